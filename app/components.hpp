@@ -0,0 +1,161 @@
+#pragma once
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+#include <jnickg/sim_ecs/snapshot.hpp>
+
+#include "spatial_grid.hpp"
+
+#include <sstream>
+
+namespace jnickg::simulator
+{
+using namespace jnickg::sim_ecs;
+
+struct WorldSpace2DComponent : public ComponentBase
+{
+    double min_x = 0.0;
+    double max_x = 0.0;
+    double min_y = 0.0;
+    double max_y = 0.0;
+
+    virtual std::ostream &print(std::ostream &os) const override
+    {
+        std::stringstream ss;
+        std::stringstream ss_base;
+        ComponentBase::print(ss_base);
+
+        ss << "WorldSpace2DComponent(base=" << ss_base.str() << ", " << "min_x=" << min_x << ", max_x=" << max_x
+           << ", min_y=" << min_y << ", max_y=" << max_y << ")";
+
+        os << ss.str();
+
+        return os;
+    }
+};
+
+/**
+ * @brief Where the entities in a world are, for neighbor and range queries
+ * @details Lives on the world entity next to its WorldSpace2DComponent and
+ * wraps around the same bounds. The spatial index system keeps it up to date
+ * from the wanderers that moved each tick, and the simulator takes wanderers
+ * out of it as they are destroyed.
+ */
+struct SpatialIndexComponent : public ComponentBase
+{
+    SpatialGrid2D grid;
+
+    SpatialIndexComponent(const WorldSpace2DComponent &space, double cell_size)
+        : grid(space.min_x, space.max_x, space.min_y, space.max_y, cell_size)
+    {
+    }
+    explicit SpatialIndexComponent(const SpatialGrid2D::layout &layout) : grid(layout) {}
+
+    virtual std::ostream &print(std::ostream &os) const override
+    {
+        std::stringstream ss;
+        std::stringstream ss_base;
+        ComponentBase::print(ss_base);
+
+        ss << "SpatialIndexComponent(base=" << ss_base.str() << ", size=" << grid.size() << ")";
+
+        os << ss.str();
+
+        return os;
+    }
+};
+
+/**
+ * @brief A plain component for an entity that wanders around its world
+ * @details This is the hottest component in the simulation, so it is a plain
+ * struct with no vtable or debug fields, stored by value in its column.
+ */
+struct WandererComponent
+{
+    entity_t owner   = NO_ENTITY; //< The world the wanderer is in
+    double x         = 0.0;
+    double y         = 0.0;
+    double speed     = 0.0;
+    double direction = 0.0;
+};
+
+inline std::ostream &operator<<(std::ostream &os, const WandererComponent &wanderer)
+{
+    std::stringstream ss;
+
+    ss << "WandererComponent(owner=" << wanderer.owner << ", x=" << wanderer.x << ", y=" << wanderer.y
+       << ", speed=" << wanderer.speed << ", direction=" << wanderer.direction << ")";
+
+    os << ss.str();
+
+    return os;
+}
+
+/**
+ * @brief Where a simulator's run had got to when its world was saved, kept on
+ * the world entity
+ * @details A run resumed from the save carries on from the same seed and
+ * frame, so it draws the same random numbers the original run would have.
+ */
+struct RunStateComponent
+{
+    std::uint64_t seed  = 0;
+    std::uint64_t frame = 0; //< SystemManager::frame() at the save
+};
+
+/**
+ * @brief Sent by the movement system when a wanderer runs off one edge of its
+ * world and reappears at the opposite one
+ */
+struct WrapEvent
+{
+    entity_t wanderer = NO_ENTITY;
+    entity_t world    = NO_ENTITY;
+};
+
+/**
+ * @brief The snapshot names and serializers for every component the simulator
+ * stores
+ */
+inline const SnapshotSchema &snapshot_schema()
+{
+    static const SnapshotSchema schema = [] {
+        SnapshotSchema s;
+        s.add<WandererComponent>("simulator::WandererComponent");
+        s.add<RunStateComponent>("simulator::RunStateComponent");
+        s.add<WorldSpace2DComponent>(
+            "simulator::WorldSpace2DComponent",
+            [](SnapshotWriter &w, const WorldSpace2DComponent &c) {
+                w.write(c.min_x);
+                w.write(c.max_x);
+                w.write(c.min_y);
+                w.write(c.max_y);
+            },
+            [](SnapshotReader &r) {
+                auto c   = std::make_shared<WorldSpace2DComponent>();
+                c->min_x = r.read<double>();
+                c->max_x = r.read<double>();
+                c->min_y = r.read<double>();
+                c->max_y = r.read<double>();
+                return c;
+            });
+        s.add<SpatialIndexComponent>(
+            "simulator::SpatialIndexComponent",
+            [](SnapshotWriter &w, const SpatialIndexComponent &c) {
+                w.write(c.grid.get_layout());
+                w.write<std::uint64_t>(c.grid.size());
+                c.grid.for_each([&](const SpatialGrid2D::entry &e) { w.write(e); });
+            },
+            [](SnapshotReader &r) {
+                auto c = std::make_shared<SpatialIndexComponent>(r.read<SpatialGrid2D::layout>());
+                auto n = r.read<std::uint64_t>();
+                for (std::uint64_t i = 0; i < n; ++i)
+                {
+                    auto e = r.read<SpatialGrid2D::entry>();
+                    c->grid.update(e.entity, e.x, e.y);
+                }
+                return c;
+            });
+        return s;
+    }();
+    return schema;
+}
+} // namespace jnickg::simulator
@@ -2,13 +2,219 @@
 
 #include "simulator.hpp"
 
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
+namespace
+{
+struct world_summary
+{
+    std::size_t wanderers = 0;
+    double total_time     = 0.0;
+    double mean_x         = 0.0;
+    double mean_y         = 0.0;
+    std::size_t wraps     = 0;
+};
+
+/**
+ * @brief Run @p worlds separate worlds side by side for @p ticks ticks, the
+ * @c i th holding `wanderers + i` wanderers, and print a line about each
+ */
+void run_worlds(std::size_t worlds, std::size_t wanderers, std::size_t ticks)
+{
+    using jnickg::simulator::simulator;
+    using jnickg::simulator::WandererComponent;
+    using namespace jnickg::sim_ecs;
+
+    WorldRunner<simulator> runner;
+    for (std::size_t i = 0; i < worlds; ++i)
+    {
+        runner.emplace(wanderers + i, false, 0);
+    }
+    runner.run(ticks);
+
+    auto summaries = runner.gather([](simulator &sim) {
+        world_summary summary;
+        summary.wraps = sim.wrap_count;
+        sim.component_manager->query<Read<WorldTimeComponent>>(
+            [&](entity_t, const WorldTimeComponent &world_time_c) { summary.total_time = world_time_c.total_time; });
+        sim.component_manager->query<Read<WandererComponent>>([&](entity_t, const WandererComponent &wanderer_c) {
+            ++summary.wanderers;
+            summary.mean_x += wanderer_c.x;
+            summary.mean_y += wanderer_c.y;
+        });
+        if (summary.wanderers != 0)
+        {
+            summary.mean_x /= static_cast<double>(summary.wanderers);
+            summary.mean_y /= static_cast<double>(summary.wanderers);
+        }
+        return summary;
+    });
+    for (std::size_t i = 0; i < summaries.size(); ++i)
+    {
+        const auto &summary = summaries[i];
+        std::cout << "World " << i << ": wanderers=" << summary.wanderers << ", total_time=" << summary.total_time
+                  << ", mean=(" << summary.mean_x << ", " << summary.mean_y << "), wraps=" << summary.wraps << '\n';
+    }
+}
+
+/**
+ * @brief Run @p sim for @p ticks ticks, adding a wanderer to its first world
+ * before every @p spawn_every th frame, as input from outside the run
+ * @details Counts frames rather than this call's ticks, so a run resumed
+ * from a snapshot spawns on the same frames the original would have.
+ */
+void run_spawning(jnickg::simulator::simulator &sim, std::size_t ticks, std::size_t spawn_every)
+{
+    using namespace jnickg::simulator;
+
+    auto world_e = NO_ENTITY;
+    sim.component_manager->query<Read<WorldSpace2DComponent>>([&](entity_t entity, const WorldSpace2DComponent &) {
+        world_e = world_e == NO_ENTITY ? entity : world_e;
+    });
+    for (std::size_t tick = 0; tick < ticks; ++tick)
+    {
+        if (sim.system_manager->frame() % spawn_every == 0)
+        {
+            sim.spawn_wanderers(world_e, 1);
+        }
+        sim.run(1);
+    }
+}
+
+/**
+ * @brief Replay the log at @p path and say whether every tick ended the way it
+ * did when recorded
+ * @return The process exit code: 0 if they all did
+ */
+int replay(const std::string &path)
+{
+    jnickg::sim_ecs::ReplayReader log(path);
+    jnickg::simulator::simulator sim(log, false);
+    auto result = sim.replay(log);
+    if (result.diverged)
+    {
+        std::cout << "Replay diverged at tick " << *result.diverged << " of " << path << std::endl;
+        return 1;
+    }
+    std::cout << "Replayed " << result.ticks << " ticks of " << path << ", every one matching" << std::endl;
+    return 0;
+}
+} // namespace
+
 int main(int argc, char *argv[])
 {
-    jnickg::simulator::simulator sim;
+    std::size_t ticks       = 20;
+    std::size_t worlds      = 0;
+    std::size_t wanderers   = 1;
+    double realtime_secs    = 0.0;
+    std::size_t defrag_us   = 0;
+    std::size_t spawn_every = 0;
+    std::optional<std::uint64_t> seed;
+    std::string load_path;
+    std::string save_path;
+    std::string record_path;
+    std::string replay_path;
+    for (int i = 1; i < argc; i += 2)
+    {
+        std::string arg = i + 1 < argc ? argv[i] : "";
+        if (arg == "--ticks")
+        {
+            ticks = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (arg == "--worlds")
+        {
+            worlds = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (arg == "--wanderers")
+        {
+            wanderers = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (arg == "--realtime")
+        {
+            realtime_secs = std::strtod(argv[i + 1], nullptr);
+        }
+        else if (arg == "--defrag-us")
+        {
+            defrag_us = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (arg == "--spawn-every")
+        {
+            spawn_every = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (arg == "--seed")
+        {
+            seed = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (arg == "--record")
+        {
+            record_path = argv[i + 1];
+        }
+        else if (arg == "--replay")
+        {
+            replay_path = argv[i + 1];
+        }
+        else if (arg == "--load")
+        {
+            load_path = argv[i + 1];
+        }
+        else if (arg == "--save")
+        {
+            save_path = argv[i + 1];
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--ticks N | --realtime SECONDS] [--wanderers N] [--seed N] [--defrag-us MICROSECONDS]"
+                      << " [--spawn-every TICKS] [--load SNAPSHOT] [--save SNAPSHOT] [--record LOG]\n"
+                      << "       " << argv[0] << " --worlds N [--ticks N] [--wanderers N]\n"
+                      << "       " << argv[0] << " --replay LOG" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!replay_path.empty())
+    {
+        return replay(replay_path);
+    }
+
+    if (worlds != 0)
+    {
+        run_worlds(worlds, wanderers, ticks);
+        return 0;
+    }
+
+    auto sim = load_path.empty()
+                 ? std::make_unique<jnickg::simulator::simulator>(wanderers, true, std::thread::hardware_concurrency(), seed)
+                 : std::make_unique<jnickg::simulator::simulator>(load_path, true, seed);
+    sim->set_maintenance_budget(std::chrono::microseconds(defrag_us));
+    if (!record_path.empty())
+    {
+        sim->start_recording(record_path);
+    }
+
+    if (realtime_secs > 0.0)
+    {
+        sim->run_realtime(std::chrono::duration_cast<jnickg::sim_ecs::duration_t>(
+            std::chrono::duration<double>(realtime_secs)));
+    }
+    else if (spawn_every != 0)
+    {
+        run_spawning(*sim, ticks, spawn_every);
+    }
+    else
+    {
+        sim->run(ticks);
+    }
 
-    sim.run(20);
+    if (!save_path.empty())
+    {
+        sim->save(save_path);
+    }
 }
@@ -1,10 +1,21 @@
 #pragma once
+#include <jnickg/sim_ecs/replay.hpp>
 #include <jnickg/sim_ecs/sim_ecs.hpp>
+#include <jnickg/sim_ecs/telemetry.hpp>
+
+#include "components.hpp"
+#include "wanderer_kernel.hpp"
 
 #include <stdlib.h>
 
+#include <algorithm>
 #include <cmath>
+#include <optional>
+#include <random>
+#include <chrono>
 #include <sstream>
+#include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -12,259 +23,516 @@ namespace jnickg::simulator
 {
 using namespace jnickg::sim_ecs;
 
-struct WorldSpace2DComponent : public ComponentBase
+struct simulator
 {
-    double min_x = 0.0;
-    double max_x = 0.0;
-    double min_y = 0.0;
-    double max_y = 0.0;
+    using ticks_t = std::size_t;
+
+    /**
+     * @brief The inputs a replay log can hold, each recorded by the method of
+     * the same name
+     */
+    enum input_kind : std::uint32_t
+    {
+        set_paused_input = 1,
+        set_world_paused_input,
+        spawn_wanderers_input,
+    };
 
-    virtual std::ostream &print(std::ostream &os) const override
+    /**
+     * @brief How a replay() went
+     */
+    struct replay_result
     {
-        std::stringstream ss;
-        std::stringstream ss_base;
-        ComponentBase::print(ss_base);
+        ticks_t ticks = 0;               //< Ticks replayed, up to and including any that diverged
+        std::optional<ticks_t> diverged; //< The first tick that applied other commands, or whose world hashed
+                                         // differently, than when recorded
+    };
 
-        ss << "WorldSpace2DComponent(base=" << ss_base.str() << ", " << "min_x=" << min_x << ", max_x=" << max_x
-           << ", min_y=" << min_y << ", max_y=" << max_y << ")";
+    handle<Telemetry> telemetry;                //< Where the systems report to, if they report; outlives them
+    handle<ComponentManager> component_manager = std::make_shared<ComponentManager>();
+    handle<SystemManager> system_manager       = std::make_shared<SystemManager>(std::thread::hardware_concurrency());
+
+    duration_t tick_length = std::chrono::seconds(1); //< Real time per tick in run_realtime(), one world time step
+
+    handle<Defragmenter> defragmenter;                  //< Keeps each world's wanderers together, in spatial order
+    duration_t maintenance_budget = duration_t::zero(); //< Time run() gives the defragmenter after each tick
 
-        os << ss.str();
+    std::size_t wrap_count = 0; //< Times a wanderer has wrapped around its world's edges since this simulator started
 
-        return os;
+    std::uint64_t seed = 0;          //< Where everything random in the world starts from
+    handle<ReplayRecorder> recorder; //< Where inputs and ticks are recorded to, if anywhere
+
+//     using diagnostic_system_t                     = GenericSystem<WandererComponent>;
+//     handle<diagnostic_system_t> diagnostic_system = std::make_shared<diagnostic_system_t>(
+// );
+
+    /**
+     * @param wanderer_count How many wanderers to put in the world. The first
+     * always starts at the origin heading along +x; the rest are scattered
+     * from @p seed, so every run with the same seed is the same.
+     * @param report Print the world time and every wanderer that moved each
+     * tick
+     * @param worker_count Threads for running systems in parallel within this
+     * world; 0 when a WorldRunner is already running many worlds side by side
+     * @param seed Where everything random starts from; the wanderer count if
+     * not given
+     */
+    explicit simulator(std::size_t wanderer_count = 1, bool report = true,
+        std::size_t worker_count = std::thread::hardware_concurrency(), std::optional<std::uint64_t> seed = {})
+        : system_manager{std::make_shared<SystemManager>(worker_count)}, seed{seed.value_or(wanderer_count)}
+    {
+        this->system_manager->set_seed(this->seed);
+        add_systems(report);
+        create_world(wanderer_count);
     }
-};
 
-struct WandererComponent : public OwnedComponent
-{
-    double x         = 0.0;
-    double y         = 0.0;
-    double speed     = 0.0;
-    double direction = 0.0;
+    /**
+     * @brief Resume the world saved by save() at @p snapshot_path, from the
+     * seed and frame it was saved at
+     * @param seed Branch off with this seed instead of the saved one
+     */
+    simulator(const std::string &snapshot_path, bool report, std::optional<std::uint64_t> seed = {})
+    {
+        add_systems(report);
+        read_snapshot(*this->component_manager, snapshot_schema(), snapshot_path);
+        this->component_manager->query<Read<RunStateComponent>>([this](entity_t, const RunStateComponent &run_c) {
+            this->seed = run_c.seed;
+            this->system_manager->set_frame(run_c.frame);
+        });
+        this->seed = seed.value_or(this->seed);
+        this->system_manager->set_seed(this->seed);
+    }
 
-    WandererComponent(entity_t world) : OwnedComponent{world} {}
-    WandererComponent()          = delete;
-    virtual ~WandererComponent() = default;
+    /**
+     * @brief Start from the world @p log was recorded from, with its seed and
+     * frame, to replay() it
+     */
+    simulator(const ReplayReader &log, bool report) : seed{log.seed()}
+    {
+        this->system_manager->set_seed(this->seed);
+        this->system_manager->set_frame(log.frame());
+        this->system_manager->set_deterministic(true);
+        add_systems(report);
+        log.restore(*this->component_manager, snapshot_schema());
+    }
 
-    virtual std::ostream &print(std::ostream &os) const override
+    simulator(const simulator &)            = delete;
+    simulator(simulator &&)                 = delete;
+    simulator &operator=(const simulator &) = delete;
+    simulator &operator=(simulator &&)      = delete;
+    virtual ~simulator()                    = default;
+
+    void run(ticks_t t)
     {
-        std::stringstream ss;
-        std::stringstream ss_base;
-        OwnedComponent::print(ss_base);
+        for (ticks_t i = 0; i < t; ++i)
+        {
+            auto all_entities = this->component_manager->get_all_entities();
+            this->system_manager->update(all_entities);
+            end_tick();
+            if (this->defragmenter && !this->recorder)
+            {
+                this->defragmenter->step(this->maintenance_budget);
+            }
+        }
+    }
 
-        ss << "WandererComponent(base=" << ss_base.str() << ", " << "x=" << x << ", y=" << y << ", speed=" << speed
-           << ", direction=" << direction << ")";
+    /**
+     * @brief Record the rest of this run, from the world, seed and frame as
+     * they are now, to a replay log at @p path, along with every command the
+     * systems apply
+     * @details The run is made deterministic, and the defragmenter is left
+     * off, since how far it gets each tick depends on the clock.
+     */
+    void start_recording(const std::string &path)
+    {
+        this->system_manager->set_deterministic(true);
+        this->recorder = std::make_shared<ReplayRecorder>(
+            path, *this->component_manager, snapshot_schema(), this->seed, this->system_manager->frame());
+        this->system_manager->commands(*this->component_manager).set_log(this->recorder.get());
+    }
 
-        os << ss.str();
+    /**
+     * @brief Run the ticks recorded in @p log as fast as possible, applying
+     * their inputs, and stop at the first tick that applies different commands
+     * or ends in a different world than it did when recorded
+     */
+    replay_result replay(ReplayReader &log)
+    {
+        replay_result result;
+        ReplayCommandCheck check(log, snapshot_schema());
+        auto &commands = this->system_manager->commands(*this->component_manager);
+        commands.set_log(&check);
+        auto apply = [this](std::uint32_t kind, SnapshotReader &payload) { apply_input(kind, payload); };
+        while (auto expected = log.next_tick(apply))
+        {
+            run(1);
+            ++result.ticks;
+            if (!check.end_tick() || state_hash(*this->component_manager, snapshot_schema()) != *expected)
+            {
+                result.diverged = result.ticks - 1;
+                break;
+            }
+        }
+        commands.set_log(nullptr);
+        return result;
+    }
 
-        return os;
+    /**
+     * @brief Spend up to @p budget after each tick of run() reordering the
+     * wanderers, by world and then along a Z-order curve through it, so ones
+     * near each other are also near each other in memory; zero turns it off
+     * @details Ignored while recording; see start_recording().
+     */
+    void set_maintenance_budget(duration_t budget)
+    {
+        this->maintenance_budget = budget;
+        if (budget == duration_t::zero())
+        {
+            this->defragmenter.reset();
+        }
+        else if (!this->defragmenter)
+        {
+            this->defragmenter = std::make_shared<Defragmenter>(*this->component_manager, [this](entity_t entity) {
+                return locality_key(entity);
+            });
+        }
     }
-};
 
-struct simulator
-{
-    using ticks_t = std::size_t;
+    /**
+     * @brief Run ticks in step with the wall clock for @p wall
+     * @details Falls at most @p max_catch_up ticks behind before dropping time,
+     * and defers reporting on any tick that takes longer than a tick.
+     */
+    void run_realtime(duration_t wall, std::size_t max_catch_up = 4)
+    {
+        this->system_manager->set_time_budget(tick_length);
+        FixedStepScheduler scheduler(*this->system_manager, *this->component_manager, tick_length, max_catch_up);
+        scheduler.set_after_update([this] { end_tick(); });
+        scheduler.run_for(wall);
+        this->system_manager->set_time_budget(duration_t::zero());
+    }
 
-    handle<ComponentManager> component_manager = std::make_shared<ComponentManager>();
-    handle<SystemManager> system_manager       = std::make_shared<SystemManager>();
+    /**
+     * @brief Write the whole world to a snapshot at @p path, along with the
+     * seed and frame, to resume or branch from later
+     */
+    void save(const std::string &path)
+    {
+        this->component_manager->query<Write<RunStateComponent>>([this](entity_t, RunStateComponent &run_c) {
+            run_c.seed  = this->seed;
+            run_c.frame = this->system_manager->frame();
+        });
+        write_snapshot(*this->component_manager, snapshot_schema(), path);
+    }
 
-//     using diagnostic_system_t                     = GenericSystem<WandererComponent>;
-//     handle<diagnostic_system_t> diagnostic_system = std::make_shared<diagnostic_system_t>(
-// );
+    /**
+     * @brief Stop or restart @p entity's time, leaving the rest of its world
+     * running
+     * @details A paused entity is disabled, so the systems pass over it without
+     * looking at it.
+     */
+    void set_paused(entity_t entity, bool paused)
+    {
+        record(set_paused_input, entity, static_cast<std::uint8_t>(paused));
+        if (auto timed_c = this->component_manager->get_ref<TimedEntityComponent>(entity))
+        {
+            timed_c->running = !paused;
+        }
+        this->component_manager->set_enabled(entity, !paused);
+    }
+
+    /**
+     * @brief Stop or restart time in the world @p world_e, and so for
+     * everything in it
+     */
+    void set_world_paused(entity_t world_e, bool paused)
+    {
+        record(set_world_paused_input, world_e, static_cast<std::uint8_t>(paused));
+        if (auto world_time_c = this->component_manager->get_ref<WorldTimeComponent>(world_e))
+        {
+            world_time_c->running = !paused;
+        }
+    }
+
+    /**
+     * @brief Add @p count wanderers to the world @p world_e, scattered from the
+     * seed and the current tick
+     */
+    void spawn_wanderers(entity_t world_e, std::size_t count)
+    {
+        record(spawn_wanderers_input, world_e, static_cast<std::uint64_t>(count));
+        if (count == 0 || !this->component_manager->has<WorldSpace2DComponent>(world_e))
+        {
+            return;
+        }
+        std::mt19937_64 rng(stable_random(this->seed, this->system_manager->frame()));
+        scatter(world_e, add_wanderers(world_e, count), 0, rng);
+    }
 
-    simulator()
+  private:
+    template <typename... Fields> void record(input_kind kind, const Fields &...fields)
     {
+        if (this->recorder)
+        {
+            this->recorder->record(kind, fields...);
+        }
+    }
+
+    void end_tick()
+    {
+        if (this->recorder)
+        {
+            this->recorder->end_tick(state_hash(*this->component_manager, snapshot_schema()));
+        }
+    }
+
+    /**
+     * @brief Apply an input read back from a replay log
+     */
+    void apply_input(std::uint32_t kind, SnapshotReader &payload)
+    {
+        auto entity = payload.read<entity_t>();
+        switch (kind)
+        {
+        case set_paused_input:
+            set_paused(entity, payload.read<std::uint8_t>() != 0);
+            break;
+        case set_world_paused_input:
+            set_world_paused(entity, payload.read<std::uint8_t>() != 0);
+            break;
+        case spawn_wanderers_input:
+            spawn_wanderers(entity, payload.read<std::uint64_t>());
+            break;
+        default:
+            throw std::runtime_error("Unknown input kind " + std::to_string(kind) + " in replay log");
+        }
+    }
+
+    /**
+     * @brief The index of a wanderer's world in the high 32 bits, and where it
+     * is in that world as a Morton code in the low 32
+     */
+    std::uint64_t locality_key(entity_t entity) const
+    {
+        std::uint64_t world_key = entity_index(this->component_manager->owner_of(entity));
+        auto wanderer_c         = this->component_manager->get_ref<const WandererComponent>(entity);
+        auto world_space_c      = wanderer_c ? this->component_manager->get_ref<const WorldSpace2DComponent>(wanderer_c->owner)
+                                             : nullptr;
+        if (!world_space_c)
+        {
+            return world_key << 32;
+        }
+        auto cell = [](double v, double min, double max) {
+            auto t = max > min ? (v - min) / (max - min) : 0.0;
+            return static_cast<std::uint32_t>(std::clamp(t, 0.0, 1.0) * 65535.0);
+        };
+        return world_key << 32 | morton_code(cell(wanderer_c->x, world_space_c->min_x, world_space_c->max_x),
+                                             cell(wanderer_c->y, world_space_c->min_y, world_space_c->max_y));
+    }
+
+    void add_systems(bool report)
+    {
+        if (report)
+        {
+            this->telemetry = std::make_shared<Telemetry>();
+        }
+
         // Add the systems to the system manager
         // auto world_time_s   = this->system_manager->register_new(this->world_time_system);
-        auto world_time_s = this->system_manager->new_system<WorldTimeComponent>(
-            "World Time System", system_state::enabled,
-            [this](entity_t entity) {
-                auto should_run = this->component_manager->has<WorldTimeComponent>(entity);
-                return should_run;
-            },
-            [this](entity_t entity) {
-                return this->component_manager->get_view<WorldTimeComponent>(entity);
-            },
-            [](entity_t entity, auto components) {
-                component_set_t updated_components;
-                auto world_time_c = std::get<0>(components);
-                if (!world_time_c || !world_time_c->running)
+        auto world_time_s = this->system_manager->new_query_system<Write<WorldTimeComponent>>(
+            "World Time System", system_state::enabled, *this->component_manager,
+            [this, report](entity_t, WorldTimeComponent &world_time_c) {
+                if (!world_time_c.running)
                 {
                     // No time for this entity, so nothing to do
-                    return updated_components;
+                    return;
                 }
-    
+
                 // Increment the time
-                world_time_c->delta_time = world_time_c->step * world_time_c->time_scale;
-                world_time_c->total_time += world_time_c->delta_time;
-                std::cout << "World time updated: " << world_time_c->total_time << std::endl;
-    
-                return updated_components;
+                world_time_c.delta_time = world_time_c.step * world_time_c.time_scale;
+                world_time_c.total_time += world_time_c.delta_time;
+                if (report)
+                {
+                    this->telemetry->emit(world_time_c.total_time, [](std::ostream &os, const double &total_time) {
+                        os << "World time updated: " << total_time << '\n';
+                    });
+                }
             });
 
 
-        auto movement_s    = this->system_manager->new_system<WandererComponent, TimedEntityComponent>(
-            "Movement System", system_state::enabled,
-            [this](entity_t entity) -> bool {
-                if (!this->component_manager->has_view<WandererComponent, TimedEntityComponent>(entity))
-                {
-                    // No wanderer component, so nothing to do
-                    return false;
-                }
-                auto [wanderer_c, timed_c] = this->component_manager->get_view<WandererComponent, TimedEntityComponent>(entity);
-                auto world_e = wanderer_c->owner;
-                return this->component_manager->has_view<WandererComponent, TimedEntityComponent>(entity)
-                    && this->component_manager->has_view<WorldTimeComponent, WorldSpace2DComponent>(world_e);
-            },
-            [this](entity_t entity) -> auto {
-                return this->component_manager->get_view<WandererComponent, TimedEntityComponent>(entity);
-            },
-            [this](entity_t entity, auto components) {
-                component_set_t updated_components;
-                auto& [wanderer_c, timed_c] = components;
-                if (!wanderer_c || !timed_c)
-                {
-                    // No wanderer component, so nothing to do
-                    return updated_components;
-                }
-                auto world_e       = wanderer_c->owner;
-                auto [world_time_c, world_space_c] = this->component_manager->get_view<WorldTimeComponent, WorldSpace2DComponent>(world_e);
-                if (!wanderer_c || !timed_c || !world_time_c || !world_space_c)
-                {
-                    // No wanderer component, so nothing to do
-                    return updated_components;
-                }
-    
-                if (!timed_c->running || !world_time_c->running)
-                {
-                    // Time is not running, so it can't wander
-                    return updated_components;
-                }
-    
-                // How much time has passed
-                auto time_passed = world_time_c->delta_time;
-                if (time_passed == 0.0)
-                {
-                    // No time has passed, so nothing to do
-                    return updated_components;
-                }
-    
-                // How much time has passed in the entity's time
-                auto entity_time_passed = time_passed * timed_c->time_scale;
-                if (entity_time_passed == 0.0)
-                {
-                    // No time has passed, so nothing to do
-                    return updated_components;
-                }
-    
-                // Actually move the wanderer
-                wanderer_c->x += wanderer_c->speed * entity_time_passed * std::cos(wanderer_c->direction);
-                wanderer_c->y += wanderer_c->speed * entity_time_passed * std::sin(wanderer_c->direction);
-                // Check if the wanderer is out of bounds
-                if (wanderer_c->x < world_space_c->min_x || wanderer_c->x > world_space_c->max_x
-                    || wanderer_c->y < world_space_c->min_y || wanderer_c->y > world_space_c->max_y)
-                {
-                    // Wanderer is out of bounds, so wrap around world bounds
-                    if (wanderer_c->x < world_space_c->min_x)
+        auto &wraps     = this->system_manager->events<WrapEvent>();
+        auto movement_s = this->system_manager->new_batch_system<Write<WandererComponent>, Read<TimedEntityComponent>>(
+            "Movement System", system_state::enabled, *this->component_manager,
+            [this, &wraps](span<const entity_t> entities, span<WandererComponent> wanderers,
+                span<const handle<TimedEntityComponent>> timed) -> span<const std::uint8_t> {
+                // How much time each wanderer has to move, whether it moved,
+                // and whether it wrapped around. Paused wanderers are
+                // disabled, so never get here.
+                thread_local std::vector<double> dt;
+                thread_local std::vector<std::uint8_t> moved;
+                thread_local std::vector<std::uint8_t> wrapped;
+                dt.resize(wanderers.size());
+                moved.assign(wanderers.size(), 0);
+                wrapped.resize(wanderers.size());
+
+                // Wanderers are grouped by the world that owns them, so only look
+                // each world up once per run of them
+                this->component_manager->for_each_owner_run(entities, [&](entity_t world_e, std::size_t begin, std::size_t end) {
+                    auto [world_time_c, world_space_c] = this->component_manager->get_refs<const WorldTimeComponent, const WorldSpace2DComponent>(world_e);
+                    if (!world_time_c || !world_space_c || !world_time_c->running || world_time_c->delta_time == 0.0)
                     {
-                        wanderer_c->x = world_space_c->max_x;
+                        // No world to wander in, or no time has passed in it
+                        return;
                     }
-                    else if (wanderer_c->x > world_space_c->max_x)
+
+                    bool any_time = false;
+                    for (auto i = begin; i < end; ++i)
                     {
-                        wanderer_c->x = world_space_c->min_x;
+                        dt[i]    = world_time_c->delta_time * timed[i]->time_scale;
+                        moved[i] = dt[i] != 0.0;
+                        any_time = any_time || moved[i];
                     }
-                    if (wanderer_c->y < world_space_c->min_y)
+                    if (!any_time)
                     {
-                        wanderer_c->y = world_space_c->max_y;
+                        return;
                     }
-                    else if (wanderer_c->y > world_space_c->max_y)
+
+                    wrap_bounds bounds{world_space_c->min_x, world_space_c->max_x, world_space_c->min_y, world_space_c->max_y};
+                    move_wanderers(wanderers.data() + begin, dt.data() + begin, end - begin, bounds, wrapped.data() + begin);
+
+                    for (auto i = begin; i < end; ++i)
                     {
-                        wanderer_c->y = world_space_c->min_y;
+                        if (wrapped[i])
+                        {
+                            wraps.send(WrapEvent{entities[i], world_e});
+                        }
                     }
-                    // Update the wanderer component
-                    updated_components.emplace(wanderer_c);
+                });
+                return {moved.data(), moved.size()};
+            });
+        // Keep each world's spatial index in step with the wanderers that moved
+        auto spatial_index_s = this->system_manager->new_query_system<Read<WandererComponent>, Changed<WandererComponent>>(
+            "Spatial Index System", system_state::enabled, *this->component_manager,
+            [this](entity_t entity, const WandererComponent &wanderer_c) {
+                if (auto index_c = this->component_manager->get_ref<SpatialIndexComponent>(wanderer_c.owner))
+                {
+                    index_c->grid.update(entity, wanderer_c.x, wanderer_c.y);
                 }
-    
-                return updated_components;
+            });
+
+        // And take wanderers out of it as they are destroyed, however that
+        // happens, so queries never turn up dead ones
+        this->component_manager->set_on_destroy([this](entity_t entity) {
+            auto wanderer_c = this->component_manager->get_ref<const WandererComponent>(entity);
+            if (!wanderer_c)
+            {
+                return;
+            }
+            if (auto index_c = this->component_manager->get_ref<SpatialIndexComponent>(wanderer_c->owner))
+            {
+                index_c->grid.erase(entity);
             }
-        );
-        auto diagnostic_s   = this->system_manager->new_system<WandererComponent>(
-            "Diagnostic System", system_state::enabled,
-            [this](entity_t entity) -> bool {
-                auto can_run = this->component_manager->has_view<WandererComponent>(entity);
-                return can_run;
-            },
-            [this](entity_t entity) -> auto {
-                return this->component_manager->get_view<WandererComponent>(entity);
-            },
-            [](entity_t entity, auto components) -> component_set_t {
-                component_set_t updated_components;
-                auto& [wanderer_c] = components;
-                if (!wanderer_c)
+        });
+
+        auto wrap_counter_s = this->system_manager->new_event_system<WrapEvent>(
+            "Wrap Counter System", system_state::enabled,
+            [this](span<const WrapEvent> events) { this->wrap_count += events.size(); });
+
+        // Only report wanderers that moved since the last report
+        auto diagnostic_s = this->system_manager->new_query_system<Read<WandererComponent>, Changed<WandererComponent>>(
+            "Diagnostic System", report ? system_state::enabled : system_state::disabled, *this->component_manager,
+            [this](entity_t, const WandererComponent &wanderer_c) {
+                if (this->telemetry)
                 {
-                    // No wanderer component, so nothing to do
-                    return updated_components;
+                    this->telemetry->emit(wanderer_c, [](std::ostream &os, const WandererComponent &w) { os << w << '\n'; });
                 }
-    
-                std::stringstream ss;
-                ss << *wanderer_c << std::endl;
-                std::cout << ss.str();
-    
-                return updated_components;
             });
 
+        // The movement system also looks up its world's components
+        this->system_manager->declare_reads<WorldTimeComponent, WorldSpace2DComponent>(movement_s);
+        this->system_manager->declare_writes<SpatialIndexComponent>(spatial_index_s);
+
+        // Wanderers never touch each other, so movement can be split across workers
+        this->system_manager->set_parallel(movement_s, true);
+
+        // Reports are the first thing to go when a tick runs long
+        this->system_manager->set_priority(diagnostic_s, -1);
+
         // Add dependencies
         this->system_manager->add_dependency(world_time_s, diagnostic_s);
         this->system_manager->add_dependency(movement_s, world_time_s);
+        this->system_manager->add_dependency(spatial_index_s, movement_s);
+        this->system_manager->add_dependency(wrap_counter_s, movement_s);
+
+    }
 
+    void create_world(std::size_t wanderer_count)
+    {
         //
         // Create the world
         //
-        auto world_e = create_entity();
-
-        auto world_time_c = std::make_shared<WorldTimeComponent>();
-        this->component_manager->add(world_e, world_time_c);
-        world_time_c->running    = true;
-        world_time_c->step       = 1.0;
-        world_time_c->time_scale = 1.0;
-        world_time_c->total_time = 0.0;
-        world_time_c->delta_time = 0.0;
-
-        auto world_space_2d_c = std::make_shared<WorldSpace2DComponent>();
-        this->component_manager->add(world_e, world_space_2d_c);
-        world_space_2d_c->min_x = -10.0;
-        world_space_2d_c->max_x = 10.0;
-        world_space_2d_c->min_y = -10.0;
-        world_space_2d_c->max_y = 10.0;
+        auto world_e = this->component_manager->create_entity();
+
+        auto &world_time_c      = this->component_manager->emplace<WorldTimeComponent>(world_e);
+        world_time_c.running    = true;
+        world_time_c.step       = 1.0;
+        world_time_c.time_scale = 1.0;
+        world_time_c.total_time = 0.0;
+        world_time_c.delta_time = 0.0;
+
+        auto &world_space_2d_c = this->component_manager->emplace<WorldSpace2DComponent>(world_e);
+        world_space_2d_c.min_x = -10.0;
+        world_space_2d_c.max_x = 10.0;
+        world_space_2d_c.min_y = -10.0;
+        world_space_2d_c.max_y = 10.0;
+
+        this->component_manager->emplace<SpatialIndexComponent>(world_e, world_space_2d_c, 2.0);
+        this->component_manager->emplace<RunStateComponent>(world_e, RunStateComponent{this->seed, 0});
 
         //
-        // Create the wanderer
+        // Create the wanderers. The first stays at the origin heading along +x.
         //
-        auto wanderer_e = create_entity();
-
-        auto timed_entity_c = std::make_shared<TimedEntityComponent>(world_e);
-        this->component_manager->add(wanderer_e, timed_entity_c);
-        timed_entity_c->running    = true;
-        timed_entity_c->time_scale = 1.0;
-
-        auto wanderer_c = std::make_shared<WandererComponent>(world_e);
-        this->component_manager->add(wanderer_e, wanderer_c);
-        wanderer_c->x         = 0.0;
-        wanderer_c->y         = 0.0;
-        wanderer_c->speed     = 1.0;
-        wanderer_c->direction = 0.0;
+        std::mt19937_64 rng(this->seed);
+        scatter(world_e, add_wanderers(world_e, wanderer_count), 1, rng);
     }
-    simulator(const simulator &)            = delete;
-    simulator(simulator &&)                 = delete;
-    simulator &operator=(const simulator &) = delete;
-    simulator &operator=(simulator &&)      = delete;
-    virtual ~simulator()                    = default;
 
-    void run(ticks_t t)
+    /**
+     * @brief Spawn @p count wanderers owned by the world @p world_e, all at
+     * the origin heading along +x
+     */
+    entity_range add_wanderers(entity_t world_e, std::size_t count)
     {
-        for (ticks_t i = 0; i < t; ++i)
+        TimedEntityComponent timed_entity_c(world_e);
+        timed_entity_c.running    = true;
+        timed_entity_c.time_scale = 1.0;
+
+        WandererComponent wanderer_c{};
+        wanderer_c.owner = world_e;
+        wanderer_c.speed = 1.0;
+
+        auto wanderers = this->component_manager->spawn_batch(count, timed_entity_c, wanderer_c);
+        this->component_manager->set_owner(wanderers, world_e);
+        return wanderers;
+    }
+
+    /**
+     * @brief Give the wanderers from @p first on a random place in the world
+     * @p world_e, speed and direction
+     */
+    void scatter(entity_t world_e, const entity_range &wanderers, std::size_t first, std::mt19937_64 &rng)
+    {
+        auto world_space_c = this->component_manager->get_ref<const WorldSpace2DComponent>(world_e);
+        std::uniform_real_distribution<double> x(world_space_c->min_x, world_space_c->max_x);
+        std::uniform_real_distribution<double> y(world_space_c->min_y, world_space_c->max_y);
+        std::uniform_real_distribution<double> speed(0.1, 2.0);
+        std::uniform_real_distribution<double> direction(-std::acos(-1.0), std::acos(-1.0));
+        for (std::size_t i = first; i < wanderers.size(); ++i)
         {
-            auto all_entities = this->component_manager->get_all_entities();
-            this->system_manager->update(all_entities);
+            auto wanderer       = this->component_manager->get_ref<WandererComponent>(wanderers[i]);
+            wanderer->x         = x(rng);
+            wanderer->y         = y(rng);
+            wanderer->speed     = speed(rng);
+            wanderer->direction = direction(rng);
         }
     }
 };
@@ -0,0 +1,400 @@
+#pragma once
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace jnickg::simulator
+{
+using namespace jnickg::sim_ecs;
+
+/**
+ * @brief A uniform grid of entity positions over a world whose edges wrap
+ * around
+ * @details The world `[min_x, max_x] x [min_y, max_y]` is split into square-ish
+ * cells, and each entity lives in exactly one cell. Moving an entity within
+ * its cell only rewrites its position; moving it to another cell is a
+ * swap-remove and a push, so keeping the grid up to date costs O(1) per
+ * entity that moved. Distances are measured the short way around the wrapped
+ * edges.
+ *
+ * Entities are located through a dense table indexed by their entity index,
+ * like the ComponentManager's records.
+ */
+class SpatialGrid2D
+{
+  public:
+    struct entry
+    {
+        entity_t entity = NO_ENTITY;
+        double x        = 0.0;
+        double y        = 0.0;
+    };
+
+    /**
+     * @brief What the grid was built with, enough to build an identical empty
+     * grid
+     */
+    struct layout
+    {
+        double min_x     = 0.0;
+        double max_x     = 0.0;
+        double min_y     = 0.0;
+        double max_y     = 0.0;
+        double cell_size = 1.0;
+    };
+
+    SpatialGrid2D(double min_x, double max_x, double min_y, double max_y, double cell_size)
+        : built_with{min_x, max_x, min_y, max_y, cell_size}, min_x(min_x), min_y(min_y), width(max_x - min_x),
+          height(max_y - min_y)
+    {
+        cells_x = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(width / cell_size)));
+        cells_y = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(height / cell_size)));
+        cell_w  = width > 0.0 ? width / cells_x : 1.0;
+        cell_h  = height > 0.0 ? height / cells_y : 1.0;
+        cells.resize(cells_x * cells_y);
+    }
+
+    explicit SpatialGrid2D(const layout &l) : SpatialGrid2D(l.min_x, l.max_x, l.min_y, l.max_y, l.cell_size) {}
+
+    inline const layout &get_layout() const { return built_with; }
+    inline std::size_t size() const { return count; }
+    inline bool contains(entity_t entity) const { return find(entity) != nullptr; }
+
+    /**
+     * @brief Insert @p entity at `(x, y)`, or move it there if it is already in
+     * the grid
+     */
+    void update(entity_t entity, double x, double y)
+    {
+        auto cell = cell_of(x, y);
+        if (auto *loc = find(entity))
+        {
+            if (loc->cell == cell)
+            {
+                auto &e = cells[cell][loc->slot];
+                e.x     = x;
+                e.y     = y;
+                return;
+            }
+            unlink(*loc);
+        }
+        else
+        {
+            auto index = entity_index(entity);
+            if (index >= locations.size())
+            {
+                locations.resize(index + 1);
+            }
+            ++count;
+        }
+        cells[cell].push_back(entry{entity, x, y});
+        locations[entity_index(entity)] = location{entity, cell, cells[cell].size() - 1};
+    }
+
+    /**
+     * @brief Remove @p entity from the grid, if it is there
+     */
+    void erase(entity_t entity)
+    {
+        if (auto *loc = find(entity))
+        {
+            unlink(*loc);
+            *loc = location{};
+            --count;
+        }
+    }
+
+    void clear()
+    {
+        for (auto &cell : cells)
+        {
+            cell.clear();
+        }
+        locations.clear();
+        count = 0;
+    }
+
+    /**
+     * @brief Call `fn(const entry &)` for every entity in the grid, in no
+     * particular order
+     */
+    template <typename F> void for_each(F &&fn) const
+    {
+        for (const auto &cell : cells)
+        {
+            for (const auto &e : cell)
+            {
+                fn(e);
+            }
+        }
+    }
+
+    /**
+     * @brief The shortest distance between two points, going around the wrapped
+     * edges if that is shorter
+     */
+    inline double distance_sq(double ax, double ay, double bx, double by) const
+    {
+        auto dx = wrapped_delta(ax - bx, width);
+        auto dy = wrapped_delta(ay - by, height);
+        return dx * dx + dy * dy;
+    }
+
+    /**
+     * @brief Call `fn(const entry &)` for every entity within @p radius of
+     * `(x, y)`
+     */
+    template <typename F> void for_each_in_radius(double x, double y, double radius, F &&fn) const
+    {
+        auto radius_sq = radius * radius;
+        for_each_cell_in(x - radius, x + radius, y - radius, y + radius, [&](const std::vector<entry> &cell) {
+            for (const auto &e : cell)
+            {
+                if (distance_sq(x, y, e.x, e.y) <= radius_sq)
+                {
+                    fn(e);
+                }
+            }
+        });
+    }
+
+    /**
+     * @brief Call `fn(const entry &)` for every entity inside the box
+     * `[x0, x1] x [y0, y1]`, which may extend past the world's edges and wrap
+     */
+    template <typename F> void for_each_in_box(double x0, double y0, double x1, double y1, F &&fn) const
+    {
+        for_each_cell_in(x0, x1, y0, y1, [&](const std::vector<entry> &cell) {
+            for (const auto &e : cell)
+            {
+                if (in_wrapped_range(e.x, x0, x1, width) && in_wrapped_range(e.y, y0, y1, height))
+                {
+                    fn(e);
+                }
+            }
+        });
+    }
+
+    std::vector<entry> in_radius(double x, double y, double radius) const
+    {
+        std::vector<entry> found;
+        for_each_in_radius(x, y, radius, [&](const entry &e) { found.push_back(e); });
+        return found;
+    }
+
+    std::vector<entry> in_box(double x0, double y0, double x1, double y1) const
+    {
+        std::vector<entry> found;
+        for_each_in_box(x0, y0, x1, y1, [&](const entry &e) { found.push_back(e); });
+        return found;
+    }
+
+    /**
+     * @brief The @p k entities closest to `(x, y)`, nearest first, leaving out
+     * @p exclude
+     * @details Searches rings of cells outward from `(x, y)` and stops once the
+     * k-th best candidate is closer than anything an unsearched ring could hold.
+     */
+    std::vector<entry> nearest(double x, double y, std::size_t k, entity_t exclude = NO_ENTITY) const
+    {
+        std::vector<std::pair<double, entry>> best;
+        if (k == 0 || count == 0)
+        {
+            return {};
+        }
+        auto by_distance = [](const auto &a, const auto &b) { return a.first < b.first; };
+        auto [cx, cy]    = cell_coords(x, y);
+        auto max_ring    = std::max(cells_x, cells_y) / 2 + 1;
+        for (std::size_t ring = 0; ring <= max_ring; ++ring)
+        {
+            for_each_cell_in_ring(cx, cy, ring, [&](const std::vector<entry> &cell) {
+                for (const auto &e : cell)
+                {
+                    if (e.entity == exclude)
+                    {
+                        continue;
+                    }
+                    auto d = distance_sq(x, y, e.x, e.y);
+                    if (best.size() < k)
+                    {
+                        best.emplace_back(d, e);
+                        std::push_heap(best.begin(), best.end(), by_distance);
+                    }
+                    else if (d < best.front().first)
+                    {
+                        std::pop_heap(best.begin(), best.end(), by_distance);
+                        best.back() = {d, e};
+                        std::push_heap(best.begin(), best.end(), by_distance);
+                    }
+                }
+            });
+            // Every point outside the rings searched so far is at least this far away
+            auto covered = static_cast<double>(ring) * std::min(cell_w, cell_h);
+            if (best.size() == k && best.front().first <= covered * covered)
+            {
+                break;
+            }
+        }
+        std::sort_heap(best.begin(), best.end(), by_distance);
+        std::vector<entry> found;
+        found.reserve(best.size());
+        for (auto &[d, e] : best)
+        {
+            found.push_back(e);
+        }
+        return found;
+    }
+
+  private:
+    struct location
+    {
+        entity_t entity  = NO_ENTITY;
+        std::size_t cell  = 0;
+        std::size_t slot  = 0;
+    };
+
+    layout built_with;
+    double min_x;
+    double min_y;
+    double width;
+    double height;
+    double cell_w       = 1.0;
+    double cell_h       = 1.0;
+    std::size_t cells_x = 1;
+    std::size_t cells_y = 1;
+    std::size_t count   = 0;
+    std::vector<std::vector<entry>> cells;
+    std::vector<location> locations; //< Indexed by entity index
+
+    static inline double wrapped_delta(double d, double extent)
+    {
+        if (extent <= 0.0)
+        {
+            return std::fabs(d);
+        }
+        d = std::fmod(std::fabs(d), extent);
+        return std::min(d, extent - d);
+    }
+
+    static inline bool in_wrapped_range(double v, double lo, double hi, double extent)
+    {
+        if (extent <= 0.0 || hi - lo >= extent)
+        {
+            return true;
+        }
+        auto offset = std::fmod(v - lo, extent);
+        offset      = offset < 0.0 ? offset + extent : offset;
+        return offset <= hi - lo;
+    }
+
+    inline location *find(entity_t entity)
+    {
+        auto index = entity_index(entity);
+        return index < locations.size() && locations[index].entity == entity ? &locations[index] : nullptr;
+    }
+
+    inline const location *find(entity_t entity) const
+    {
+        return const_cast<SpatialGrid2D *>(this)->find(entity);
+    }
+
+    /**
+     * @brief Swap-remove the entry at @p loc from its cell, fixing up the
+     * location of the entry moved into its slot
+     */
+    void unlink(const location &loc)
+    {
+        auto &cell = cells[loc.cell];
+        if (loc.slot + 1 != cell.size())
+        {
+            cell[loc.slot]                                      = cell.back();
+            locations[entity_index(cell[loc.slot].entity)].slot = loc.slot;
+        }
+        cell.pop_back();
+    }
+
+    /**
+     * @brief Whether @p offset cells from a center is the nearest way to reach
+     * the cell it lands on in a wrapped row of @p n cells
+     */
+    static inline bool in_offset_range(std::int64_t offset, std::size_t n)
+    {
+        return offset >= -static_cast<std::int64_t>((n - 1) / 2) && offset <= static_cast<std::int64_t>(n / 2);
+    }
+
+    static inline std::int64_t wrap_index(std::int64_t i, std::size_t n)
+    {
+        auto m = i % static_cast<std::int64_t>(n);
+        return m < 0 ? m + static_cast<std::int64_t>(n) : m;
+    }
+
+    inline std::pair<std::int64_t, std::int64_t> cell_coords(double x, double y) const
+    {
+        return {static_cast<std::int64_t>(std::floor((x - min_x) / cell_w)),
+            static_cast<std::int64_t>(std::floor((y - min_y) / cell_h))};
+    }
+
+    inline std::size_t cell_of(double x, double y) const
+    {
+        auto [cx, cy] = cell_coords(x, y);
+        return static_cast<std::size_t>(wrap_index(cy, cells_y)) * cells_x +
+               static_cast<std::size_t>(wrap_index(cx, cells_x));
+    }
+
+    /**
+     * @brief Call @p fn once for every cell overlapping `[x0, x1] x [y0, y1]`
+     */
+    template <typename F> void for_each_cell_in(double x0, double x1, double y0, double y1, F &&fn) const
+    {
+        auto [cx0, cy0] = cell_coords(x0, y0);
+        auto [cx1, cy1] = cell_coords(x1, y1);
+        // A range wider than the grid would visit cells twice after wrapping
+        auto span_x = std::min<std::int64_t>(cx1 - cx0 + 1, cells_x);
+        auto span_y = std::min<std::int64_t>(cy1 - cy0 + 1, cells_y);
+        for (std::int64_t j = 0; j < span_y; ++j)
+        {
+            auto row = static_cast<std::size_t>(wrap_index(cy0 + j, cells_y)) * cells_x;
+            for (std::int64_t i = 0; i < span_x; ++i)
+            {
+                fn(cells[row + static_cast<std::size_t>(wrap_index(cx0 + i, cells_x))]);
+            }
+        }
+    }
+
+    /**
+     * @brief Call @p fn once for every cell on the square ring @p ring cells out
+     * from `(cx, cy)`, skipping cells an earlier ring already wrapped onto
+     */
+    template <typename F> void for_each_cell_in_ring(std::int64_t cx, std::int64_t cy, std::size_t ring, F &&fn) const
+    {
+        auto r     = static_cast<std::int64_t>(ring);
+        auto visit = [&](std::int64_t i, std::int64_t j) {
+            if (in_offset_range(i - cx, cells_x) && in_offset_range(j - cy, cells_y))
+            {
+                fn(cells[static_cast<std::size_t>(wrap_index(j, cells_y)) * cells_x +
+                         static_cast<std::size_t>(wrap_index(i, cells_x))]);
+            }
+        };
+        if (r == 0)
+        {
+            visit(cx, cy);
+            return;
+        }
+        for (auto i = cx - r; i <= cx + r; ++i)
+        {
+            visit(i, cy - r);
+            visit(i, cy + r);
+        }
+        for (auto j = cy - r + 1; j <= cy + r - 1; ++j)
+        {
+            visit(cx - r, j);
+            visit(cx + r, j);
+        }
+    }
+};
+} // namespace jnickg::simulator
@@ -0,0 +1,360 @@
+#pragma once
+#include "components.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace jnickg::simulator
+{
+/**
+ * @brief The bounds a wanderer wraps around, copied out of a
+ * WorldSpace2DComponent so the kernel does not touch the world's handle
+ */
+struct wrap_bounds
+{
+    double min_x = 0.0;
+    double max_x = 0.0;
+    double min_y = 0.0;
+    double max_y = 0.0;
+};
+
+namespace detail
+{
+//
+// sin/cos
+//
+// The polynomials are the Cephes minimax fits over [-pi/4, pi/4]. The argument
+// is reduced by the nearest multiple of pi/2 (split in three parts so the
+// reduction stays exact for the headings a wanderer can have), then the
+// quadrant picks which polynomial feeds sin and cos and their signs. The SIMD
+// paths round to the nearest integer by adding and subtracting 1.5 * 2^52, which
+// leaves the quadrant in the low bits of the sum, so they never convert to int.
+//
+
+constexpr inline double round_shift   = 0x1.8p52;
+constexpr inline double two_over_pi   = 0.63661977236758134308;
+constexpr inline double pio2_1        = 1.57079632673412561417;
+constexpr inline double pio2_2        = 6.07710050630396597660e-11;
+constexpr inline double pio2_3        = 2.02226624879595063154e-21;
+constexpr inline double sin_coeffs[6] = {1.58962301576546568060E-10, -2.50507477628578072866E-8,
+    2.75573136213857245213E-6, -1.98412698295895385996E-4, 8.33333333332211858878E-3, -1.66666666666666307295E-1};
+constexpr inline double cos_coeffs[6] = {-1.13585365213876817300E-11, 2.08757008419747316778E-9,
+    -2.75573141792967388112E-7, 2.48015872888517045348E-5, -1.38888888888730564116E-3, 4.16666666666665929218E-2};
+
+/**
+ * @brief sin and cos of @p x, to within 2 ulp of std::sin/std::cos for |x| up
+ * to 2^22
+ * @details Past that, q * pio2_1 is no longer exact and the reduction loses
+ * more bits the larger x gets. Headings stay within a turn or two of zero, far
+ * inside the range.
+ */
+inline void fast_sincos(double x, double &sin_x, double &cos_x)
+{
+    // Round with nearbyint rather than the shift, which breaks on targets that
+    // keep doubles in extended precision
+    double q      = std::nearbyint(x * two_over_pi);
+    auto quadrant = static_cast<std::int64_t>(q);
+
+    double r = ((x - q * pio2_1) - q * pio2_2) - q * pio2_3;
+    double z = r * r;
+
+    double ps = sin_coeffs[0];
+    double pc = cos_coeffs[0];
+    for (int i = 1; i < 6; ++i)
+    {
+        ps = ps * z + sin_coeffs[i];
+        pc = pc * z + cos_coeffs[i];
+    }
+    ps = r + r * z * ps;
+    pc = 1.0 - 0.5 * z + z * z * pc;
+
+    switch (quadrant & 3)
+    {
+    case 0:
+        sin_x = ps;
+        cos_x = pc;
+        break;
+    case 1:
+        sin_x = pc;
+        cos_x = -ps;
+        break;
+    case 2:
+        sin_x = -ps;
+        cos_x = -pc;
+        break;
+    default:
+        sin_x = -pc;
+        cos_x = ps;
+        break;
+    }
+}
+
+/**
+ * @brief Move one wanderer by @p dt and wrap it around @p bounds
+ * @return Whether it wrapped around either axis
+ */
+inline bool move_wanderer(WandererComponent &w, double dt, const wrap_bounds &bounds)
+{
+    if (dt == 0.0)
+    {
+        return false;
+    }
+    double sin_d, cos_d;
+    fast_sincos(w.direction, sin_d, cos_d);
+    w.x += w.speed * dt * cos_d;
+    w.y += w.speed * dt * sin_d;
+    bool wrapped = true;
+    if (w.x < bounds.min_x)
+    {
+        w.x = bounds.max_x;
+    }
+    else if (w.x > bounds.max_x)
+    {
+        w.x = bounds.min_x;
+    }
+    else
+    {
+        wrapped = false;
+    }
+    if (w.y < bounds.min_y)
+    {
+        w.y     = bounds.max_y;
+        wrapped = true;
+    }
+    else if (w.y > bounds.max_y)
+    {
+        w.y     = bounds.min_y;
+        wrapped = true;
+    }
+    return wrapped;
+}
+
+// The SIMD paths load x, y, speed and direction as one run of four doubles
+static_assert(offsetof(WandererComponent, y) == offsetof(WandererComponent, x) + sizeof(double) &&
+                  offsetof(WandererComponent, speed) == offsetof(WandererComponent, x) + 2 * sizeof(double) &&
+                  offsetof(WandererComponent, direction) == offsetof(WandererComponent, x) + 3 * sizeof(double),
+    "WandererComponent's position, speed and direction must be contiguous");
+
+#if defined(__SSE2__)
+inline __m128d blend_pd(__m128d mask, __m128d if_set, __m128d if_clear)
+{
+    return _mm_or_pd(_mm_and_pd(mask, if_set), _mm_andnot_pd(mask, if_clear));
+}
+
+inline void fast_sincos(__m128d x, __m128d &sin_x, __m128d &cos_x)
+{
+    const __m128d shift = _mm_set1_pd(round_shift);
+    __m128d shifted     = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(two_over_pi)), shift);
+    __m128d q           = _mm_sub_pd(shifted, shift);
+    __m128i quadrant    = _mm_castpd_si128(shifted);
+
+    __m128d r = _mm_sub_pd(x, _mm_mul_pd(q, _mm_set1_pd(pio2_1)));
+    r         = _mm_sub_pd(r, _mm_mul_pd(q, _mm_set1_pd(pio2_2)));
+    r         = _mm_sub_pd(r, _mm_mul_pd(q, _mm_set1_pd(pio2_3)));
+    __m128d z = _mm_mul_pd(r, r);
+
+    __m128d ps = _mm_set1_pd(sin_coeffs[0]);
+    __m128d pc = _mm_set1_pd(cos_coeffs[0]);
+    for (int i = 1; i < 6; ++i)
+    {
+        ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(sin_coeffs[i]));
+        pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(cos_coeffs[i]));
+    }
+    ps = _mm_add_pd(r, _mm_mul_pd(_mm_mul_pd(r, z), ps));
+    pc = _mm_add_pd(_mm_sub_pd(_mm_set1_pd(1.0), _mm_mul_pd(_mm_set1_pd(0.5), z)), _mm_mul_pd(_mm_mul_pd(z, z), pc));
+
+    const __m128i one  = _mm_set1_epi64x(1);
+    const __m128i sign = _mm_set1_epi64x(INT64_MIN);
+    __m128d swap       = _mm_castsi128_pd(_mm_sub_epi64(_mm_setzero_si128(), _mm_and_si128(quadrant, one)));
+    __m128d sin_sign   = _mm_castsi128_pd(_mm_and_si128(_mm_slli_epi64(quadrant, 62), sign));
+    __m128d cos_sign   = _mm_castsi128_pd(_mm_and_si128(_mm_slli_epi64(_mm_add_epi64(quadrant, one), 62), sign));
+    sin_x              = _mm_xor_pd(blend_pd(swap, pc, ps), sin_sign);
+    cos_x              = _mm_xor_pd(blend_pd(swap, ps, pc), cos_sign);
+}
+
+/**
+ * @brief Wrap @p v around [@p lo, @p hi], setting the lanes of @p wrapped
+ * where it did
+ */
+inline __m128d wrap(__m128d v, __m128d lo, __m128d hi, __m128d &wrapped)
+{
+    __m128d below = _mm_cmplt_pd(v, lo), above = _mm_cmpgt_pd(v, hi);
+    wrapped       = _mm_or_pd(wrapped, _mm_or_pd(below, above));
+    return blend_pd(below, hi, blend_pd(above, lo, v));
+}
+
+/**
+ * @brief Move two wanderers at a time, returning the index of the first one
+ * left over
+ * @details Flags the wanderers that wrapped in @p wrapped, if given.
+ */
+inline std::size_t move_wanderers_sse2(
+    WandererComponent *w, const double *dt, std::size_t count, const wrap_bounds &bounds, std::uint8_t *wrapped)
+{
+    const __m128d min_x = _mm_set1_pd(bounds.min_x), max_x = _mm_set1_pd(bounds.max_x);
+    const __m128d min_y = _mm_set1_pd(bounds.min_y), max_y = _mm_set1_pd(bounds.max_y);
+    std::size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128d xy0 = _mm_loadu_pd(&w[i].x), sd0 = _mm_loadu_pd(&w[i].speed);
+        __m128d xy1 = _mm_loadu_pd(&w[i + 1].x), sd1 = _mm_loadu_pd(&w[i + 1].speed);
+        __m128d x = _mm_unpacklo_pd(xy0, xy1), y = _mm_unpackhi_pd(xy0, xy1);
+        __m128d speed = _mm_unpacklo_pd(sd0, sd1), dir = _mm_unpackhi_pd(sd0, sd1);
+        __m128d step  = _mm_loadu_pd(dt + i);
+
+        __m128d sin_d, cos_d;
+        fast_sincos(dir, sin_d, cos_d);
+        __m128d distance   = _mm_mul_pd(speed, step);
+        __m128d moved      = _mm_cmpneq_pd(step, _mm_setzero_pd());
+        __m128d wrapped_xy = _mm_setzero_pd();
+        x = blend_pd(moved, wrap(_mm_add_pd(x, _mm_mul_pd(distance, cos_d)), min_x, max_x, wrapped_xy), x);
+        y = blend_pd(moved, wrap(_mm_add_pd(y, _mm_mul_pd(distance, sin_d)), min_y, max_y, wrapped_xy), y);
+
+        _mm_storeu_pd(&w[i].x, _mm_unpacklo_pd(x, y));
+        _mm_storeu_pd(&w[i + 1].x, _mm_unpackhi_pd(x, y));
+        if (wrapped)
+        {
+            int lanes      = _mm_movemask_pd(_mm_and_pd(moved, wrapped_xy));
+            wrapped[i]     = lanes & 1;
+            wrapped[i + 1] = lanes >> 1 & 1;
+        }
+    }
+    return i;
+}
+#endif
+
+#if defined(__AVX2__)
+inline __m256d fast_sincos_sign(__m256i bits)
+{
+    return _mm256_castsi256_pd(_mm256_and_si256(_mm256_slli_epi64(bits, 62), _mm256_set1_epi64x(INT64_MIN)));
+}
+
+inline void fast_sincos(__m256d x, __m256d &sin_x, __m256d &cos_x)
+{
+    const __m256d shift = _mm256_set1_pd(round_shift);
+    __m256d shifted     = _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(two_over_pi)), shift);
+    __m256d q           = _mm256_sub_pd(shifted, shift);
+    __m256i quadrant    = _mm256_castpd_si256(shifted);
+
+    __m256d r = _mm256_sub_pd(x, _mm256_mul_pd(q, _mm256_set1_pd(pio2_1)));
+    r         = _mm256_sub_pd(r, _mm256_mul_pd(q, _mm256_set1_pd(pio2_2)));
+    r         = _mm256_sub_pd(r, _mm256_mul_pd(q, _mm256_set1_pd(pio2_3)));
+    __m256d z = _mm256_mul_pd(r, r);
+
+    __m256d ps = _mm256_set1_pd(sin_coeffs[0]);
+    __m256d pc = _mm256_set1_pd(cos_coeffs[0]);
+    for (int i = 1; i < 6; ++i)
+    {
+        ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(sin_coeffs[i]));
+        pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(cos_coeffs[i]));
+    }
+    ps = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(r, z), ps));
+    pc = _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(1.0), _mm256_mul_pd(_mm256_set1_pd(0.5), z)),
+        _mm256_mul_pd(_mm256_mul_pd(z, z), pc));
+
+    const __m256i one = _mm256_set1_epi64x(1);
+    __m256d swap      = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(quadrant, one), one));
+    sin_x             = _mm256_xor_pd(_mm256_blendv_pd(ps, pc, swap), fast_sincos_sign(quadrant));
+    cos_x = _mm256_xor_pd(_mm256_blendv_pd(pc, ps, swap), fast_sincos_sign(_mm256_add_epi64(quadrant, one)));
+}
+
+/**
+ * @brief Wrap @p v around [@p lo, @p hi], setting the lanes of @p wrapped
+ * where it did
+ */
+inline __m256d wrap(__m256d v, __m256d lo, __m256d hi, __m256d &wrapped)
+{
+    __m256d below = _mm256_cmp_pd(v, lo, _CMP_LT_OQ), above = _mm256_cmp_pd(v, hi, _CMP_GT_OQ);
+    wrapped       = _mm256_or_pd(wrapped, _mm256_or_pd(below, above));
+    return _mm256_blendv_pd(_mm256_blendv_pd(v, lo, above), hi, below);
+}
+
+/**
+ * @brief Move four wanderers at a time, returning the index of the first one
+ * left over
+ * @details Flags the wanderers that wrapped in @p wrapped, if given.
+ */
+inline std::size_t move_wanderers_avx2(
+    WandererComponent *w, const double *dt, std::size_t count, const wrap_bounds &bounds, std::uint8_t *wrapped)
+{
+    const __m256d min_x = _mm256_set1_pd(bounds.min_x), max_x = _mm256_set1_pd(bounds.max_x);
+    const __m256d min_y = _mm256_set1_pd(bounds.min_y), max_y = _mm256_set1_pd(bounds.max_y);
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        // Each load is one wanderer's {x, y, speed, direction}; transpose to
+        // one register per field
+        __m256d r0 = _mm256_loadu_pd(&w[i].x), r1 = _mm256_loadu_pd(&w[i + 1].x);
+        __m256d r2 = _mm256_loadu_pd(&w[i + 2].x), r3 = _mm256_loadu_pd(&w[i + 3].x);
+        __m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1);
+        __m256d t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3);
+        __m256d x     = _mm256_permute2f128_pd(t0, t2, 0x20);
+        __m256d y     = _mm256_permute2f128_pd(t1, t3, 0x20);
+        __m256d speed = _mm256_permute2f128_pd(t0, t2, 0x31);
+        __m256d dir   = _mm256_permute2f128_pd(t1, t3, 0x31);
+        __m256d step  = _mm256_loadu_pd(dt + i);
+
+        __m256d sin_d, cos_d;
+        fast_sincos(dir, sin_d, cos_d);
+        __m256d distance   = _mm256_mul_pd(speed, step);
+        __m256d moved      = _mm256_cmp_pd(step, _mm256_setzero_pd(), _CMP_NEQ_UQ);
+        __m256d wrapped_xy = _mm256_setzero_pd();
+        x = _mm256_blendv_pd(
+            x, wrap(_mm256_add_pd(x, _mm256_mul_pd(distance, cos_d)), min_x, max_x, wrapped_xy), moved);
+        y = _mm256_blendv_pd(
+            y, wrap(_mm256_add_pd(y, _mm256_mul_pd(distance, sin_d)), min_y, max_y, wrapped_xy), moved);
+
+        // Only x and y changed, so write back one {x, y} pair per wanderer
+        __m256d xy_lo = _mm256_unpacklo_pd(x, y), xy_hi = _mm256_unpackhi_pd(x, y);
+        _mm_storeu_pd(&w[i].x, _mm256_castpd256_pd128(xy_lo));
+        _mm_storeu_pd(&w[i + 1].x, _mm256_castpd256_pd128(xy_hi));
+        _mm_storeu_pd(&w[i + 2].x, _mm256_extractf128_pd(xy_lo, 1));
+        _mm_storeu_pd(&w[i + 3].x, _mm256_extractf128_pd(xy_hi, 1));
+        if (wrapped)
+        {
+            int lanes      = _mm256_movemask_pd(_mm256_and_pd(moved, wrapped_xy));
+            wrapped[i]     = lanes & 1;
+            wrapped[i + 1] = lanes >> 1 & 1;
+            wrapped[i + 2] = lanes >> 2 & 1;
+            wrapped[i + 3] = lanes >> 3 & 1;
+        }
+    }
+    return i;
+}
+#endif
+} // namespace detail
+
+/**
+ * @brief Move @p count wanderers, each by `speed * dt[i]` along its direction,
+ * and wrap them around @p bounds
+ * @details Wanderers whose @p dt is zero are left untouched. Uses AVX2 or SSE2
+ * when the build targets them (see the @c SIM_ECS_NATIVE_ARCH option) and
+ * finishes any leftover wanderers with the scalar path, which gives the same
+ * results lane for lane.
+ * @param wrapped If given, @p count flags, each set to 1 if that wanderer
+ * wrapped around either axis and to 0 otherwise
+ */
+inline void move_wanderers(WandererComponent *w, const double *dt, std::size_t count, const wrap_bounds &bounds,
+    std::uint8_t *wrapped = nullptr)
+{
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    i = detail::move_wanderers_avx2(w, dt, count, bounds, wrapped);
+#elif defined(__SSE2__)
+    i = detail::move_wanderers_sse2(w, dt, count, bounds, wrapped);
+#endif
+    for (; i < count; ++i)
+    {
+        bool wrapped_i = detail::move_wanderer(w[i], dt[i], bounds);
+        if (wrapped)
+        {
+            wrapped[i] = wrapped_i;
+        }
+    }
+}
+} // namespace jnickg::simulator
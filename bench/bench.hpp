@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace jnickg::sim_ecs::bench
+{
+using bench_clock_t = std::chrono::steady_clock;
+
+/**
+ * @brief Times the measured part of one benchmark iteration
+ * @details A benchmark does its setup first, then wraps the code under test in
+ * start() and stop(). Only the time between them counts.
+ */
+class timer
+{
+  public:
+    inline void start() { started = bench_clock_t::now(); }
+    inline void stop() { elapsed += bench_clock_t::now() - started; }
+
+    inline bench_clock_t::duration total() const { return elapsed; }
+
+  private:
+    bench_clock_t::time_point started;
+    bench_clock_t::duration elapsed = bench_clock_t::duration::zero();
+};
+
+/**
+ * @brief A named value reported next to a benchmark's timings, such as an
+ * error bound
+ */
+using counter_t = std::pair<std::string, double>;
+
+struct result
+{
+    std::string name;
+    std::size_t entities      = 0; //< The problem size, in entities (or systems)
+    std::size_t items         = 0; //< Operations per iteration, for the per-op figures
+    std::size_t iterations    = 0;
+    double total_ns           = 0.0;
+    double min_iteration_ns   = 0.0;
+    std::vector<counter_t> counters;
+
+    inline double ns_per_iteration() const { return iterations ? total_ns / iterations : 0.0; }
+    inline double ns_per_item() const { return items ? ns_per_iteration() / items : 0.0; }
+};
+
+/**
+ * @brief Runs benchmarks, repeating each until it has been timed for long
+ * enough, and collects the results
+ */
+class runner
+{
+  public:
+    using benchmark_t = std::function<void(timer &, std::vector<counter_t> &)>;
+
+    std::chrono::milliseconds min_time{200}; //< Keep repeating a benchmark until it has run this long
+    std::size_t max_iterations = 1000;
+    std::string filter;                     //< Only run benchmarks whose name contains this
+
+    /**
+     * @brief Run @p fn as the benchmark @p name over @p entities entities, doing
+     * @p items operations per iteration
+     */
+    void run(const std::string &name, std::size_t entities, std::size_t items, const benchmark_t &fn)
+    {
+        if (!filter.empty() && name.find(filter) == std::string::npos)
+        {
+            return;
+        }
+        result r;
+        r.name     = name;
+        r.entities = entities;
+        r.items    = items;
+
+        bench_clock_t::duration total = bench_clock_t::duration::zero();
+        bench_clock_t::duration best  = bench_clock_t::duration::max();
+        while (r.iterations < max_iterations && (r.iterations == 0 || total < min_time))
+        {
+            timer t;
+            r.counters.clear();
+            fn(t, r.counters);
+            total += t.total();
+            best = std::min(best, t.total());
+            ++r.iterations;
+        }
+        r.total_ns         = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(total).count());
+        r.min_iteration_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(best).count());
+        results.push_back(std::move(r));
+    }
+
+    inline const std::vector<result> &get_results() const { return results; }
+
+    /**
+     * @brief Print one line per result, for reading at a terminal
+     */
+    void print_table(std::ostream &os) const
+    {
+        for (const auto &r : results)
+        {
+            std::stringstream ss;
+            ss << std::left << std::setw(40) << r.name << std::right << std::setw(10) << r.entities << std::setw(14)
+               << std::fixed << std::setprecision(2) << r.ns_per_item() << " ns/op" << std::setw(8) << r.iterations
+               << " it";
+            for (const auto &[key, value] : r.counters)
+            {
+                ss << "  " << key << "=" << std::defaultfloat << value;
+            }
+            os << ss.str() << std::endl;
+        }
+    }
+
+    /**
+     * @brief Write every result as JSON, with @p context as extra top-level
+     * string fields describing the build and machine
+     */
+    void write_json(std::ostream &os, const std::vector<std::pair<std::string, std::string>> &context) const
+    {
+        os << "{\n  \"context\": {";
+        for (std::size_t i = 0; i < context.size(); ++i)
+        {
+            os << (i ? ",\n" : "\n") << "    " << quoted(context[i].first) << ": " << quoted(context[i].second);
+        }
+        os << "\n  },\n  \"benchmarks\": [";
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            const auto &r = results[i];
+            os << (i ? ",\n" : "\n") << "    {" << "\"name\": " << quoted(r.name) << ", \"entities\": " << r.entities
+               << ", \"items\": " << r.items << ", \"iterations\": " << r.iterations
+               << ", \"total_ns\": " << number(r.total_ns) << ", \"ns_per_iteration\": " << number(r.ns_per_iteration())
+               << ", \"min_iteration_ns\": " << number(r.min_iteration_ns)
+               << ", \"ns_per_item\": " << number(r.ns_per_item());
+            for (const auto &[key, value] : r.counters)
+            {
+                os << ", " << quoted(key) << ": " << number(value);
+            }
+            os << "}";
+        }
+        os << "\n  ]\n}\n";
+    }
+
+  private:
+    std::vector<result> results;
+
+    static std::string quoted(const std::string &s)
+    {
+        std::string out = "\"";
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+            }
+            out += c;
+        }
+        return out + "\"";
+    }
+
+    static std::string number(double v)
+    {
+        std::stringstream ss;
+        ss << std::setprecision(17) << v;
+        return ss.str();
+    }
+};
+} // namespace jnickg::sim_ecs::bench
@@ -0,0 +1,586 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "bench.hpp"
+#include "simulator.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+using namespace jnickg::sim_ecs::bench;
+using jnickg::simulator::move_wanderers;
+using jnickg::simulator::simulator;
+using jnickg::simulator::WandererComponent;
+using jnickg::simulator::wrap_bounds;
+
+namespace
+{
+struct drift //< Written by one system while another reads last tick's values
+{
+    double x;
+    double dx;
+};
+} // namespace
+
+template <> struct jnickg::sim_ecs::double_buffered<drift> : std::true_type
+{
+};
+
+namespace
+{
+//
+// Helpers
+//
+
+/**
+ * @brief Somewhere to put results so the optimizer cannot drop the work that
+ * produced them
+ */
+volatile double sink = 0.0;
+
+std::vector<std::size_t> entity_counts(std::size_t max_entities)
+{
+    std::vector<std::size_t> counts;
+    for (std::size_t n = 1000; n <= max_entities; n *= 10)
+    {
+        counts.push_back(n);
+    }
+    return counts;
+}
+
+std::vector<entity_t> create_entities(ComponentManager &components, std::size_t count)
+{
+    std::vector<entity_t> entities;
+    entities.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        entities.push_back(components.create_entity());
+    }
+    return entities;
+}
+
+/**
+ * @brief Give every entity a plain WandererComponent and a ComponentBase-derived
+ * TimedEntityComponent
+ */
+void populate(ComponentManager &components, const std::vector<entity_t> &entities)
+{
+    for (auto entity : entities)
+    {
+        components.emplace<TimedEntityComponent>(entity, NO_ENTITY);
+        auto &wanderer_c = components.emplace<WandererComponent>(entity);
+        wanderer_c.x     = static_cast<double>(entity_index(entity));
+    }
+}
+
+//
+// ComponentManager
+//
+
+void bench_components(runner &r, std::size_t n)
+{
+    r.run("component/emplace_plain", n, n, [n](timer &t, std::vector<counter_t> &) {
+        ComponentManager components;
+        auto entities = create_entities(components, n);
+        t.start();
+        for (auto entity : entities)
+        {
+            components.emplace<WandererComponent>(entity);
+        }
+        t.stop();
+    });
+
+    r.run("component/add", n, n, [n](timer &t, std::vector<counter_t> &) {
+        ComponentManager components;
+        auto entities = create_entities(components, n);
+        std::vector<handle<TimedEntityComponent>> timed;
+        timed.reserve(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            timed.push_back(std::make_shared<TimedEntityComponent>(NO_ENTITY));
+        }
+        t.start();
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            components.add<TimedEntityComponent>(entities[i], std::move(timed[i]));
+        }
+        t.stop();
+    });
+
+    r.run("component/remove", n, n, [n](timer &t, std::vector<counter_t> &) {
+        ComponentManager components;
+        auto entities = create_entities(components, n);
+        populate(components, entities);
+        t.start();
+        for (auto entity : entities)
+        {
+            components.remove<TimedEntityComponent>(entity);
+        }
+        t.stop();
+    });
+
+    r.run("component/spawn_batch", n, n, [n](timer &t, std::vector<counter_t> &) {
+        ComponentManager components;
+        TimedEntityComponent timed_c(NO_ENTITY);
+        t.start();
+        components.spawn_batch(n, timed_c, WandererComponent{});
+        t.stop();
+    });
+
+    r.run("component/destroy_entity", n, n, [n](timer &t, std::vector<counter_t> &) {
+        ComponentManager components;
+        auto entities = create_entities(components, n);
+        populate(components, entities);
+        t.start();
+        for (auto entity : entities)
+        {
+            components.destroy_entity(entity);
+        }
+        t.stop();
+    });
+
+    r.run("component/destroy_entities", n, n, [n](timer &t, std::vector<counter_t> &) {
+        ComponentManager components;
+        auto entities = create_entities(components, n);
+        populate(components, entities);
+        t.start();
+        components.destroy_entities(entities);
+        t.stop();
+    });
+
+    // The lookups do not change anything, so they share one populated manager
+    ComponentManager components;
+    auto entities = create_entities(components, n);
+    populate(components, entities);
+
+    r.run("component/get", n, n, [&](timer &t, std::vector<counter_t> &) {
+        double total = 0.0;
+        t.start();
+        for (auto entity : entities)
+        {
+            total += components.get<TimedEntityComponent>(entity)->time_scale;
+        }
+        t.stop();
+        sink = total;
+    });
+
+    r.run("component/get_plain", n, n, [&](timer &t, std::vector<counter_t> &) {
+        double total = 0.0;
+        t.start();
+        for (auto entity : entities)
+        {
+            total += components.get<WandererComponent>(entity)->x;
+        }
+        t.stop();
+        sink = total;
+    });
+
+    r.run("component/has", n, n, [&](timer &t, std::vector<counter_t> &) {
+        std::size_t found = 0;
+        t.start();
+        for (auto entity : entities)
+        {
+            found += components.has<TimedEntityComponent>(entity) ? 1 : 0;
+        }
+        t.stop();
+        sink = static_cast<double>(found);
+    });
+
+    r.run("component/get_view", n, n, [&](timer &t, std::vector<counter_t> &) {
+        double total = 0.0;
+        t.start();
+        for (auto entity : entities)
+        {
+            auto [wanderer_c, timed_c] = components.get_view<WandererComponent, TimedEntityComponent>(entity);
+            total += wanderer_c->x * timed_c->time_scale;
+        }
+        t.stop();
+        sink = total;
+    });
+}
+
+//
+// Execution graph
+//
+
+template <int I> struct access_tag
+{
+    double value;
+};
+
+constexpr std::size_t access_tag_count = 16;
+
+using declare_fn_t = void (*)(SystemManager &, system_t);
+
+template <std::size_t... Is> constexpr std::array<declare_fn_t, sizeof...(Is)> make_reads(std::index_sequence<Is...>)
+{
+    return {[](SystemManager &systems, system_t id) { systems.declare_reads<access_tag<Is>>(id); }...};
+}
+
+template <std::size_t... Is> constexpr std::array<declare_fn_t, sizeof...(Is)> make_writes(std::index_sequence<Is...>)
+{
+    return {[](SystemManager &systems, system_t id) { systems.declare_writes<access_tag<Is>>(id); }...};
+}
+
+/**
+ * @brief Build execution graphs for @p n systems that each read and write a few
+ * of a small set of component types and depend on up to two earlier systems
+ */
+void bench_execution_graph(runner &r, std::size_t n)
+{
+    static const auto reads  = make_reads(std::make_index_sequence<access_tag_count>{});
+    static const auto writes = make_writes(std::make_index_sequence<access_tag_count>{});
+
+    SystemManager systems;
+    std::mt19937_64 rng(n);
+    std::vector<system_t> ids;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        auto id = systems.new_system<>("Bench System " + std::to_string(i), system_state::enabled,
+            [](entity_t) { return false; }, [](entity_t) { return std::tuple<>{}; },
+            [](entity_t, std::tuple<>) { return component_set_t{}; });
+        reads[rng() % access_tag_count](systems, id);
+        reads[rng() % access_tag_count](systems, id);
+        if (rng() % 2 == 0)
+        {
+            writes[rng() % access_tag_count](systems, id);
+        }
+        for (std::size_t d = 0; d < 2 && !ids.empty(); ++d)
+        {
+            if (rng() % 4 == 0)
+            {
+                systems.add_dependency(id, ids[rng() % ids.size()]);
+            }
+        }
+        ids.push_back(id);
+    }
+
+    r.run("systems/build_execution_graph", n, n, [&](timer &t, std::vector<counter_t> &counters) {
+        t.start();
+        auto graph = systems.build_execution_graph();
+        t.stop();
+        counters.emplace_back("stages", static_cast<double>(graph.size()));
+    });
+}
+
+//
+// Queries
+//
+
+struct tracked_tag //< Carried by every queried entity, to match with With<>
+{
+};
+
+/**
+ * @brief Query @p n wanderers with all of them enabled, then with a random 90%
+ * of them disabled
+ */
+void bench_queries(runner &r, std::size_t n)
+{
+    ComponentManager components;
+    auto entities = components.spawn_batch(n, WandererComponent{}, tracked_tag{});
+
+    auto run_query = [&](timer &t, std::vector<counter_t> &counters) {
+        double total        = 0.0;
+        std::size_t visited = 0;
+        t.start();
+        components.query<Read<WandererComponent>, With<tracked_tag>>([&](entity_t, const WandererComponent &w) {
+            total += w.x;
+            ++visited;
+        });
+        t.stop();
+        sink = total;
+        counters.emplace_back("visited", static_cast<double>(visited));
+    };
+    r.run("query/enabled", n, n, run_query);
+
+    std::mt19937_64 rng(n);
+    std::bernoulli_distribution paused(0.9);
+    for (auto entity : entities)
+    {
+        components.set_enabled(entity, !paused(rng));
+    }
+    r.run("query/mostly_disabled", n, n, run_query);
+}
+
+//
+// Maintenance
+//
+
+/**
+ * @brief Put @p n wanderers scattered at random into Z-order with the
+ * Defragmenter, a millisecond at a time
+ */
+void bench_defragment(runner &r, std::size_t n)
+{
+    r.run("maintenance/defragment", n, n, [n](timer &t, std::vector<counter_t> &counters) {
+        ComponentManager components;
+        auto entities = components.spawn_batch(n, WandererComponent{});
+        std::mt19937_64 rng(n);
+        std::uniform_real_distribution<double> position(-10.0, 10.0);
+        for (auto entity : entities)
+        {
+            auto wanderer_c = components.get_ref<WandererComponent>(entity);
+            wanderer_c->x   = position(rng);
+            wanderer_c->y   = position(rng);
+        }
+        Defragmenter defragmenter(components, [&](entity_t entity) {
+            auto wanderer_c = components.get_ref<const WandererComponent>(entity);
+            return morton_code(static_cast<std::uint32_t>((wanderer_c->x + 10.0) * 3276.0),
+                static_cast<std::uint32_t>((wanderer_c->y + 10.0) * 3276.0));
+        });
+
+        std::size_t steps = 0;
+        t.start();
+        while (!defragmenter.step(std::chrono::milliseconds(1)))
+        {
+            ++steps;
+        }
+        t.stop();
+        counters.emplace_back("steps", static_cast<double>(steps + 1));
+        counters.emplace_back("rows_moved", static_cast<double>(defragmenter.rows_moved()));
+    });
+}
+
+//
+// Ticks
+//
+
+/**
+ * @brief Run whole ticks of the simulator app's world with @p n wanderers and
+ * reporting switched off
+ */
+void bench_update(runner &r, std::size_t n)
+{
+    simulator sim(n, false);
+    r.run("systems/update", n, n, [&](timer &t, std::vector<counter_t> &) {
+        t.start();
+        sim.run(1);
+        t.stop();
+    });
+}
+
+/**
+ * @brief Run ticks of one system writing @p n components and another reading
+ * them through @p ReadTerm, which is @c Read for the current values (so the
+ * two need separate stages) or @c Prev for last tick's (so they can share one)
+ */
+template <template <typename> class ReadTerm> void bench_reader_writer(runner &r, const std::string &name, std::size_t n)
+{
+    ComponentManager components;
+    components.spawn_batch(n, drift{0.0, 1.0});
+    SystemManager systems(std::thread::hardware_concurrency());
+    systems.new_query_system<Write<drift>>(
+        "Writer", system_state::enabled, components, [](entity_t, drift &d) { d.x += d.dx; });
+    double total = 0.0;
+    systems.new_query_system<ReadTerm<drift>>(
+        "Reader", system_state::enabled, components, [&](entity_t, const drift &d) { total += d.x; });
+    r.run(name, n, n, [&](timer &t, std::vector<counter_t> &counters) {
+        t.start();
+        systems.update({});
+        t.stop();
+        sink = total;
+        counters.emplace_back("stages", static_cast<double>(systems.build_execution_graph().size()));
+    });
+}
+
+void bench_double_buffer(runner &r, std::size_t n)
+{
+    bench_reader_writer<Read>(r, "systems/read_current", n);
+    bench_reader_writer<Prev>(r, "systems/read_prev", n);
+}
+
+/**
+ * @brief Run ticks of one system sending an event for each of @p n entities,
+ * split across the workers, and another reading them all in the next stage
+ */
+void bench_events(runner &r, std::size_t n)
+{
+    ComponentManager components;
+    components.spawn_batch(n, drift{0.0, 1.0});
+    SystemManager systems(std::thread::hardware_concurrency());
+    auto &channel = systems.events<drift>();
+    auto sender   = systems.new_batch_system<Read<drift>>(
+        "Sender", system_state::enabled, components, [&](span<const entity_t>, span<const drift> ds) {
+            for (const auto &d : ds)
+            {
+                channel.send(d);
+            }
+        });
+    double total = 0.0;
+    auto reader  = systems.new_event_system<drift>("Reader", system_state::enabled, [&](span<const drift> ds) {
+        for (const auto &d : ds)
+        {
+            total += d.dx;
+        }
+    });
+    systems.set_parallel(sender, true);
+    systems.add_dependency(reader, sender);
+    r.run("systems/events", n, n, [&](timer &t, std::vector<counter_t> &counters) {
+        t.start();
+        systems.update({});
+        t.stop();
+        sink = total;
+        counters.emplace_back("events", static_cast<double>(channel.size()));
+    });
+}
+
+/**
+ * @brief Run ticks of @p n wanderers split evenly over several independent
+ * worlds, a few per hardware thread, side by side
+ */
+void bench_worlds(runner &r, std::size_t n)
+{
+    auto worlds = 4 * std::max(1u, std::thread::hardware_concurrency());
+    WorldRunner<simulator> worlds_runner;
+    for (std::size_t i = 0; i < worlds; ++i)
+    {
+        worlds_runner.emplace(std::max<std::size_t>(1, n / worlds), false, 0);
+    }
+    r.run("worlds/run", n, n, [&](timer &t, std::vector<counter_t> &counters) {
+        t.start();
+        worlds_runner.run(1);
+        t.stop();
+        counters.emplace_back("worlds", static_cast<double>(worlds));
+    });
+}
+
+/**
+ * @brief Move @p n wanderers with the movement kernel, and report how far it
+ * strays from doing the same with std::sin and std::cos
+ */
+void bench_kernel(runner &r, std::size_t n)
+{
+    std::mt19937_64 rng(n);
+    std::uniform_real_distribution<double> position(-10.0, 10.0);
+    std::uniform_real_distribution<double> direction(-4.0, 4.0);
+    std::vector<WandererComponent> wanderers(n);
+    for (auto &w : wanderers)
+    {
+        w = WandererComponent{NO_ENTITY, position(rng), position(rng), 1.0, direction(rng)};
+    }
+    std::vector<double> dt(n, 0.01);
+    wrap_bounds bounds{-10.0, 10.0, -10.0, 10.0};
+
+    auto reference = wanderers;
+    for (auto &w : reference)
+    {
+        w.x += w.speed * 0.01 * std::cos(w.direction);
+        w.y += w.speed * 0.01 * std::sin(w.direction);
+        w.x = w.x < bounds.min_x ? bounds.max_x : w.x > bounds.max_x ? bounds.min_x : w.x;
+        w.y = w.y < bounds.min_y ? bounds.max_y : w.y > bounds.max_y ? bounds.min_y : w.y;
+    }
+
+    r.run("kernel/move_wanderers", n, n, [&](timer &t, std::vector<counter_t> &counters) {
+        auto moved = wanderers;
+        t.start();
+        move_wanderers(moved.data(), dt.data(), moved.size(), bounds);
+        t.stop();
+
+        double max_error = 0.0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            max_error = std::max({max_error, std::fabs(moved[i].x - reference[i].x),
+                std::fabs(moved[i].y - reference[i].y)});
+        }
+        counters.emplace_back("max_error", max_error);
+    });
+}
+
+void usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [--max-entities N] [--min-time-ms MS] [--filter TEXT] [--json FILE]"
+              << std::endl;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    runner r;
+    std::size_t max_entities = 1000000;
+    std::string json_path;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        if (arg == "--max-entities")
+        {
+            max_entities = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--min-time-ms")
+        {
+            r.min_time = std::chrono::milliseconds(std::strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--filter")
+        {
+            r.filter = argv[++i];
+        }
+        else if (arg == "--json")
+        {
+            json_path = argv[++i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    for (auto n : entity_counts(max_entities))
+    {
+        bench_components(r, n);
+    }
+    for (auto n : {10, 100, 1000})
+    {
+        bench_execution_graph(r, n);
+    }
+    for (auto n : entity_counts(max_entities))
+    {
+        bench_queries(r, n);
+        bench_defragment(r, n);
+        bench_update(r, n);
+        bench_double_buffer(r, n);
+        bench_events(r, n);
+        bench_worlds(r, n);
+        bench_kernel(r, n);
+    }
+
+    std::vector<std::pair<std::string, std::string>> context = {
+        {"compiler", SIM_ECS_BENCH_COMPILER},
+        {"build_type", SIM_ECS_BENCH_BUILD_TYPE},
+        {"hardware_concurrency", std::to_string(std::thread::hardware_concurrency())},
+#if defined(__AVX2__)
+        {"simd", "avx2"},
+#elif defined(__SSE2__)
+        {"simd", "sse2"},
+#else
+        {"simd", "none"},
+#endif
+    };
+    // The JSON goes to stdout unless it has a file, so the table goes to
+    // stderr to keep stdout parseable
+    if (json_path.empty())
+    {
+        r.print_table(std::cerr);
+        r.write_json(std::cout, context);
+    }
+    else
+    {
+        r.print_table(std::cout);
+        std::ofstream out(json_path);
+        r.write_json(out, context);
+    }
+}
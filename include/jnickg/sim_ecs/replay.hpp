@@ -0,0 +1,404 @@
+#pragma once
+
+#include "snapshot.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace jnickg::sim_ecs
+{
+//
+// Replays
+//
+// A replay log is the world a run started from and everything done to it from
+// outside since, so the run can be repeated exactly. It is written in the
+// writer's native byte order (checked on replay) as:
+//
+//   header   magic, format version, byte order mark, the run's seed and the
+//            frame it started on
+//   start    the size of the starting world's snapshot, then the snapshot
+//   records  each as a kind, a payload size and the payload. Kind 0 ends a
+//            tick and carries the state_hash() of the world after it. Kind
+//            ReplayRecorder::command_kind is a structural command a
+//            CommandQueue applied during the tick, in the order applied: what
+//            it did, the names of its component types and its entities. Every
+//            other kind is an input, numbered by the application, applied
+//            before the tick that follows it.
+//
+// The run has to be deterministic for its replay to match: see
+// SystemManager::set_deterministic(). Commands are not applied from the log on
+// replay, since the replayed systems record them again; ReplayCommandCheck
+// compares the two, so a replay that goes wrong is caught at the first command
+// that differs rather than only at the end of the tick.
+//
+
+constexpr inline char replay_magic[8]         = {'S', 'I', 'M', 'E', 'C', 'S', 'R', 'P'};
+constexpr inline std::uint32_t replay_version = 1;
+
+namespace detail
+{
+/**
+ * @brief Write what a command did, as a command record's payload
+ * @throws std::logic_error if a component type involved is not in @p schema
+ */
+inline void write_command(SnapshotWriter &w, const SnapshotSchema &schema, CommandLog::op what,
+    span<const component_type_t> types, span<const entity_t> entities)
+{
+    w.write(what);
+    w.write<std::uint32_t>(static_cast<std::uint32_t>(types.size()));
+    for (auto type : types)
+    {
+        auto *found = schema.find(type);
+        if (!found)
+        {
+            throw std::logic_error(
+                "Component type " + std::to_string(type) + " is used by a command but has no name in the SnapshotSchema");
+        }
+        w.write_string(found->name);
+    }
+    w.write<std::uint64_t>(entities.size());
+    w.write_bytes(entities.data(), entities.size() * sizeof(entity_t));
+}
+
+/**
+ * @brief An output stream buffer that hashes everything written to it
+ * instead of keeping it
+ * @details Bytes are mixed in eight at a time, so hashing a large world costs
+ * little more than copying it.
+ */
+class hash_streambuf : public std::streambuf
+{
+  public:
+    hash_streambuf() { setp(buffer, buffer + sizeof(buffer)); }
+
+    /**
+     * @brief The hash of everything written so far
+     */
+    std::uint64_t digest()
+    {
+        flush_words();
+        std::uint64_t tail = 0;
+        std::memcpy(&tail, pbase(), static_cast<std::size_t>(pptr() - pbase()));
+        return stable_random(mix(state, tail), length + static_cast<std::uint64_t>(pptr() - pbase()));
+    }
+
+  protected:
+    int_type overflow(int_type ch) override
+    {
+        flush_words();
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+  private:
+    char buffer[4096];
+    std::uint64_t state  = 0;
+    std::uint64_t length = 0; //< Bytes already mixed into state
+
+    static inline std::uint64_t mix(std::uint64_t h, std::uint64_t word)
+    {
+        return ((h << 31 | h >> 33) ^ word) * 0x9e3779b97f4a7c15ull;
+    }
+
+    /**
+     * @brief Mix every whole word in the buffer into the state, and move what
+     * is left over to the front
+     */
+    void flush_words()
+    {
+        auto used  = static_cast<std::size_t>(pptr() - pbase());
+        auto words = used / sizeof(std::uint64_t);
+        for (std::size_t i = 0; i < words; ++i)
+        {
+            std::uint64_t word;
+            std::memcpy(&word, buffer + i * sizeof(word), sizeof(word));
+            state = mix(state, word);
+        }
+        auto mixed = words * sizeof(std::uint64_t);
+        std::memmove(buffer, buffer + mixed, used - mixed);
+        length += mixed;
+        setp(buffer, buffer + sizeof(buffer));
+        pbump(static_cast<int>(used - mixed));
+    }
+};
+} // namespace detail
+
+/**
+ * @brief A hash of everything a snapshot of @p components would hold, apart
+ * from change ticks
+ * @details Two worlds hash the same when they hold the same entities with the
+ * same components in the same rows. Change ticks are left out, since they
+ * only say when something was written, and systems running side by side may
+ * take them in either order.
+ */
+inline std::uint64_t state_hash(const ComponentManager &components, const SnapshotSchema &schema)
+{
+    detail::hash_streambuf buffer;
+    std::ostream os(&buffer);
+    detail::snapshot_access::write(components, schema, os, false);
+    return buffer.digest();
+}
+
+/**
+ * @brief Writes a replay log as a run goes
+ * @details Create it before the first tick, record() each input as it is
+ * applied, and end_tick() after each tick. Give it to the world's CommandQueue
+ * with CommandQueue::set_log() to log the commands applied too. The log is
+ * flushed at the end of every tick, so a run that crashes still leaves a log
+ * up to its last tick.
+ */
+class ReplayRecorder : public CommandLog
+{
+  public:
+    static constexpr std::uint32_t tick_kind    = 0;           //< The kind of record that ends a tick
+    static constexpr std::uint32_t command_kind = 0xffffffffu; //< The kind of record that logs a command
+
+    /**
+     * @brief Start a log at @p path of a run starting from @p components
+     * @param schema Names the component types, and must outlive the recorder
+     * @param seed The run's seed, for the replay to start from too
+     * @param frame The SystemManager::frame() the run starts on, which is not
+     * zero for a run resumed from a snapshot
+     */
+    ReplayRecorder(const std::string &path, const ComponentManager &components, const SnapshotSchema &schema,
+        std::uint64_t seed, frameidx_t frame = 0)
+        : out{path, std::ios::binary | std::ios::trunc}, w{out}, schema{schema}
+    {
+        if (!out)
+        {
+            throw std::runtime_error("Cannot create replay log '" + path + "'");
+        }
+        std::ostringstream start;
+        write_snapshot(components, schema, start);
+        auto snapshot = start.str();
+
+        w.write_bytes(replay_magic, sizeof(replay_magic));
+        w.write(replay_version);
+        w.write(snapshot_bom);
+        w.write(seed);
+        w.write<std::uint64_t>(frame);
+        w.write<std::uint64_t>(snapshot.size());
+        w.write_bytes(snapshot.data(), snapshot.size());
+    }
+    ReplayRecorder(const ReplayRecorder &)            = delete;
+    ReplayRecorder(ReplayRecorder &&)                 = delete;
+    ReplayRecorder &operator=(const ReplayRecorder &) = delete;
+    ReplayRecorder &operator=(ReplayRecorder &&)      = delete;
+
+    /**
+     * @brief Record an input of @p kind, made of @p fields, each written as
+     * raw bytes
+     * @details Give fields one at a time rather than as a struct, so no padding
+     * ends up in the log.
+     */
+    template <typename... Fields> void record(std::uint32_t kind, const Fields &...fields)
+    {
+        static_assert((... && std::is_trivially_copyable_v<Fields>), "Input fields are written as raw bytes");
+        if (kind == tick_kind || kind == command_kind)
+        {
+            throw std::logic_error("Input kind " + std::to_string(kind) + " is reserved for the log itself");
+        }
+        w.write(kind);
+        w.write<std::uint32_t>((0 + ... + sizeof(Fields)));
+        (w.write(fields), ...);
+    }
+
+    void applied(op what, span<const component_type_t> types, span<const entity_t> entities) override
+    {
+        std::ostringstream payload;
+        SnapshotWriter pw(payload);
+        detail::write_command(pw, schema, what, types, entities);
+        auto bytes = payload.str();
+        w.write(command_kind);
+        w.write<std::uint32_t>(static_cast<std::uint32_t>(bytes.size()));
+        w.write_bytes(bytes.data(), bytes.size());
+    }
+
+    /**
+     * @brief End the current tick, whose world hashed to @p hash
+     */
+    void end_tick(std::uint64_t hash)
+    {
+        w.write(tick_kind);
+        w.write<std::uint32_t>(sizeof(hash));
+        w.write(hash);
+        out.flush();
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write replay log");
+        }
+        ++tick_count;
+    }
+
+    /**
+     * @brief How many ticks have been recorded
+     */
+    inline std::uint64_t ticks() const { return tick_count; }
+
+  private:
+    std::ofstream out;
+    SnapshotWriter w;
+    const SnapshotSchema &schema;
+    std::uint64_t tick_count = 0;
+};
+
+/**
+ * @brief Reads back a log written by ReplayRecorder, a tick at a time
+ */
+class ReplayReader
+{
+  public:
+    /**
+     * @throws std::runtime_error if @p path is not a replay log this build can
+     * read
+     */
+    explicit ReplayReader(const std::string &path) : file{path}, r{file.data(), file.size()}
+    {
+        if (std::memcmp(r.read_bytes(sizeof(replay_magic)), replay_magic, sizeof(replay_magic)) != 0)
+        {
+            throw std::runtime_error("Not a replay log");
+        }
+        if (r.read<std::uint32_t>() != replay_version)
+        {
+            throw std::runtime_error("Unsupported replay log version");
+        }
+        if (r.read<std::uint32_t>() != snapshot_bom)
+        {
+            throw std::runtime_error("Replay log was written with a different byte order");
+        }
+        run_seed      = r.read<std::uint64_t>();
+        first_frame   = r.read<std::uint64_t>();
+        snapshot_size = r.read<std::uint64_t>();
+        snapshot      = r.read_bytes(snapshot_size);
+    }
+    ReplayReader(const ReplayReader &)            = delete;
+    ReplayReader(ReplayReader &&)                 = delete;
+    ReplayReader &operator=(const ReplayReader &) = delete;
+    ReplayReader &operator=(ReplayReader &&)      = delete;
+
+    /**
+     * @brief The seed the recorded run was given
+     */
+    inline std::uint64_t seed() const { return run_seed; }
+
+    /**
+     * @brief The SystemManager::frame() the recorded run started on
+     */
+    inline frameidx_t frame() const { return static_cast<frameidx_t>(first_frame); }
+
+    /**
+     * @brief Restore the world the recorded run started from into
+     * @p components, which must never have had any entities
+     */
+    void restore(ComponentManager &components, const SnapshotSchema &schema) const
+    {
+        read_snapshot(components, schema, snapshot, snapshot_size);
+    }
+
+    /**
+     * @brief Call @p on_input as `on_input(kind, SnapshotReader &payload)` for
+     * each input recorded before the next tick, and gather the commands
+     * recorded during it
+     * @return The hash the world had after that tick, or nothing once the log
+     * has no more ticks
+     */
+    template <typename F> std::optional<std::uint64_t> next_tick(F &&on_input)
+    {
+        tick_commands.clear();
+        while (!r.at_end())
+        {
+            auto kind   = r.read<std::uint32_t>();
+            auto size   = r.read<std::uint32_t>();
+            auto *bytes = r.read_bytes(size);
+            SnapshotReader payload(bytes, size);
+            if (kind == ReplayRecorder::tick_kind)
+            {
+                return payload.read<std::uint64_t>();
+            }
+            if (kind == ReplayRecorder::command_kind)
+            {
+                tick_commands.emplace_back(reinterpret_cast<const char *>(bytes), size);
+                continue;
+            }
+            on_input(kind, payload);
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * @brief The payloads of the commands applied during the tick last
+     * returned by next_tick(), in the order they were applied
+     */
+    inline const std::vector<std::string> &commands() const { return tick_commands; }
+
+  private:
+    MappedFile file;
+    SnapshotReader r;
+    std::uint64_t run_seed      = 0;
+    std::uint64_t first_frame   = 0;
+    std::uint64_t snapshot_size = 0;
+    const std::byte *snapshot   = nullptr;
+    std::vector<std::string> tick_commands;
+};
+
+/**
+ * @brief Checks the commands a replayed tick applies against the ones
+ * recorded for it
+ * @details Give it to the world's CommandQueue with CommandQueue::set_log()
+ * while replaying, and call end_tick() after each tick.
+ */
+class ReplayCommandCheck : public CommandLog
+{
+  public:
+    /**
+     * @param log The log being replayed, whose commands() are checked against
+     * @param schema Names the component types, and must outlive the check
+     */
+    ReplayCommandCheck(const ReplayReader &log, const SnapshotSchema &schema) : log{log}, schema{schema} {}
+    ReplayCommandCheck(const ReplayCommandCheck &)            = delete;
+    ReplayCommandCheck(ReplayCommandCheck &&)                 = delete;
+    ReplayCommandCheck &operator=(const ReplayCommandCheck &) = delete;
+    ReplayCommandCheck &operator=(ReplayCommandCheck &&)      = delete;
+
+    void applied(op what, span<const component_type_t> types, span<const entity_t> entities) override
+    {
+        std::ostringstream payload;
+        SnapshotWriter w(payload);
+        detail::write_command(w, schema, what, types, entities);
+        const auto &recorded = log.commands();
+        matching             = matching && next < recorded.size() && recorded[next] == payload.str();
+        ++next;
+    }
+
+    /**
+     * @brief Whether the tick just replayed applied exactly the commands
+     * recorded for it, in the same order; starts checking the next tick
+     */
+    bool end_tick()
+    {
+        bool matched = matching && next == log.commands().size();
+        matching     = true;
+        next         = 0;
+        return matched;
+    }
+
+  private:
+    const ReplayReader &log;
+    const SnapshotSchema &schema;
+    std::size_t next = 0; //< Which of the tick's recorded commands the next one applied should be
+    bool matching    = true;
+};
+} // namespace jnickg::sim_ecs
@@ -3,19 +3,35 @@
 #include <stdlib.h>
 
 #include <algorithm>
+#include <array>
 #include <atomic>
+#include <cstdint>
 #include <chrono>
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <map>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <numeric>
 #include <optional>
 #include <queue>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "thread_pool.hpp"
+
 namespace jnickg::sim_ecs
 {
 //
@@ -23,33 +39,201 @@ namespace jnickg::sim_ecs
 //
 
 template <typename T> using handle = std::shared_ptr<T>;
+template <typename T> using ref    = T *; //< A non-owning reference to a component, valid until it is removed
 using entity_t                     = std::size_t;
 using system_t                     = std::size_t;
 using frameidx_t                   = std::size_t;
+using tick_t                       = std::uint64_t;
 using clock_t                      = std::chrono::high_resolution_clock;
 using time_t                       = clock_t::time_point;
 using duration_t                   = clock_t::duration;
 template <typename T> using maybe  = std::optional<T>;
 constexpr inline auto nothing      = std::nullopt;
 
-constexpr inline entity_t NO_ENTITY = 0; //< The null entity, used to indicate that an entity does not exist
-inline static entity_t create_entity()
+/**
+ * @brief A non-owning view of a contiguous run of @p T
+ */
+template <typename T> struct span
 {
-    static std::atomic<entity_t> id = 1;
-    return id++;
-}
+    T *ptr            = nullptr;
+    std::size_t count = 0;
+
+    inline T *data() const { return ptr; }
+    inline std::size_t size() const { return count; }
+    inline bool empty() const { return count == 0; }
+    inline T &operator[](std::size_t i) const { return ptr[i]; }
+    inline T *begin() const { return ptr; }
+    inline T *end() const { return ptr + count; }
+};
 
+constexpr inline entity_t NO_ENTITY = 0; //< The null entity, used to indicate that an entity does not exist
 constexpr inline system_t NO_SYSTEM = 0; //< The null system, used to indicate that a system does not exist
-inline static system_t create_system()
+
+/**
+ * @brief Entity IDs pack a slot index in the low 32 bits and the slot's
+ * generation in the high 32 bits
+ * @details The index is dense, so it can address arrays directly, and the
+ * generation changes every time a slot is freed so that an ID kept past its
+ * entity's destruction can be told apart from the slot's next occupant.
+ */
+inline constexpr std::uint32_t entity_index(entity_t entity) { return static_cast<std::uint32_t>(entity); }
+inline constexpr std::uint32_t entity_generation(entity_t entity) { return static_cast<std::uint32_t>(entity >> 32); }
+inline constexpr entity_t make_entity(std::uint32_t index, std::uint32_t generation)
 {
-    static std::atomic<system_t> id = 1;
-    return id++;
+    return (static_cast<entity_t>(generation) << 32) | index;
 }
 
+/**
+ * @brief A run of entities created together in never-used slots, so their
+ * indices are consecutive and every generation is 0
+ */
+struct entity_range
+{
+    struct iterator
+    {
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = entity_t;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const entity_t *;
+        using reference         = entity_t;
+
+        std::uint32_t index;
+
+        inline entity_t operator*() const { return make_entity(index, 0); }
+        inline iterator &operator++()
+        {
+            ++index;
+            return *this;
+        }
+        inline bool operator==(const iterator &other) const { return index == other.index; }
+        inline bool operator!=(const iterator &other) const { return index != other.index; }
+    };
+
+    std::uint32_t first = 0; //< Index of the first entity
+    std::size_t count   = 0;
+
+    inline std::size_t size() const { return count; }
+    inline bool empty() const { return count == 0; }
+    inline entity_t operator[](std::size_t i) const { return make_entity(static_cast<std::uint32_t>(first + i), 0); }
+    inline bool contains(entity_t entity) const
+    {
+        return entity_generation(entity) == 0 && entity_index(entity) >= first && entity_index(entity) - first < count;
+    }
+    inline iterator begin() const { return iterator{first}; }
+    inline iterator end() const { return iterator{static_cast<std::uint32_t>(first + count)}; }
+};
+
+namespace detail
+{
+struct snapshot_access; //< Reads and rebuilds a world's internals for snapshot.hpp
+} // namespace detail
+
+/**
+ * @brief Hands out generational entity IDs for one world and recycles the
+ * slots of destroyed entities
+ * @details Slot 0 is never used, so @c NO_ENTITY is never a valid ID.
+ */
+class EntityRegistry
+{
+    friend struct detail::snapshot_access;
+
+    std::vector<std::uint32_t> generations = {0}; //< Current generation of each slot
+    std::vector<bool> alive                = {false};
+    std::vector<std::uint32_t> free_slots;        //< Freed slots, reused last-in first-out
+    std::size_t alive_count = 0;
+
+  public:
+    entity_t create()
+    {
+        std::uint32_t index;
+        if (!free_slots.empty())
+        {
+            index = free_slots.back();
+            free_slots.pop_back();
+        }
+        else
+        {
+            index = static_cast<std::uint32_t>(generations.size());
+            generations.push_back(0);
+            alive.push_back(false);
+        }
+        alive[index] = true;
+        ++alive_count;
+        return make_entity(index, generations[index]);
+    }
+
+    /**
+     * @brief Create @p count entities in fresh slots at the end, skipping the
+     * free list so that their IDs form one contiguous range
+     */
+    entity_range create_range(std::size_t count)
+    {
+        entity_range range{static_cast<std::uint32_t>(generations.size()), count};
+        generations.resize(generations.size() + count, 0);
+        alive.resize(alive.size() + count, true);
+        alive_count += count;
+        return range;
+    }
+
+    /**
+     * @brief Free an entity's slot for reuse
+     * @return false if @p entity was not alive
+     */
+    bool destroy(entity_t entity)
+    {
+        if (!is_alive(entity))
+        {
+            return false;
+        }
+        auto index = entity_index(entity);
+        alive[index] = false;
+        ++generations[index];
+        free_slots.push_back(index);
+        --alive_count;
+        return true;
+    }
+
+    inline bool is_alive(entity_t entity) const
+    {
+        auto index = entity_index(entity);
+        return index < generations.size() && alive[index] && generations[index] == entity_generation(entity);
+    }
+
+    inline std::size_t size() const { return alive_count; }
+
+    /**
+     * @brief One past the highest slot index ever handed out, for sizing arrays
+     * indexed by entity_index()
+     */
+    inline std::size_t capacity() const { return generations.size(); }
+};
+
 //
 // Components
 //
 
+/**
+ * @brief Identifier for a component type, dense and assigned on first use
+ * @details Type IDs are small integers so that archetypes can map a type to its
+ * column with a flat array lookup instead of a hash.
+ */
+using component_type_t = std::size_t;
+
+namespace detail
+{
+inline std::atomic<component_type_t> component_type_counter = 0;
+
+template <typename T> struct component_type_id_holder
+{
+    inline static const component_type_t value = component_type_counter++;
+};
+} // namespace detail
+
+template <typename T> inline component_type_t component_type_id()
+{
+    return detail::component_type_id_holder<std::remove_cv_t<T>>::value;
+}
+
 struct ComponentBase
 {
     time_t created_at     = clock_t::now();  //< The real-world time when the
@@ -120,6 +304,10 @@ struct OwnedComponent : public ComponentBase
     entity_t owner = NO_ENTITY;         // The entity that owns this component
 
     OwnedComponent(entity_t owner) { this->owner = owner; }
+    /**
+     * @brief A new component with the same owner, and its own debug fields
+     */
+    OwnedComponent(const OwnedComponent &other) : ComponentBase{}, owner{other.owner} {}
     OwnedComponent()          = delete;
     virtual ~OwnedComponent() = default;
 
@@ -182,8 +370,9 @@ struct TimedEntityComponent : public OwnedComponent
     double time_scale = 1.0;   //< The time scale of the entity
 
     TimedEntityComponent(entity_t world) : OwnedComponent{world} {}
-    TimedEntityComponent()          = delete;
-    virtual ~TimedEntityComponent() = default;
+    TimedEntityComponent(const TimedEntityComponent &) = default;
+    TimedEntityComponent()                             = delete;
+    virtual ~TimedEntityComponent()                    = default;
 
     virtual std::ostream &print(std::ostream &os) const override
     {
@@ -200,22 +389,241 @@ struct TimedEntityComponent : public OwnedComponent
     }
 };
 
+/**
+ * @brief Whether @p T is a plain component: a trivially copyable struct that
+ * does not derive from ComponentBase
+ * @details Plain components carry no vtable or debug fields and are stored by
+ * value in their columns. Anything else is stored behind a handle.
+ */
+template <typename T>
+inline constexpr bool is_plain_component_v =
+    std::is_trivially_copyable_v<std::remove_cv_t<T>> && !std::is_base_of_v<ComponentBase, std::remove_cv_t<T>>;
+
+/**
+ * @brief Whether @p T is a tag: a plain component with no members
+ * @details A tag only marks which entities have it. Its column stores nothing
+ * but a row count, and queries match it with @c With and @c Without rather
+ * than fetching it.
+ */
+template <typename T>
+inline constexpr bool is_tag_component_v = is_plain_component_v<T> && std::is_empty_v<std::remove_cv_t<T>>;
+
+/**
+ * @brief Specialize as @c std::true_type to keep last tick's values of the
+ * plain component @p T alongside the current ones
+ * @details Systems read last tick's values with a @c Prev term, which doesn't
+ * conflict with systems writing the current ones, so both can share a stage.
+ * SystemManager::update() publishes the current values as the previous ones
+ * when it finishes, for every manager it tracks, by copying forward just the
+ * rows written during the update, so a column nothing wrote costs nothing.
+ */
+template <typename T> struct double_buffered : std::false_type
+{
+};
+
+template <typename T> inline constexpr bool is_double_buffered_v = double_buffered<std::remove_cv_t<T>>::value;
+
+/**
+ * @brief What a lookup returns for a component of type @p T: a ref for plain
+ * components, stored by value, and a handle for everything else
+ */
+template <typename T> using component_ptr_t = std::conditional_t<is_plain_component_v<T>, ref<T>, handle<T>>;
+
 //
 // Systems
 //
 using component_set_t = std::unordered_set<handle<ComponentBase>>;
 
+struct ColumnBase;
+class ComponentManager;
+
+namespace detail
+{
+/**
+ * @brief Where the calling thread is in the current update, used to order
+ * deferred commands deterministically no matter which thread recorded them
+ */
+struct command_context
+{
+    std::size_t sequence = 0; //< Position of the running system in this update
+    std::size_t chunk    = 0; //< 1 + the parallel chunk being run, or 0 outside of chunks
+};
+
+inline command_context &current_command_context()
+{
+    thread_local command_context context;
+    return context;
+}
+
+/**
+ * @brief Sets the calling thread's command context for a scope
+ */
+struct scoped_command_context
+{
+    command_context saved;
+
+    scoped_command_context(std::size_t sequence, std::size_t chunk) : saved{current_command_context()}
+    {
+        current_command_context() = command_context{sequence, chunk};
+    }
+    ~scoped_command_context() { current_command_context() = saved; }
+};
+
+/**
+ * @brief The change tick a system run stamps its lookups on one
+ * ComponentManager with
+ */
+struct run_tick
+{
+    const ComponentManager *components;
+    tick_t tick;
+};
+
+/**
+ * @brief What lookups on the calling thread need from the system run it is
+ * part of
+ * @details SystemManager takes one change tick per tracked ComponentManager
+ * before each system runs, and lookups handing out double-buffered rows for
+ * writing are stamped with it rather than each taking a tick of their own. The
+ * rows they hand out are kept here, for this thread alone, and recorded in
+ * their columns when the run or chunk ends, one lock per column rather than
+ * one per lookup.
+ */
+struct lookup_context
+{
+    const std::vector<run_tick> *ticks = nullptr; //< The running system's ticks, or null outside a run
+    std::vector<std::pair<ColumnBase *, std::pair<std::size_t, std::size_t>>> written; //< Row ranges handed out
+    std::vector<std::pair<std::size_t, std::size_t>> ranges; //< One column's ranges while flushing
+
+    /**
+     * @brief The running system's tick for @p components, or 0 if it has none
+     */
+    inline tick_t tick_for(const ComponentManager *components) const
+    {
+        if (ticks)
+        {
+            for (const auto &t : *ticks)
+            {
+                if (t.components == components)
+                {
+                    return t.tick;
+                }
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Remember that rows `[begin, end)` of @p column were handed out
+     */
+    inline void add(ColumnBase *column, std::size_t begin, std::size_t end)
+    {
+        if (!written.empty() && written.back().first == column && written.back().second.second == begin)
+        {
+            written.back().second.second = end;
+        }
+        else
+        {
+            written.push_back({column, {begin, end}});
+        }
+    }
+
+    /**
+     * @brief Record every range kept so far in its column
+     */
+    void flush();
+};
+
+inline lookup_context &current_lookup_context()
+{
+    thread_local lookup_context context;
+    return context;
+}
+
+/**
+ * @brief Sets the calling thread's lookup ticks for a scope, recording the
+ * rows handed out under them when it ends
+ */
+struct scoped_lookup_ticks
+{
+    const std::vector<run_tick> *saved;
+
+    explicit scoped_lookup_ticks(const std::vector<run_tick> *ticks) : saved{current_lookup_context().ticks}
+    {
+        current_lookup_context().ticks = ticks;
+    }
+    ~scoped_lookup_ticks()
+    {
+        auto &context = current_lookup_context();
+        context.flush();
+        context.ticks = saved;
+    }
+};
+
+template <typename F> struct is_std_function : std::false_type
+{
+};
+template <typename R, typename... Args> struct is_std_function<std::function<R(Args...)>> : std::true_type
+{
+};
+template <typename F> inline constexpr bool is_std_function_v = is_std_function<std::decay_t<F>>::value;
+} // namespace detail
+
+/**
+ * @brief A random number that depends only on @p seed and @p key
+ * @details This is a hash rather than a generator with state, so a system
+ * split across workers draws the same numbers however its work is chunked,
+ * as long as it keys them by something stable like the entity and the
+ * SystemManager's frame().
+ */
+inline constexpr std::uint64_t stable_random(std::uint64_t seed, std::uint64_t key)
+{
+    // splitmix64's finalizer over the seed's stream, stepped to key
+    auto z = seed + (key + 1) * 0x9e3779b97f4a7c15ull;
+    z      = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z      = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
 enum class system_state
 {
     enabled,
     disabled,
 };
 
+/**
+ * @brief How much work one update of a system did
+ */
+struct update_counts
+{
+    std::size_t matched   = 0; //< Entities that had every component the system needs
+    std::size_t processed = 0; //< Entities the system's update function ran on
+    std::size_t changed   = 0; //< Entities or components the system reported as changed
+
+    inline update_counts &operator+=(const update_counts &other)
+    {
+        matched += other.matched;
+        processed += other.processed;
+        changed += other.changed;
+        return *this;
+    }
+};
+
 struct SystemBase
 {
     std::string name   = "";
     system_state state = system_state::enabled;
 
+    std::vector<component_type_t> reads;  //< Sorted component types this system reads
+    std::vector<component_type_t> writes; //< Sorted component types this system may modify
+
+    bool parallel          = false; //< If the system may split its entities across worker threads
+    std::size_t chunk_size = 0;     //< Entities per parallel chunk, or 0 to size chunks to the cache
+
+    std::size_t period = 1; //< Run on every period-th update of the SystemManager
+    std::size_t phase  = 0; //< Which update within each period to run on
+    int priority       = 0; //< Below zero, the system may be deferred when an update is over its time budget
+
     SystemBase()                              = default;
     SystemBase(const SystemBase &)            = delete;
     SystemBase(SystemBase &&)                 = delete;
@@ -225,6 +633,55 @@ struct SystemBase
     virtual ~SystemBase() = default;
 
   protected:
+    friend struct SystemManager;
+
+    static constexpr std::size_t cache_chunk_bytes = 32 * 1024; //< Working set targeted by one parallel chunk
+
+    ThreadPool *pool = nullptr; //< Workers of the owning SystemManager, set on registration
+
+    update_counts counts; //< Filled in by update_impl() on every update
+
+    std::vector<entity_t> filtered; //< Kept by update_if() between calls so filtering doesn't allocate
+
+    bool deferred = false; //< Skipped for the time budget, so due on the next update regardless of period
+
+    /**
+     * @brief Whether this system should run on the SystemManager's
+     * @p frame-th update
+     */
+    inline bool is_due(frameidx_t frame) const
+    {
+        return deferred || period <= 1 || frame % period == phase % period;
+    }
+
+    /**
+     * @brief Whether this update should be split into chunks of @p count
+     * entities run across the worker pool
+     */
+    inline bool should_run_parallel(std::size_t count) const
+    {
+        return parallel && pool && pool->size() > 0 && count > 1;
+    }
+
+    /**
+     * @brief The parallel chunk size to use, in entities, given the bytes
+     * touched per entity
+     */
+    inline std::size_t effective_chunk_size(std::size_t bytes_per_entity) const
+    {
+        if (chunk_size != 0)
+        {
+            return chunk_size;
+        }
+        return std::max<std::size_t>(1, cache_chunk_bytes / std::max<std::size_t>(1, bytes_per_entity));
+    }
+
+    /**
+     * @brief Whether update_impl() works from the entity list it is given, as
+     * opposed to finding its own entities
+     */
+    virtual bool needs_entities() const { return true; }
+
     /**
      * @brief Update the system for the given entities, and return what was
      * updated
@@ -235,17 +692,53 @@ struct SystemBase
 
   public:
     inline bool is_enabled() const { return state == system_state::enabled; }
+
+    /**
+     * @brief How much work the most recent update did
+     */
+    inline const update_counts &last_counts() const { return counts; }
+
+    /**
+     * @brief Declare that this system reads the given component types
+     * @details Declared access is used by the SystemManager to order systems that
+     * touch the same components. Anything the system looks up through a
+     * ComponentManager outside its own template parameters must be declared here.
+     */
+    template <typename... Ts> SystemBase &declare_reads()
+    {
+        (insert_access(reads, component_type_id<Ts>()), ...);
+        return *this;
+    }
+
+    /**
+     * @brief Declare that this system may modify the given component types
+     */
+    template <typename... Ts> SystemBase &declare_writes()
+    {
+        (insert_access(writes, component_type_id<Ts>()), ...);
+        return *this;
+    }
+
+    /**
+     * @brief Whether this system and @p other cannot safely run at the same time,
+     * because one of them writes a component type the other reads or writes
+     */
+    bool conflicts_with(const SystemBase &other) const
+    {
+        return intersects(writes, other.writes) || intersects(writes, other.reads) || intersects(reads, other.writes);
+    }
     inline void enable() { state = system_state::enabled; }
     inline void disable() { state = system_state::disabled; }
 
     virtual void update(const std::vector<entity_t> &entities) final
     {
+        counts = update_counts{};
         if (state != system_state::enabled)
         {
             std::cerr << "System " << name << " is not enabled" << std::endl;
             return;
         }
-        if (entities.empty())
+        if (entities.empty() && needs_entities())
         {
             return;
         }
@@ -261,23 +754,67 @@ struct SystemBase
         }
     }
 
-    virtual void update_if(const std::vector<entity_t> &entities, std::function<bool(entity_t)> predicate) final
+    virtual void update_if(const std::vector<entity_t> &entities, const std::function<bool(entity_t)> &predicate) final
     {
-        if (state != system_state::enabled)
+        update_if<const std::function<bool(entity_t)> &>(entities, predicate);
+    }
+
+    /**
+     * @brief update() only the entities @p predicate accepts
+     * @details The predicate is called directly rather than through a
+     * @c std::function, and the filtered list reuses the same buffer on every
+     * call. To pass over entities that are paused, disabling them with
+     * ComponentManager::set_enabled() is cheaper still, since queries skip
+     * them without calling anything. An empty @c std::function updates
+     * nothing, whichever overload it reaches.
+     */
+    template <typename P> void update_if(const std::vector<entity_t> &entities, P &&predicate)
+    {
+        if (state != system_state::enabled || entities.empty())
         {
             return;
         }
-        if (entities.empty())
+        if constexpr (detail::is_std_function_v<P>)
         {
-            return;
+            if (!predicate)
+            {
+                return;
+            }
         }
-        if (!predicate)
+        filtered.clear();
+        for (auto entity : entities)
         {
-            return;
+            if (predicate(entity))
+            {
+                filtered.push_back(entity);
+            }
+        }
+        update(filtered);
+    }
+
+  private:
+    static void insert_access(std::vector<component_type_t> &types, component_type_t type)
+    {
+        auto it = std::lower_bound(types.begin(), types.end(), type);
+        if (it == types.end() || *it != type)
+        {
+            types.insert(it, type);
+        }
+    }
+
+    static bool intersects(const std::vector<component_type_t> &a, const std::vector<component_type_t> &b)
+    {
+        auto ia = a.begin();
+        auto ib = b.begin();
+        while (ia != a.end() && ib != b.end())
+        {
+            if (*ia == *ib)
+            {
+                return true;
+            }
+            *ia < *ib ? ++ia : ++ib;
         }
-        std::vector<entity_t> filtered_entities;
-        std::copy_if(entities.begin(), entities.end(), std::back_inserter(filtered_entities), predicate);
-        update(filtered_entities);
+        return false;
     }
 };
 
@@ -289,10 +826,13 @@ struct SystemBase
  * entities to be updated, and the update function is used to update the
  * component. This is useful for systems that need to update entities that have
  * a specific component.
+ *
+ * Each of @p Cs is declared as written by this system, unless it is
+ * const-qualified, in which case it is only declared as read.
  */
 template <typename... Cs> struct GenericSystem : public SystemBase
 {
-    using component_tuple_t = std::tuple<handle<Cs>...>;
+    using component_tuple_t = std::tuple<component_ptr_t<Cs>...>;
 
     using initialize_component_t = std::function<void(entity_t)>;
     using can_update_t           = std::function<bool(entity_t)>;
@@ -306,24 +846,45 @@ template <typename... Cs> struct GenericSystem : public SystemBase
     GenericSystem(can_update_t can_update, component_retriever_t get_components, update_function_t update_components)
         : can_update_f{can_update}, get_components_f{get_components}, update_components_f{update_components}
     {
+        (declare_access<Cs>(), ...);
     }
 
   private:
-    template <typename... Ts> inline bool all_non_null(std::tuple<handle<Ts>...> const &t)
+    std::vector<std::pair<entity_t, component_tuple_t>> matched; //< Reused by every sequential update
+
+    template <typename C> void declare_access()
+    {
+        if constexpr (std::is_const_v<C>)
+        {
+            declare_reads<C>();
+        }
+        else
+        {
+            declare_writes<C>();
+        }
+    }
+
+    static inline bool all_non_null(component_tuple_t const &t)
     {
-        return (... && (std::get<handle<Ts>>(t) != nullptr));
+        return std::apply([](const auto &...c) { return (... && (c != nullptr)); }, t);
     }
 
-    template <typename... Ts> inline bool any_null(std::tuple<handle<Ts>...> const &t)
+    static inline bool any_null(component_tuple_t const &t)
     {
-        return (... || (std::get<handle<Ts>>(t) == nullptr));
+        return std::apply([](const auto &...c) { return (... || (c == nullptr)); }, t);
     }
 
   protected:
     component_set_t update_impl(const std::vector<entity_t> &entities) override
     {
-        // Build a list of entities that have the component
-        std::unordered_map<entity_t, component_tuple_t> components;
+        if (should_run_parallel(entities.size()))
+        {
+            return update_parallel(entities);
+        }
+
+        // Build a list of entities that have the component, in the order given,
+        // so every run updates them in the same order
+        matched.clear();
         for (const auto &entity : entities)
         {
             if (!can_update_f(entity))
@@ -335,230 +896,4541 @@ template <typename... Cs> struct GenericSystem : public SystemBase
             {
                 continue;
             }
-            // Iff all components are present, add them to the map
-            components[entity] = component;
+            // Iff all components are present, add them to the list
+            matched.emplace_back(entity, std::move(component));
         }
         // Update the components
         component_set_t updated_components;
-        for (const auto &[entity, component] : components)
+        for (const auto &[entity, component] : matched)
         {
             auto updated = update_components_f(entity, component);
             updated_components.insert(updated.begin(), updated.end());
         }
+        counts.matched   = matched.size();
+        counts.processed = matched.size();
+        counts.changed   = updated_components.size();
+        matched.clear();
         return updated_components;
     }
-};
 
-//
+    /**
+     * @brief Filter and update the entities in cache-sized chunks across the
+     * worker pool
+     * @details Each chunk collects what it updated into its own set, and the
+     * sets are merged once every chunk has finished, so no locking is needed.
+     * The update function must not write to components of other entities.
+     */
+    component_set_t update_parallel(const std::vector<entity_t> &entities)
+    {
+        auto chunk       = effective_chunk_size(sizeof(component_tuple_t));
+        auto chunk_count = (entities.size() + chunk - 1) / chunk;
+        std::vector<component_set_t> chunk_updates(chunk_count);
+        std::vector<std::size_t> chunk_matched(chunk_count, 0);
+        auto sequence      = detail::current_command_context().sequence;
+        auto *lookup_ticks = detail::current_lookup_context().ticks;
+        pool->parallel_for(entities.size(), chunk, [&](std::size_t begin, std::size_t end, std::size_t index) {
+            detail::scoped_command_context context{sequence, index + 1};
+            detail::scoped_lookup_ticks lookups{lookup_ticks};
+            auto &updated_components = chunk_updates[index];
+            for (auto i = begin; i < end; ++i)
+            {
+                auto entity = entities[i];
+                if (!can_update_f(entity))
+                {
+                    continue;
+                }
+                auto component = get_components_f(entity);
+                if (any_null(component))
+                {
+                    continue;
+                }
+                auto updated = update_components_f(entity, component);
+                updated_components.insert(updated.begin(), updated.end());
+                ++chunk_matched[index];
+            }
+        });
+        for (auto matched : chunk_matched)
+        {
+            counts.matched += matched;
+        }
+        counts.processed = counts.matched;
+
+        // Merge into the largest set to keep rehashing to a minimum
+        auto largest = std::max_element(chunk_updates.begin(), chunk_updates.end(),
+            [](const auto &a, const auto &b) { return a.size() < b.size(); });
+        component_set_t updated_components = std::move(*largest);
+        for (auto it = chunk_updates.begin(); it != chunk_updates.end(); ++it)
+        {
+            if (it != largest)
+            {
+                updated_components.insert(it->begin(), it->end());
+            }
+        }
+        counts.changed = updated_components.size();
+        return updated_components;
+    }
+};
+
+//
 // Managers
 //
 
-class ComponentManager
+#if SIM_ECS_COMPONENT_METADATA
+/**
+ * @brief Debug timestamps kept beside each row of a column, the side-table
+ * counterpart of ComponentBase's fields for plain components
+ */
+struct component_metadata
 {
-    inline static std::atomic<std::size_t> manager_id_counter;
+    time_t created_at;      //< The real-world time when the component was added
+    time_t last_updated_at; //< The real-world time when the component was last written by a query
+};
+#endif
 
-    std::size_t id = manager_id_counter++;
-    std::unordered_set<entity_t> entities;
+/**
+ * @brief An allocator drawing from a shared memory resource that it keeps alive
+ * @details Components allocated through a ComponentManager use this so that
+ * the object and its @c shared_ptr control block come from the manager's pool
+ * in one allocation, and so that a handle outliving the manager still has a
+ * pool to return its memory to.
+ */
+template <typename T> struct pool_allocator
+{
+    using value_type = T;
 
-  public:
-    template <typename T> void add(entity_t entity, std::shared_ptr<T> component)
+    std::shared_ptr<std::pmr::memory_resource> resource;
+
+    explicit pool_allocator(std::shared_ptr<std::pmr::memory_resource> resource) : resource{std::move(resource)} {}
+    template <typename U> pool_allocator(const pool_allocator<U> &other) : resource{other.resource} {}
+
+    inline T *allocate(std::size_t count)
+    {
+        return static_cast<T *>(resource->allocate(count * sizeof(T), alignof(T)));
+    }
+    inline void deallocate(T *ptr, std::size_t count) { resource->deallocate(ptr, count * sizeof(T), alignof(T)); }
+
+    template <typename U> bool operator==(const pool_allocator<U> &other) const { return resource == other.resource; }
+    template <typename U> bool operator!=(const pool_allocator<U> &other) const { return resource != other.resource; }
+};
+
+/**
+ * @brief Type-erased interface to a single component column of an archetype
+ */
+struct ColumnBase
+{
+    ColumnBase()                              = default;
+    ColumnBase(const ColumnBase &)            = delete;
+    ColumnBase(ColumnBase &&)                 = delete;
+    ColumnBase &operator=(const ColumnBase &) = delete;
+    ColumnBase &operator=(ColumnBase &&)      = delete;
+    virtual ~ColumnBase()                     = default;
+
+    std::vector<tick_t> changed; //< The change tick at which each row was last added or written
+#if SIM_ECS_COMPONENT_METADATA
+    std::vector<component_metadata> metadata; //< Debug side table, one entry per row
+#endif
+
+    inline void mark_changed(std::size_t row, tick_t tick)
     {
-        auto &map   = get_map<T>();
-        map[entity] = component;
-        entities.insert(entity);
+        changed[row] = tick;
+#if SIM_ECS_COMPONENT_METADATA
+        metadata[row].last_updated_at = clock_t::now();
+#endif
     }
+    inline bool changed_since(std::size_t row, tick_t tick) const { return changed[row] > tick; }
+
+    virtual std::unique_ptr<ColumnBase> make_empty() const = 0;
+    virtual std::size_t size() const                       = 0;
+    virtual void reserve(std::size_t count)                = 0;
+
+    /**
+     * @brief Append the given row to the end of @p dst and swap-remove it from
+     * this column
+     */
+    virtual void move_to(std::size_t row, ColumnBase &dst) = 0;
 
-    template <typename T> std::shared_ptr<T> get(entity_t entity)
+    /**
+     * @brief Remove the given row by moving the last row into its place
+     */
+    virtual void swap_remove(std::size_t row) = 0;
+
+    /**
+     * @brief swap_remove() each of @p rows, which must be sorted highest first
+     * so that no row still to be removed is moved
+     */
+    virtual void swap_remove_rows(const std::vector<std::size_t> &rows) = 0;
+
+    /**
+     * @brief How many of @p rows, sorted highest first, are the last rows of a
+     * column of @p size, so removing them needs nothing moved
+     */
+    static inline std::size_t removable_tail(const std::vector<std::size_t> &rows, std::size_t size)
     {
-        auto &map = get_map<T>();
-        auto it   = map.find(entity);
-        if (it != map.end())
+        std::size_t tail = 0;
+        while (tail < rows.size() && rows[tail] == size - 1 - tail)
         {
-            return it->second;
+            ++tail;
         }
-        return nullptr;
+        return tail;
     }
 
-    template<typename... Ts> std::tuple<handle<Ts>...> get_view(entity_t entity)
+    /**
+     * @brief Rearrange the rows so that row @c i holds what was row
+     * @c order[i]
+     */
+    virtual void permute(const std::vector<std::size_t> &order) = 0;
+
+    /**
+     * @brief Exchange rows @p a and @p b
+     */
+    virtual void swap_rows(std::size_t a, std::size_t b) = 0;
+
+    /**
+     * @brief Give back spare capacity if less than half of it is in use
+     */
+    virtual void compact() = 0;
+
+    /**
+     * @brief Whether append_clones() can copy this column's components
+     */
+    virtual bool cloneable() const = 0;
+
+    /**
+     * @brief Append @p count copies of the given row, as of @p tick
+     * @details ComponentBase-derived copies are allocated from @p pool.
+     * @throws std::logic_error if the component type cannot be copied
+     */
+    virtual void append_clones(std::size_t row, std::size_t count, tick_t tick,
+        const std::shared_ptr<std::pmr::memory_resource> &pool) = 0;
+
+    /**
+     * @brief For a double-buffered column, make the current values the
+     * previous ones; otherwise do nothing
+     * @details O(rows written since the last swap).
+     */
+    virtual void swap_buffers() = 0;
+
+    /**
+     * @brief For a double-buffered column, remember that each of the row
+     * ranges `[begin, end)` in @p ranges was written, for swap_buffers() to
+     * copy forward; otherwise do nothing
+     */
+    virtual void record_written(const std::vector<std::pair<std::size_t, std::size_t>> &ranges) = 0;
+
+  protected:
+    inline void push_row_state(tick_t tick)
     {
-        return std::make_tuple(get<Ts>(entity)...);
+        changed.push_back(tick);
+#if SIM_ECS_COMPONENT_METADATA
+        auto now = clock_t::now();
+        metadata.push_back(component_metadata{now, now});
+#endif
     }
 
-    template<typename... Ts> bool has_view(entity_t entity)
+    inline void push_row_state_from(const ColumnBase &src, std::size_t row)
     {
-        return (... && has<Ts>(entity));
+        changed.push_back(src.changed[row]);
+#if SIM_ECS_COMPONENT_METADATA
+        metadata.push_back(src.metadata[row]);
+#endif
     }
 
-    std::vector<entity_t> get_all_entities() const { return std::vector<entity_t>(entities.begin(), entities.end()); }
+    inline void push_row_states(std::size_t count, tick_t tick)
+    {
+        changed.insert(changed.end(), count, tick);
+#if SIM_ECS_COMPONENT_METADATA
+        auto now = clock_t::now();
+        metadata.insert(metadata.end(), count, component_metadata{now, now});
+#endif
+    }
 
-    template <typename T> void remove(entity_t entity)
+    inline void reserve_row_state(std::size_t count)
     {
-        auto &map = get_map<T>();
-        map.erase(entity);
+        changed.reserve(count);
+#if SIM_ECS_COMPONENT_METADATA
+        metadata.reserve(count);
+#endif
     }
 
-    bool entity_exists(entity_t entity) const { return entities.find(entity) != entities.end(); }
+    inline void permute_row_state(const std::vector<std::size_t> &order)
+    {
+        std::vector<tick_t> ticks(order.size());
+        for (std::size_t i = 0; i < order.size(); ++i)
+        {
+            ticks[i] = changed[order[i]];
+        }
+        changed.swap(ticks);
+#if SIM_ECS_COMPONENT_METADATA
+        std::vector<component_metadata> meta(order.size());
+        for (std::size_t i = 0; i < order.size(); ++i)
+        {
+            meta[i] = metadata[order[i]];
+        }
+        metadata.swap(meta);
+#endif
+    }
 
-    template <typename T> bool has(entity_t entity) const
+    inline void swap_row_state(std::size_t a, std::size_t b)
     {
-        auto &map = get_map<T>();
-        return map.find(entity) != map.end();
+        std::swap(changed[a], changed[b]);
+#if SIM_ECS_COMPONENT_METADATA
+        std::swap(metadata[a], metadata[b]);
+#endif
     }
 
-    template <typename T> std::unordered_map<entity_t, std::shared_ptr<T>> &get_all() { return get_map<T>(); }
+    inline void compact_row_state()
+    {
+        if (changed.capacity() > 2 * changed.size())
+        {
+            changed.shrink_to_fit();
+#if SIM_ECS_COMPONENT_METADATA
+            metadata.shrink_to_fit();
+#endif
+        }
+    }
 
-  private:
-    template <typename T>
-    static std::unordered_map<entity_t, std::shared_ptr<T>> &get_static_map(std::size_t manager_id)
+    inline void truncate_row_state(std::size_t count)
     {
-        static std::unordered_map<std::size_t, std::unordered_map<entity_t, std::shared_ptr<T>>> map;
-        return map[manager_id];
+        changed.resize(count);
+#if SIM_ECS_COMPONENT_METADATA
+        metadata.resize(count);
+#endif
     }
-    template <typename T> std::unordered_map<entity_t, std::shared_ptr<T>> &get_map() { return get_static_map<T>(id); }
 
-    template <typename T> const std::unordered_map<entity_t, std::shared_ptr<T>> &get_map() const
+    inline void swap_remove_row_state(std::size_t row)
     {
-        return get_static_map<T>(id);
+        changed[row] = changed.back();
+        changed.pop_back();
+#if SIM_ECS_COMPONENT_METADATA
+        metadata[row] = metadata.back();
+        metadata.pop_back();
+#endif
     }
 };
 
-struct SystemManager
+namespace detail
 {
-    struct SystemDependencyNode
+inline void lookup_context::flush()
+{
+    std::sort(written.begin(), written.end());
+    for (std::size_t i = 0; i < written.size();)
     {
-        system_t id;
-        std::vector<system_t> dependencies;
-    };
-    struct ExecutionStage
+        auto *column = written[i].first;
+        ranges.clear();
+        for (; i < written.size() && written[i].first == column; ++i)
+        {
+            auto [begin, end] = written[i].second;
+            if (!ranges.empty() && ranges.back().second >= begin)
+            {
+                ranges.back().second = std::max(ranges.back().second, end);
+            }
+            else
+            {
+                ranges.emplace_back(begin, end);
+            }
+        }
+        column->record_written(ranges);
+    }
+    written.clear();
+}
+} // namespace detail
+
+/**
+ * @brief Stands in for a column's vector when @p T is a tag, counting rows
+ * without storing anything, since every value of a tag is the same
+ */
+template <typename T> struct tag_storage
+{
+    std::size_t count = 0;
+
+    static inline T &value()
     {
-        std::vector<system_t> systems;
-    };
-    using ExecutionGraph = std::vector<ExecutionStage>;
-    std::unordered_map<system_t, SystemDependencyNode> system_nodes;
-    std::unordered_map<system_t, handle<SystemBase>> systems;
+        static T instance{};
+        return instance;
+    }
 
-    SystemManager() = default;
+    inline std::size_t size() const { return count; }
+    inline void reserve(std::size_t) {}
+    inline void resize(std::size_t rows) { count = rows; }
+    inline void push_back(const T &) { ++count; }
+    inline void pop_back() { --count; }
+    inline T &back() { return value(); }
+    inline T &operator[](std::size_t) { return value(); }
+    inline const T &operator[](std::size_t) const { return value(); }
+};
 
-    system_t register_new(handle<SystemBase> system)
+namespace detail
+{
+inline unsigned count_trailing_zeros(std::uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(word));
+#else
+    unsigned n = 0;
+    while ((word & 1) == 0)
     {
-        auto system_id     = create_system();
-        systems[system_id] = system;
-        return system_id;
+        word >>= 1;
+        ++n;
     }
+    return n;
+#endif
+}
+} // namespace detail
 
-    template<typename... Cs>
-    system_t new_system(std::string name,
-        system_state start_state,
-        typename GenericSystem<Cs...>::can_update_t can_update,
-        typename GenericSystem<Cs...>::component_retriever_t get_components,
-        typename GenericSystem<Cs...>::update_function_t update_components)
+/**
+ * @brief One bit per row of an archetype, set while the row's entity is
+ * enabled
+ * @details Bits past the last row are always clear. Queries test 64 rows at a
+ * time, and skip the bits altogether while nothing in the table is disabled.
+ */
+struct enabled_bits
+{
+    std::vector<std::uint64_t> words;
+    std::size_t rows     = 0;
+    std::size_t disabled = 0; //< Rows whose bit is clear
+
+    static inline std::uint64_t bit(std::size_t row) { return std::uint64_t{1} << (row & 63); }
+
+    inline bool test(std::size_t row) const { return (words[row >> 6] & bit(row)) != 0; }
+    inline bool all() const { return disabled == 0; }
+
+    inline void set(std::size_t row, bool enabled)
     {
-        auto system = std::make_shared<GenericSystem<Cs...>>(can_update, get_components, update_components);
-        system->name = name;
-        system->state = start_state;
-        return register_new(system);
+        if (test(row) != enabled)
+        {
+            words[row >> 6] ^= bit(row);
+            enabled ? --disabled : ++disabled;
+        }
     }
 
-    void add_dependency(system_t system, system_t dependency)
+    inline void push_back(bool enabled)
     {
-        if (system_nodes.find(system) == system_nodes.end())
+        if ((rows & 63) == 0)
         {
-            system_nodes[system] = SystemDependencyNode{system, {}};
+            words.push_back(0);
         }
-        system_nodes[system].dependencies.push_back(dependency);
+        if (enabled)
+        {
+            words[rows >> 6] |= bit(rows);
+        }
+        else
+        {
+            ++disabled;
+        }
+        ++rows;
     }
 
-    ExecutionGraph build_execution_graph()
+    void push_back(std::size_t count, bool enabled)
     {
-        ExecutionGraph graph;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            push_back(enabled);
+        }
+    }
 
-        // Count incoming edges for each node
-        std::unordered_map<system_t, int> in_degree;
-        for (const auto &[id, node] : system_nodes)
+    inline void pop_back()
+    {
+        --rows;
+        if (!test(rows))
         {
-            if (in_degree.find(id) == in_degree.end())
-            {
-                in_degree[id] = 0;
-            }
-            for (auto dep : node.dependencies)
-            {
-                in_degree[dep]; // ensure it's in the map
-                in_degree[id]++;
-            }
+            --disabled;
+        }
+        words[rows >> 6] &= ~bit(rows);
+        if ((rows & 63) == 0)
+        {
+            words.pop_back();
+        }
+    }
+
+    /**
+     * @brief Move the last row's bit into @p row and drop the last row
+     */
+    inline void swap_remove(std::size_t row)
+    {
+        auto last = test(rows - 1);
+        if (row + 1 != rows)
+        {
+            set(row, last);
+        }
+        pop_back();
+    }
+
+    void truncate(std::size_t count)
+    {
+        while (rows > count)
+        {
+            pop_back();
+        }
+    }
+
+    void permute(const std::vector<std::size_t> &order)
+    {
+        enabled_bits moved;
+        moved.words.reserve(words.size());
+        for (auto row : order)
+        {
+            moved.push_back(test(row));
         }
+        *this = std::move(moved);
+    }
 
-        // Systems with no dependencies
-        std::queue<system_t> ready;
-        for (const auto &[id, degree] : in_degree)
+    /**
+     * @brief The first row in `[row, end)` whose bit is @p value, or @p end
+     */
+    inline std::size_t find(std::size_t row, std::size_t end, bool value) const
+    {
+        while (row < end)
         {
-            if (degree == 0)
+            auto word = value ? words[row >> 6] : ~words[row >> 6];
+            word &= ~std::uint64_t{0} << (row & 63);
+            if (word != 0)
             {
-                ready.push(id);
+                return std::min(end, (row & ~std::size_t{63}) + detail::count_trailing_zeros(word));
             }
+            row = (row & ~std::size_t{63}) + 64;
         }
+        return end;
+    }
 
-        std::unordered_map<system_t, std::vector<system_t>> reverse_graph;
-        for (const auto &[id, node] : system_nodes)
+    /**
+     * @brief Call `fn(row)` for every enabled row in `[begin, end)`
+     */
+    template <typename F> void for_each(std::size_t begin, std::size_t end, F &&fn) const
+    {
+        for (auto w = begin >> 6; begin < end && w <= (end - 1) >> 6; ++w)
         {
-            for (auto dep : node.dependencies)
+            auto word = words[w];
+            if (w == begin >> 6)
             {
-                reverse_graph[dep].push_back(id);
+                word &= ~std::uint64_t{0} << (begin & 63);
+            }
+            if (w == (end - 1) >> 6 && (end & 63) != 0)
+            {
+                word &= ~std::uint64_t{0} >> (64 - (end & 63));
+            }
+            for (; word != 0; word &= word - 1)
+            {
+                fn((w << 6) + detail::count_trailing_zeros(word));
             }
         }
+    }
 
-        // Build stages
-        while (!ready.empty())
+    /**
+     * @brief Call `fn(run_begin, run_end)` for every run of consecutive enabled
+     * rows in `[begin, end)`
+     */
+    template <typename F> void for_each_run(std::size_t begin, std::size_t end, F &&fn) const
+    {
+        for (auto row = find(begin, end, true); row < end;)
         {
-            ExecutionStage stage;
-            std::queue<system_t> next_ready;
+            auto stop = find(row, end, false);
+            fn(row, stop);
+            row = find(stop, end, true);
+        }
+    }
 
-            // process current stage
-            size_t count = ready.size();
-            for (size_t i = 0; i < count; ++i)
-            {
-                system_t id = ready.front();
-                ready.pop();
-                stage.systems.push_back(id);
+    /**
+     * @brief How many rows in `[begin, end)` are enabled
+     */
+    std::size_t count(std::size_t begin, std::size_t end) const
+    {
+        if (all())
+        {
+            return end - begin;
+        }
+        std::size_t n = 0;
+        for_each_run(begin, end, [&](std::size_t run_begin, std::size_t run_end) { n += run_end - run_begin; });
+        return n;
+    }
+};
 
-                // reduce the dependency count of dependents
-                for (auto dependent : reverse_graph[id])
-                {
-                    if (--in_degree[dependent] == 0)
-                    {
-                        next_ready.push(dependent);
-                    }
-                }
-            }
+namespace detail
+{
+/**
+ * @brief What a double-buffered column keeps besides its current values
+ */
+template <typename V> struct column_buffers
+{
+    std::vector<V> prev;                                      //< Last tick's values
+    std::vector<std::pair<std::size_t, std::size_t>> written; //< Row ranges written since the last swap
+    std::mutex written_mutex;                                 //< Parallel chunks record their writes at once
+};
 
-            graph.push_back(std::move(stage));
-            std::swap(ready, next_ready);
-        }
+/**
+ * @brief What every other column keeps besides its values: nothing, taking no
+ * space as a base
+ */
+struct no_column_buffers
+{
+};
+} // namespace detail
 
-        return graph;
+/**
+ * @brief Contiguous storage for every component of type @p T within an archetype
+ * @details Plain components are stored by value, so a column is a flat array
+ * that can be copied with @c memcpy. ComponentBase-derived components are
+ * stored as handles, and tags are not stored at all.
+ *
+ * A double-buffered column also keeps @c prev, last tick's values, row for row
+ * with @c data. Every row not written since the last swap holds the same value
+ * in both, so at the end of a tick only the rows recorded in @c written are
+ * copied from @c data into @c prev. Both, and the lock guarding @c written,
+ * come from a base that is empty for every other column, so those pay nothing
+ * for them.
+ *
+ * Swapping the two vectors instead would leave each row nobody wrote this tick
+ * with the value from the tick before last.
+ */
+template <typename T>
+struct Column : public ColumnBase,
+                public std::conditional_t<is_double_buffered_v<T>, detail::column_buffers<T>, detail::no_column_buffers>
+{
+    static_assert(!is_double_buffered_v<T> || (is_plain_component_v<T> && !is_tag_component_v<T>),
+        "Only plain components that hold data can be double-buffered");
+
+    using value_type = std::conditional_t<is_plain_component_v<T>, T, handle<T>>;
+    using storage_t  = std::conditional_t<is_tag_component_v<T>, tag_storage<T>, std::vector<value_type>>;
+
+    static constexpr bool buffered = is_double_buffered_v<T>;
+
+    // Bytes stored per row: the value for plain components, the handle for
+    // ComponentBase-derived ones, and nothing for tags
+    static constexpr std::size_t row_bytes = is_tag_component_v<T> ? 0 : sizeof(value_type);
+
+    storage_t data;
+
+    /**
+     * @brief Remember that rows `[begin, end)` of a double-buffered column were
+     * written, for swap_buffers() to copy forward
+     * @details Safe to call from parallel chunks. Ranges may overlap, or go
+     * stale as rows move; copying a row that was not written is harmless, since
+     * its two buffers already hold the same value.
+     */
+    void record_written(std::size_t begin, std::size_t end)
+    {
+        if constexpr (buffered)
+        {
+            std::lock_guard<std::mutex> lock{this->written_mutex};
+            append_written(begin, end);
+        }
     }
 
-    void update(const std::vector<entity_t> &entities)
+    void record_written(const std::vector<std::pair<std::size_t, std::size_t>> &ranges) override
     {
-        auto stages          = build_execution_graph();
-        size_t current_stage = 0;
-        for (const auto &stage : stages)
+        if constexpr (buffered)
         {
-            for (const auto &system_id : stage.systems)
+            std::lock_guard<std::mutex> lock{this->written_mutex};
+            for (auto [begin, end] : ranges)
             {
-                if (systems.find(system_id) == systems.end())
-                {
-                    continue;
-                }
-
-                auto system = systems[system_id];
-                if (!system || !system->is_enabled())
-                {
-                    continue;
-                }
-
-                systems[system_id]->update(entities);
+                append_written(begin, end);
             }
         }
     }
+
+    /**
+     * @brief Stamp a row written outside a query with @p tick
+     */
+    inline void mark_written(std::size_t row, tick_t tick)
+    {
+        mark_changed(row, tick);
+        record_written(row, row + 1);
+    }
+
+    inline T *get(std::size_t row)
+    {
+        if constexpr (is_plain_component_v<T>)
+        {
+            return &data[row];
+        }
+        else
+        {
+            return data[row].get();
+        }
+    }
+
+    inline void push_back(value_type component, tick_t tick)
+    {
+        if constexpr (buffered)
+        {
+            this->prev.push_back(component);
+        }
+        data.push_back(std::move(component));
+        push_row_state(tick);
+    }
+
+    /**
+     * @brief Append @p count copies of @p prototype, each ComponentBase-derived
+     * copy a separate allocation from @p pool
+     */
+    void append_copies(const T &prototype, std::size_t count, tick_t tick,
+        const std::shared_ptr<std::pmr::memory_resource> &pool)
+    {
+        if constexpr (is_tag_component_v<T>)
+        {
+            data.resize(data.size() + count);
+        }
+        else if constexpr (is_plain_component_v<T>)
+        {
+            data.insert(data.end(), count, prototype);
+            if constexpr (buffered)
+            {
+                this->prev.insert(this->prev.end(), count, prototype);
+            }
+        }
+        else
+        {
+            static_assert(std::is_copy_constructible_v<T>, "Only components with a copy constructor can be copied");
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                data.push_back(std::allocate_shared<T>(pool_allocator<T>{pool}, prototype));
+            }
+        }
+        push_row_states(count, tick);
+    }
+
+    std::unique_ptr<ColumnBase> make_empty() const override { return std::make_unique<Column<T>>(); }
+    std::size_t size() const override { return data.size(); }
+    void reserve(std::size_t count) override
+    {
+        data.reserve(count);
+        if constexpr (buffered)
+        {
+            this->prev.reserve(count);
+        }
+        reserve_row_state(count);
+    }
+
+    void move_to(std::size_t row, ColumnBase &dst) override
+    {
+        auto &to = static_cast<Column<T> &>(dst);
+        to.data.push_back(std::move(data[row]));
+        if constexpr (buffered)
+        {
+            to.prev.push_back(this->prev[row]);
+            to.record_written(to.data.size() - 1, to.data.size());
+        }
+        to.push_row_state_from(*this, row);
+        swap_remove(row);
+    }
+
+    void swap_remove(std::size_t row) override
+    {
+        if (row + 1 != data.size())
+        {
+            data[row] = std::move(data.back());
+            if constexpr (buffered)
+            {
+                this->prev[row] = this->prev.back();
+                record_written(row, row + 1);
+            }
+        }
+        data.pop_back();
+        if constexpr (buffered)
+        {
+            this->prev.pop_back();
+        }
+        swap_remove_row_state(row);
+    }
+
+    void swap_remove_rows(const std::vector<std::size_t> &rows) override
+    {
+        // Rows already at the end go in one truncation
+        auto tail = removable_tail(rows, data.size());
+        if constexpr (is_tag_component_v<T>)
+        {
+            data.resize(data.size() - tail);
+        }
+        else
+        {
+            data.erase(data.end() - tail, data.end());
+            if constexpr (buffered)
+            {
+                this->prev.resize(data.size());
+            }
+        }
+        truncate_row_state(data.size());
+        for (auto it = rows.begin() + tail; it != rows.end(); ++it)
+        {
+            Column::swap_remove(*it);
+        }
+    }
+
+    void permute(const std::vector<std::size_t> &order) override
+    {
+        if constexpr (!is_tag_component_v<T>)
+        {
+            std::vector<value_type> moved;
+            moved.reserve(order.size());
+            for (auto row : order)
+            {
+                moved.push_back(std::move(data[row]));
+            }
+            data.swap(moved);
+        }
+        if constexpr (buffered)
+        {
+            std::vector<value_type> moved(order.size());
+            for (std::size_t i = 0; i < order.size(); ++i)
+            {
+                moved[i] = this->prev[order[i]];
+            }
+            this->prev.swap(moved);
+            record_written(0, order.size());
+        }
+        permute_row_state(order);
+    }
+
+    void swap_rows(std::size_t a, std::size_t b) override
+    {
+        if constexpr (!is_tag_component_v<T>)
+        {
+            std::swap(data[a], data[b]);
+        }
+        if constexpr (buffered)
+        {
+            std::swap(this->prev[a], this->prev[b]);
+            record_written(a, a + 1);
+            record_written(b, b + 1);
+        }
+        swap_row_state(a, b);
+    }
+
+    void compact() override
+    {
+        if constexpr (!is_tag_component_v<T>)
+        {
+            if (data.capacity() > 2 * data.size())
+            {
+                data.shrink_to_fit();
+                if constexpr (buffered)
+                {
+                    this->prev.shrink_to_fit();
+                }
+            }
+        }
+        compact_row_state();
+    }
+
+    bool cloneable() const override { return is_plain_component_v<T> || std::is_copy_constructible_v<T>; }
+
+    void append_clones(std::size_t row, std::size_t count, tick_t tick,
+        const std::shared_ptr<std::pmr::memory_resource> &pool) override
+    {
+        if constexpr (is_plain_component_v<T>)
+        {
+            // Copied out first, since appending may reallocate under it
+            T prototype = data[row];
+            append_copies(prototype, count, tick, pool);
+        }
+        else if constexpr (std::is_copy_constructible_v<T>)
+        {
+            // The component itself does not move when the handles do
+            auto keep = data[row];
+            append_copies(*keep, count, tick, pool);
+        }
+        else
+        {
+            throw std::logic_error(std::string("Component type cannot be copied: ") + typeid(T).name());
+        }
+    }
+
+    void swap_buffers() override
+    {
+        if constexpr (buffered)
+        {
+            for (auto [begin, end] : this->written)
+            {
+                // Rows removed since they were written are gone from both
+                end = std::min(end, data.size());
+                if (begin < end)
+                {
+                    std::copy(data.begin() + begin, data.begin() + end, this->prev.begin() + begin);
+                }
+            }
+            this->written.clear();
+        }
+    }
+
+  private:
+    /**
+     * @brief Add a written range, with @c written_mutex held
+     */
+    inline void append_written(std::size_t begin, std::size_t end)
+    {
+        if (!this->written.empty() && this->written.back().second == begin)
+        {
+            this->written.back().second = end;
+        }
+        else
+        {
+            this->written.emplace_back(begin, end);
+        }
+        // Past a range per row, copying every row is cheaper than keeping
+        // track of them
+        if (this->written.size() > data.size())
+        {
+            this->written.assign(1, {0, data.size()});
+        }
+    }
+};
+
+/**
+ * @brief A table holding every entity that has exactly the same set of
+ * component types
+ * @details Each component type in the signature gets its own column, and row
+ * @c i of every column belongs to @c entities[i]. Rows are kept dense by
+ * swap-removal, so iterating a column is a linear walk over contiguous memory.
+ */
+struct Archetype
+{
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    std::vector<component_type_t> signature;           //< Sorted component types stored here
+    std::vector<std::unique_ptr<ColumnBase>> columns;  //< One column per entry in the signature
+    std::vector<entity_t> entities;                    //< The entity owning each row
+    enabled_bits enabled;                              //< Which rows' entities are enabled
+    std::uint64_t version = 0;                         //< Bumped whenever rows are added, removed or rearranged
+    std::vector<std::size_t> column_lookup;            //< Component type to column index, or npos
+    std::unordered_map<component_type_t, std::size_t> add_edges;    //< Archetype reached by adding a type
+    std::unordered_map<component_type_t, std::size_t> remove_edges; //< Archetype reached by removing a type
+
+    Archetype(std::vector<component_type_t> sig, std::vector<std::unique_ptr<ColumnBase>> cols)
+        : signature{std::move(sig)}, columns{std::move(cols)}
+    {
+        auto max_type = signature.empty() ? 0 : signature.back() + 1;
+        column_lookup.assign(max_type, npos);
+        for (std::size_t i = 0; i < signature.size(); ++i)
+        {
+            column_lookup[signature[i]] = i;
+        }
+    }
+
+    inline std::size_t size() const { return entities.size(); }
+
+    /**
+     * @brief Give back the spare capacity of every column that uses less than
+     * half of what it holds
+     */
+    void compact()
+    {
+        for (auto &col : columns)
+        {
+            col->compact();
+        }
+        if (entities.capacity() > 2 * entities.size())
+        {
+            entities.shrink_to_fit();
+            enabled.words.shrink_to_fit();
+        }
+    }
+
+    inline std::size_t column_index(component_type_t type) const
+    {
+        return type < column_lookup.size() ? column_lookup[type] : npos;
+    }
+
+    inline bool has(component_type_t type) const { return column_index(type) != npos; }
+
+    template <typename T> Column<std::remove_cv_t<T>> *column()
+    {
+        auto idx = column_index(component_type_id<T>());
+        return idx == npos ? nullptr : static_cast<Column<std::remove_cv_t<T>> *>(columns[idx].get());
+    }
+};
+
+//
+// Queries
+//
+
+template <typename T> struct Read    //< Query term: entity must have @p T, passed to the system as `const T &`
+{
+    using component_type = T;
+};
+template <typename T> struct Write   //< Query term: entity must have @p T, passed to the system as `T &`
+{
+    using component_type = T;
+};
+template <typename T> struct With    //< Query term: entity must have @p T, which is not passed to the system
+{
+    using component_type = T;
+};
+template <typename T> struct Prev    //< Query term: entity must have the double-buffered @p T, passed as last tick's `const T &`
+{
+    using component_type = T;
+};
+template <typename T> struct Without //< Query term: entity must not have @p T
+{
+    using component_type = T;
+};
+template <typename T> struct Changed //< Query term: entity's @p T was added or written since the system last ran
+{
+    using component_type = T;
+};
+
+/**
+ * @brief The change ticks a query runs with
+ */
+struct query_ticks
+{
+    tick_t this_run = 0; //< Stamped on every written row
+    tick_t last_run = 0; //< Changed<T> terms match rows changed after this
+};
+
+namespace detail
+{
+template <typename Term> struct query_term;
+
+template <typename T> struct query_term<Read<T>>
+{
+    static_assert(!is_tag_component_v<T>, "Tags hold no data; match them with With<T>");
+    static constexpr bool excluded = false;
+    static constexpr bool fetched  = true;
+    using access_t                 = const T;
+};
+
+template <typename T> struct query_term<Write<T>>
+{
+    static_assert(!is_tag_component_v<T>, "Tags hold no data; match them with With<T>");
+    static constexpr bool excluded = false;
+    static constexpr bool fetched  = true;
+    using access_t                 = T;
+};
+
+template <typename T> struct query_term<Prev<T>>
+{
+    static_assert(is_double_buffered_v<T>, "Prev terms need a component type that is double_buffered");
+    static constexpr bool excluded = false;
+    static constexpr bool fetched  = true;
+    using access_t                 = const T;
+};
+
+template <typename T> struct query_term<With<T>>
+{
+    static constexpr bool excluded = false;
+    static constexpr bool fetched  = false;
+    using access_t                 = void;
+};
+
+template <typename T> struct query_term<Without<T>>
+{
+    static constexpr bool excluded = true;
+    static constexpr bool fetched  = false;
+    using access_t                 = void;
+};
+
+template <typename T> struct query_term<Changed<T>>
+{
+    static constexpr bool excluded = false;
+    static constexpr bool fetched  = false;
+    using access_t                 = void;
+};
+
+/**
+ * @brief Row accessor for one fetched column of an archetype
+ */
+template <typename A> struct column_cursor
+{
+    static constexpr bool records_writes = !std::is_const_v<A> && Column<std::remove_cv_t<A>>::buffered;
+
+    Column<std::remove_cv_t<A>> *column;
+    std::size_t written_begin = 0; //< Rows this chunk wrote one after another, not yet recorded in the column
+    std::size_t written_end   = 0;
+
+    inline bool present(std::size_t row) const { return column->get(row) != nullptr; }
+    inline A &at(std::size_t row) const { return *column->get(row); }
+
+    inline void mark_written(std::size_t row, tick_t tick)
+    {
+        if constexpr (!std::is_const_v<A>)
+        {
+            column->mark_changed(row, tick);
+        }
+        if constexpr (records_writes)
+        {
+            if (row != written_end)
+            {
+                flush();
+                written_begin = row;
+            }
+            written_end = row + 1;
+        }
+    }
+
+    /**
+     * @brief Record the rows written by this chunk in the column, once it is
+     * done with them
+     */
+    inline void flush()
+    {
+        if constexpr (records_writes)
+        {
+            if (written_begin != written_end)
+            {
+                column->record_written(written_begin, written_end);
+                written_begin = written_end;
+            }
+        }
+    }
+
+    using value_type = typename Column<std::remove_cv_t<A>>::value_type;
+    using span_t     = sim_ecs::span<std::conditional_t<std::is_const_v<A>, const value_type, value_type>>;
+
+    inline span_t rows(std::size_t begin, std::size_t end) const { return span_t{column->data.data() + begin, end - begin}; }
+
+    inline void mark_written(std::size_t begin, std::size_t end, tick_t tick)
+    {
+        if constexpr (!std::is_const_v<A>)
+        {
+            for (auto row = begin; row < end; ++row)
+            {
+                column->mark_changed(row, tick);
+            }
+        }
+        if constexpr (records_writes)
+        {
+            column->record_written(begin, end);
+        }
+    }
+};
+
+/**
+ * @brief Row accessor for last tick's values of a double-buffered column, as
+ * read by a Prev<T> term
+ */
+template <typename T> struct prev_cursor
+{
+    const Column<T> *column;
+
+    inline bool present(std::size_t) const { return true; }
+    inline const T &at(std::size_t row) const { return column->prev[row]; }
+    inline void mark_written(std::size_t, tick_t) const {}
+    inline void flush() const {}
+
+    using span_t = sim_ecs::span<const T>;
+
+    inline span_t rows(std::size_t begin, std::size_t end) const { return span_t{column->prev.data() + begin, end - begin}; }
+
+    inline void mark_written(std::size_t, std::size_t, tick_t) const {}
+};
+
+/**
+ * @brief Row filter for a Changed<T> term
+ */
+struct changed_cursor
+{
+    const ColumnBase *column;
+
+    inline bool passes(std::size_t row, tick_t last_run) const { return column->changed_since(row, last_run); }
+};
+
+template <typename Term> auto term_cursor(Archetype &arch)
+{
+    if constexpr (!query_term<Term>::fetched)
+    {
+        return std::tuple<>{};
+    }
+    else if constexpr (std::is_same_v<Term, Prev<typename Term::component_type>>)
+    {
+        using component_t = std::remove_cv_t<typename Term::component_type>;
+        return std::tuple<prev_cursor<component_t>>{{arch.column<component_t>()}};
+    }
+    else
+    {
+        using access_t = typename query_term<Term>::access_t;
+        return std::tuple<column_cursor<access_t>>{{arch.column<access_t>()}};
+    }
+}
+
+template <typename Term> auto term_filter(Archetype &arch)
+{
+    if constexpr (!std::is_same_v<Term, Changed<typename Term::component_type>>)
+    {
+        return std::tuple<>{};
+    }
+    else
+    {
+        auto idx = arch.column_index(component_type_id<typename Term::component_type>());
+        return std::tuple<changed_cursor>{{arch.columns[idx].get()}};
+    }
+}
+} // namespace detail
+
+/**
+ * @brief A statically typed set of component requirements, e.g.
+ * `Query<Read<A>, Write<B>, Without<C>>`
+ * @details A query matches whole archetypes, then walks the matching columns
+ * directly and calls the user function as `fn(entity, const A &, B &)`, with
+ * one argument per @c Read, @c Prev or @c Write term in order. Nothing is
+ * type-erased, so the function body can be inlined into the loop.
+ *
+ * Rows visited through a @c Write term are stamped with the run's change tick.
+ * If the function returns @c bool, rows are only stamped when it returns
+ * @c true, so a system can report that it left a component untouched.
+ *
+ * Disabled entities are skipped a 64-row word at a time, and not looked at
+ * at all in archetypes where every entity is enabled.
+ */
+template <typename... Terms> struct Query
+{
+    static constexpr bool writes = (... || std::is_same_v<Terms, Write<typename Terms::component_type>>);
+
+    static bool matches(const Archetype &arch)
+    {
+        return (... && (detail::query_term<Terms>::excluded != arch.has(component_type_id<typename Terms::component_type>())));
+    }
+
+    /**
+     * @brief Run @p fn over rows `[begin, end)` of an archetype that matches
+     * this query
+     * @return How many rows were in range, how many @p fn ran on, and how many
+     * it wrote
+     */
+    template <typename F>
+    static update_counts run(Archetype &arch, std::size_t begin, std::size_t end, F &fn, const query_ticks &ticks)
+    {
+        update_counts counts;
+        counts.matched = end - begin;
+        auto cursors   = std::tuple_cat(detail::term_cursor<Terms>(arch)...);
+        auto filters   = std::tuple_cat(detail::term_filter<Terms>(arch)...);
+        std::apply(
+            [&](auto &...cursor) {
+                auto visit = [&](std::size_t row) {
+                    if (!(... && cursor.present(row)))
+                    {
+                        return;
+                    }
+                    if (!std::apply([&](auto &...filter) { return (... && filter.passes(row, ticks.last_run)); }, filters))
+                    {
+                        return;
+                    }
+                    ++counts.processed;
+                    if constexpr (std::is_same_v<decltype(fn(arch.entities[row], cursor.at(row)...)), bool>)
+                    {
+                        if (fn(arch.entities[row], cursor.at(row)...))
+                        {
+                            (cursor.mark_written(row, ticks.this_run), ...);
+                            counts.changed += writes ? 1 : 0;
+                        }
+                    }
+                    else
+                    {
+                        fn(arch.entities[row], cursor.at(row)...);
+                        (cursor.mark_written(row, ticks.this_run), ...);
+                        counts.changed += writes ? 1 : 0;
+                    }
+                };
+                if (arch.enabled.all())
+                {
+                    for (auto row = begin; row < end; ++row)
+                    {
+                        visit(row);
+                    }
+                }
+                else
+                {
+                    arch.enabled.for_each(begin, end, visit);
+                }
+                (cursor.flush(), ...);
+            },
+            cursors);
+        return counts;
+    }
+
+    /**
+     * @brief Run @p fn once over rows `[begin, end)` of an archetype that
+     * matches this query, passing contiguous spans instead of single rows
+     * @details @p fn is called as `fn(span<const entity_t>, span<const A>,
+     * span<B>, ...)`, with one span per @c Read, @c Prev or @c Write term over
+     * the stored column values: the components themselves for plain
+     * components, or their handles otherwise. Every row of a @c Write span is
+     * stamped as written, unless @p fn returns @c bool and returns @c false,
+     * or returns a `span<const std::uint8_t>` with a byte per row, when only
+     * the rows whose byte is nonzero are.
+     *
+     * Disabled entities split the range, and @p fn is called once for each
+     * run of enabled rows in it.
+     */
+    template <typename F>
+    static update_counts run_batch(Archetype &arch, std::size_t begin, std::size_t end, F &fn, const query_ticks &ticks)
+    {
+        static_assert((... && !std::is_same_v<Terms, Changed<typename Terms::component_type>>),
+            "Changed terms filter single rows and cannot be used in a batch");
+        update_counts counts{end - begin, 0, 0};
+        auto cursors = std::tuple_cat(detail::term_cursor<Terms>(arch)...);
+        std::apply(
+            [&](auto &...cursor) {
+                auto visit = [&](std::size_t run_begin, std::size_t run_end) {
+                    span<const entity_t> entities{arch.entities.data() + run_begin, run_end - run_begin};
+                    counts.processed += run_end - run_begin;
+                    using result_t = decltype(fn(entities, cursor.rows(run_begin, run_end)...));
+                    if constexpr (std::is_same_v<result_t, bool>)
+                    {
+                        if (fn(entities, cursor.rows(run_begin, run_end)...))
+                        {
+                            (cursor.mark_written(run_begin, run_end, ticks.this_run), ...);
+                            counts.changed += writes ? run_end - run_begin : 0;
+                        }
+                    }
+                    else if constexpr (std::is_same_v<result_t, span<const std::uint8_t>>)
+                    {
+                        // Stamp each run of rows the mask says were written
+                        auto written = fn(entities, cursor.rows(run_begin, run_end)...);
+                        auto rows    = std::min(written.size(), run_end - run_begin);
+                        for (std::size_t i = 0; i < rows;)
+                        {
+                            if (!written[i])
+                            {
+                                ++i;
+                                continue;
+                            }
+                            auto j = i + 1;
+                            while (j < rows && written[j])
+                            {
+                                ++j;
+                            }
+                            (cursor.mark_written(run_begin + i, run_begin + j, ticks.this_run), ...);
+                            counts.changed += writes ? j - i : 0;
+                            i = j;
+                        }
+                    }
+                    else
+                    {
+                        fn(entities, cursor.rows(run_begin, run_end)...);
+                        (cursor.mark_written(run_begin, run_end, ticks.this_run), ...);
+                        counts.changed += writes ? run_end - run_begin : 0;
+                    }
+                };
+                if (arch.enabled.all())
+                {
+                    visit(begin, end);
+                }
+                else
+                {
+                    arch.enabled.for_each_run(begin, end, visit);
+                }
+            },
+            cursors);
+        return counts;
+    }
+
+    /**
+     * @brief Run either run() or run_batch()
+     */
+    template <bool Batched, typename F>
+    static update_counts run_rows(Archetype &arch, std::size_t begin, std::size_t end, F &fn, const query_ticks &ticks)
+    {
+        if constexpr (Batched)
+        {
+            return run_batch(arch, begin, end, fn, ticks);
+        }
+        else
+        {
+            return run(arch, begin, end, fn, ticks);
+        }
+    }
+};
+
+class ComponentManager
+{
+    friend struct detail::snapshot_access;
+    friend class Defragmenter;
+
+    struct entity_record
+    {
+        entity_t entity       = NO_ENTITY; //< The entity currently in this slot, to reject stale IDs
+        std::size_t archetype = 0;         //< Index into archetypes
+        std::size_t row       = 0;         //< Row within that archetype
+    };
+
+    struct relation
+    {
+        entity_t owner            = NO_ENTITY; //< The entity that owns this one, if any
+        std::uint32_t slot        = 0;         //< Position in the owner's list of children
+        std::uint32_t child_count = 0;         //< Entities this one owns, to skip the lookup when there are none
+    };
+
+    EntityRegistry registry;
+    std::vector<std::unique_ptr<Archetype>> archetypes;
+    std::map<std::vector<component_type_t>, std::size_t> archetype_index;
+    std::vector<entity_record> records; //< Indexed by entity_index()
+    std::vector<relation> relations;    //< Indexed by entity_index(), as far as the last entity that was ever related
+    std::unordered_map<std::uint32_t, std::vector<entity_t>> children; //< Keyed by the owner's entity_index()
+    std::atomic<tick_t> change_tick = 1;
+    std::function<void(entity_t)> on_destroy; //< Told about each entity about to be destroyed, if set
+
+    // Pooled by size class, so components of one type share blocks and a
+    // despawn hands memory straight back for the next spawn
+    std::shared_ptr<std::pmr::memory_resource> component_pool =
+        std::make_shared<std::pmr::synchronized_pool_resource>();
+
+  public:
+    ComponentManager()
+    {
+        // Archetype 0 is always the empty signature, home to entities whose
+        // components have all been removed
+        archetypes.push_back(std::make_unique<Archetype>(std::vector<component_type_t>{},
+            std::vector<std::unique_ptr<ColumnBase>>{}));
+        archetype_index[{}] = 0;
+    }
+    ComponentManager(const ComponentManager &)            = delete;
+    ComponentManager(ComponentManager &&)                 = delete;
+    ComponentManager &operator=(const ComponentManager &) = delete;
+    ComponentManager &operator=(ComponentManager &&)      = delete;
+
+    /**
+     * @brief Create a new entity in this world, with no components
+     */
+    entity_t create_entity() { return create_entity_in(0); }
+
+    /**
+     * @brief Create one entity for each of @p rows, holding that row's
+     * components
+     * @details The target archetype is found once and its columns reserved up
+     * front, so a large batch is one table insert rather than an archetype move
+     * per component per entity. Like spawn_batch(), the entities take fresh
+     * slots so their IDs are one contiguous range.
+     * @return The entities created, in the order of @p rows
+     */
+    template <typename... Ts>
+    entity_range spawn_rows(std::vector<std::tuple<typename Column<Ts>::value_type...>> rows)
+    {
+        std::size_t idx = archetype_for<Ts...>();
+        Archetype &arch = *archetypes[idx];
+        auto cols       = std::make_tuple(arch.column<Ts>()...);
+        (std::get<Column<Ts> *>(cols)->reserve(arch.size() + rows.size()), ...);
+
+        auto range = create_entities_in(idx, rows.size());
+        auto tick  = advance_change_tick();
+        for (auto &row : rows)
+        {
+            std::apply(
+                [&](auto &...values) { (std::get<Column<Ts> *>(cols)->push_back(std::move(values), tick), ...); }, row);
+        }
+        return range;
+    }
+
+    /**
+     * @brief Create @p count entities holding a copy of each of @p prototypes
+     * @details The archetype is found and its columns reserved once, and the
+     * entities take fresh slots so their IDs are one contiguous range.
+     * ComponentBase-derived prototypes need a copy constructor.
+     */
+    template <typename... Ts> entity_range spawn_batch(std::size_t count, const Ts &...prototypes)
+    {
+        std::size_t idx = archetype_for<Ts...>();
+        Archetype &arch = *archetypes[idx];
+        (arch.column<Ts>()->reserve(arch.size() + count), ...);
+
+        auto range = create_entities_in(idx, count);
+        auto tick  = advance_change_tick();
+        (arch.column<Ts>()->append_copies(prototypes, count, tick, component_pool), ...);
+        return range;
+    }
+
+    /**
+     * @brief Create @p count copies of @p prefab, with every component it has
+     * @details The prefab is an ordinary entity, so it is matched by queries
+     * like any other unless it is kept out of them. ComponentBase-derived
+     * components need a copy constructor.
+     * @throws std::out_of_range if @p prefab is not alive
+     * @throws std::logic_error if one of its components cannot be copied
+     */
+    entity_range instantiate(entity_t prefab, std::size_t count)
+    {
+        auto *rec = find_record(prefab);
+        if (!rec)
+        {
+            throw std::out_of_range("Cannot instantiate a prefab that is not alive");
+        }
+        auto idx        = rec->archetype;
+        auto row        = rec->row;
+        Archetype &arch = *archetypes[idx];
+        for (auto &col : arch.columns)
+        {
+            if (!col->cloneable())
+            {
+                throw std::logic_error("Cannot instantiate a prefab with a component that cannot be copied");
+            }
+            col->reserve(arch.size() + count);
+        }
+
+        auto range = create_entities_in(idx, count);
+        auto tick  = advance_change_tick();
+        for (auto &col : arch.columns)
+        {
+            col->append_clones(row, count, tick, component_pool);
+        }
+        return range;
+    }
+
+    /**
+     * @brief Remove an entity and all of its components, and free its ID for
+     * reuse
+     * @return false if @p entity was not alive
+     */
+    bool destroy_entity(entity_t entity)
+    {
+        auto *rec = find_record(entity);
+        if (!rec)
+        {
+            return false;
+        }
+        if (on_destroy)
+        {
+            on_destroy(entity);
+        }
+        auto &arch = *archetypes[rec->archetype];
+        auto row   = rec->row;
+        for (auto &col : arch.columns)
+        {
+            col->swap_remove(row);
+        }
+        swap_remove_entity(arch, row);
+        *rec = entity_record{};
+        forget_relations(entity);
+        return registry.destroy(entity);
+    }
+
+    /**
+     * @brief Destroy every entity in @p entities, skipping any that are not
+     * alive
+     * @details Rows are grouped by archetype, so each column is visited once per
+     * batch instead of once per entity.
+     * @return How many entities were destroyed
+     */
+    std::size_t destroy_entities(const std::vector<entity_t> &entities)
+    {
+        return destroy_batch(entities.begin(), entities.end());
+    }
+
+    std::size_t destroy_entities(const entity_range &entities)
+    {
+        return destroy_batch(entities.begin(), entities.end());
+    }
+
+    inline bool is_alive(entity_t entity) const { return registry.is_alive(entity); }
+
+    /**
+     * @brief Call @p fn as `fn(entity)` for every entity about to be destroyed,
+     * however it is destroyed, replacing any function set before; an empty one
+     * stops
+     * @details The entity's components can still be looked up from @p fn, for
+     * instance to take it out of an index kept outside this manager. @p fn must
+     * not create, destroy or restructure entities.
+     */
+    inline void set_on_destroy(std::function<void(entity_t)> fn) { on_destroy = std::move(fn); }
+
+    /**
+     * @brief Enable or disable @p entity
+     * @details A disabled entity keeps its components and can still be looked
+     * up, but queries pass over it as if it did not match. Flipping its bit is
+     * all this does, so don't call it while systems are iterating the entity's
+     * archetype; queue it with CommandBuffer::set_enabled() instead.
+     * @return false if @p entity is not alive
+     */
+    bool set_enabled(entity_t entity, bool enabled)
+    {
+        auto *rec = find_record(entity);
+        if (!rec)
+        {
+            return false;
+        }
+        archetypes[rec->archetype]->enabled.set(rec->row, enabled);
+        return true;
+    }
+
+    /**
+     * @brief Whether @p entity is alive and not disabled
+     */
+    bool is_enabled(entity_t entity) const
+    {
+        auto *rec = find_record(entity);
+        return rec && archetypes[rec->archetype]->enabled.test(rec->row);
+    }
+
+    inline const EntityRegistry &entities() const { return registry; }
+
+    /**
+     * @brief Make @p owner the owner of @p child, replacing any owner it had,
+     * or clear its owner if @p owner is NO_ENTITY
+     * @details Entities are tracked as their owner's children, so
+     * children_of() is a lookup rather than a scan. Destroying an owner with
+     * destroy_entity() leaves its children without one; destroy_with_children()
+     * takes them with it.
+     * @throws std::out_of_range if either entity is not alive
+     * @throws std::logic_error if @p child would end up owning itself
+     */
+    void set_owner(entity_t child, entity_t owner)
+    {
+        if (!find_record(child) || (owner != NO_ENTITY && !find_record(owner)))
+        {
+            throw std::out_of_range("Cannot set the owner of an entity that is not alive, or to one");
+        }
+        for (auto e = owner; e != NO_ENTITY; e = owner_of(e))
+        {
+            if (e == child)
+            {
+                throw std::logic_error("Cannot make an entity its own owner");
+            }
+        }
+        unlink(child);
+        link(child, owner);
+    }
+
+    void set_owner(const entity_range &children, entity_t owner)
+    {
+        for (auto child : children)
+        {
+            set_owner(child, owner);
+        }
+    }
+
+    /**
+     * @return The owner of @p entity, or NO_ENTITY if it has none or is not
+     * alive
+     */
+    inline entity_t owner_of(entity_t entity) const
+    {
+        auto index = entity_index(entity);
+        return index < relations.size() && find_record(entity) ? relations[index].owner : NO_ENTITY;
+    }
+
+    /**
+     * @brief Every entity that @p owner owns, in no particular order
+     * @details The span is invalidated by the next change of ownership.
+     */
+    span<const entity_t> children_of(entity_t owner) const
+    {
+        auto index = entity_index(owner);
+        if (index >= relations.size() || relations[index].child_count == 0 || !find_record(owner))
+        {
+            return {};
+        }
+        const auto &list = children.at(index);
+        return {list.data(), list.size()};
+    }
+
+    /**
+     * @brief Destroy @p entity, everything it owns, everything they own, and so
+     * on
+     * @return How many entities were destroyed
+     */
+    std::size_t destroy_with_children(entity_t entity)
+    {
+        if (!find_record(entity))
+        {
+            return 0;
+        }
+        std::vector<entity_t> doomed{entity};
+        for (std::size_t i = 0; i < doomed.size(); ++i)
+        {
+            auto owned = children_of(doomed[i]);
+            doomed.insert(doomed.end(), owned.begin(), owned.end());
+        }
+        return destroy_entities(doomed);
+    }
+
+    /**
+     * @brief Split @p entities into runs of consecutive entities with the same
+     * owner and call `fn(owner, begin, end)` for each
+     * @details Batch systems use this to fetch an owner's components once per
+     * run. After group_by_owner(), each owner has one run per table.
+     */
+    template <typename F> void for_each_owner_run(span<const entity_t> entities, F &&fn) const
+    {
+        for (std::size_t begin = 0, end = 0; begin < entities.size(); begin = end)
+        {
+            auto owner = owner_of(entities[begin]);
+            for (end = begin + 1; end < entities.size() && owner_of(entities[end]) == owner; ++end)
+            {
+            }
+            fn(owner, begin, end);
+        }
+    }
+
+    /**
+     * @brief Reorder the rows of every table so that entities with the same
+     * owner are next to each other
+     * @details Stable within each owner, and tables that are already grouped
+     * are left alone. Moves rows, so any ref or span into a table is
+     * invalidated; change ticks move with their rows.
+     */
+    void group_by_owner()
+    {
+        std::vector<std::uint32_t> keys;
+        std::vector<std::size_t> order;
+        for (std::size_t idx = 0; idx < archetypes.size(); ++idx)
+        {
+            auto &arch = *archetypes[idx];
+            keys.resize(arch.size());
+            for (std::size_t row = 0; row < arch.size(); ++row)
+            {
+                keys[row] = entity_index(owner_of(arch.entities[row]));
+            }
+            if (std::is_sorted(keys.begin(), keys.end()))
+            {
+                continue;
+            }
+            order.resize(arch.size());
+            std::iota(order.begin(), order.end(), std::size_t{0});
+            std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return keys[a] < keys[b]; });
+            permute_rows(idx, order);
+        }
+    }
+
+    /**
+     * @brief Construct a @p T from @p args and add it to an entity
+     * @details Plain components are built in place in their column.
+     * ComponentBase-derived components are allocated from this manager's
+     * component pool.
+     * @return A reference to the new component, valid until it is removed or
+     * the entity's component set changes
+     */
+    template <typename T, typename... Args> T &emplace(entity_t entity, Args &&...args)
+    {
+        if constexpr (is_plain_component_v<T>)
+        {
+            if constexpr (std::is_constructible_v<T, Args &&...>)
+            {
+                return insert<T>(entity, T(std::forward<Args>(args)...));
+            }
+            else
+            {
+                return insert<T>(entity, T{std::forward<Args>(args)...});
+            }
+        }
+        else
+        {
+            return insert<T>(
+                entity, std::allocate_shared<T>(pool_allocator<T>{component_pool}, std::forward<Args>(args)...));
+        }
+    }
+
+    template <typename T> void add(entity_t entity, std::shared_ptr<T> component)
+    {
+        static_assert(!is_plain_component_v<T>, "Plain components are stored by value; add them with emplace()");
+        insert<T>(entity, std::move(component));
+    }
+
+    /**
+     * @brief Get a non-owning reference to an entity's @p T, or nullptr
+     * @details Unlike get(), this does not touch the component's reference
+     * count, so prefer it on hot paths. A non-const lookup of a double-buffered
+     * @p T counts as a write and stamps it as changed.
+     */
+    template <typename T> ref<T> get_ref(entity_t entity)
+    {
+        auto *rec = find_record(entity);
+        if (!rec)
+        {
+            return nullptr;
+        }
+        return get_ref_in<T>(*archetypes[rec->archetype], rec->row);
+    }
+
+    /**
+     * @brief Get last tick's value of an entity's double-buffered @p T, or
+     * nullptr
+     */
+    template <typename T> const T *get_prev(entity_t entity) const
+    {
+        static_assert(is_double_buffered_v<T>, "Only double_buffered components keep last tick's values");
+        auto *rec = find_record(entity);
+        if (!rec)
+        {
+            return nullptr;
+        }
+        auto *col = archetypes[rec->archetype]->column<T>();
+        return col ? &col->prev[rec->row] : nullptr;
+    }
+
+    /**
+     * @brief Make the current values of every double-buffered component the
+     * previous ones
+     * @details SystemManager::update() calls this when it finishes, for every
+     * ComponentManager it tracks. Code writing outside any SystemManager calls
+     * it itself. Only the rows recorded as written since the last swap are
+     * copied.
+     */
+    void swap_buffers()
+    {
+        for (auto &arch : archetypes)
+        {
+            for (auto &col : arch->columns)
+            {
+                col->swap_buffers();
+            }
+        }
+    }
+
+    template <typename... Ts> std::tuple<ref<Ts>...> get_refs(entity_t entity)
+    {
+        auto *rec = find_record(entity);
+        if (!rec)
+        {
+            return std::make_tuple(ref<Ts>{}...);
+        }
+        auto &arch = *archetypes[rec->archetype];
+        return std::make_tuple(get_ref_in<Ts>(arch, rec->row)...);
+    }
+
+    /**
+     * @brief Get an entity's @p T: a handle for ComponentBase-derived
+     * components, or a ref for plain components, or nullptr if it has none
+     */
+    template <typename T> component_ptr_t<T> get(entity_t entity)
+    {
+        auto *rec = find_record(entity);
+        if (!rec)
+        {
+            return nullptr;
+        }
+        return get_in<T>(*archetypes[rec->archetype], rec->row);
+    }
+
+    template<typename... Ts> std::tuple<component_ptr_t<Ts>...> get_view(entity_t entity)
+    {
+        auto *rec = find_record(entity);
+        if (!rec)
+        {
+            return std::make_tuple(component_ptr_t<Ts>{}...);
+        }
+        auto &arch = *archetypes[rec->archetype];
+        auto row   = rec->row;
+        return std::make_tuple(get_in<Ts>(arch, row)...);
+    }
+
+    template<typename... Ts> bool has_view(entity_t entity) const
+    {
+        auto *rec = find_record(entity);
+        if (!rec)
+        {
+            return false;
+        }
+        auto &arch = *archetypes[rec->archetype];
+        return (... && arch.has(component_type_id<Ts>()));
+    }
+
+    std::vector<entity_t> get_all_entities() const
+    {
+        std::vector<entity_t> all;
+        get_all_entities(all);
+        return all;
+    }
+
+    /**
+     * @brief Replace the contents of @p all with every live entity, reusing its
+     * storage
+     */
+    void get_all_entities(std::vector<entity_t> &all) const
+    {
+        all.clear();
+        all.reserve(registry.size());
+        for (const auto &arch : archetypes)
+        {
+            all.insert(all.end(), arch->entities.begin(), arch->entities.end());
+        }
+    }
+
+    /**
+     * @return false if @p entity is not alive or has no @p T
+     */
+    template <typename T> bool remove(entity_t entity)
+    {
+        auto *found = find_record(entity);
+        if (!found)
+        {
+            return false;
+        }
+        auto &rec  = *found;
+        auto type  = component_type_id<T>();
+        if (!archetypes[rec.archetype]->has(type))
+        {
+            return false;
+        }
+        auto dst_idx = find_remove_edge(rec.archetype, type);
+        move_entity(entity, rec, dst_idx);
+        return true;
+    }
+
+    bool entity_exists(entity_t entity) const { return find_record(entity) != nullptr; }
+
+    template <typename T> bool has(entity_t entity) const { return has_view<T>(entity); }
+
+    /**
+     * @brief Collect every component of type @p T, keyed by entity
+     * @details This builds a new map on every call; prefer @c each() to walk the
+     * columns in place.
+     */
+    template <typename T> std::unordered_map<entity_t, component_ptr_t<T>> get_all()
+    {
+        std::unordered_map<entity_t, component_ptr_t<T>> all;
+        auto tick = lookup_tick<T>();
+        for (auto &arch : archetypes)
+        {
+            auto *col = arch->column<T>();
+            if (!col)
+            {
+                continue;
+            }
+            stamp_lookups<T>(*col, 0, arch->size(), tick);
+            for (std::size_t row = 0; row < arch->size(); ++row)
+            {
+                if constexpr (is_plain_component_v<T>)
+                {
+                    all.emplace(arch->entities[row], col->get(row));
+                }
+                else
+                {
+                    all.emplace(arch->entities[row], col->data[row]);
+                }
+            }
+        }
+        return all;
+    }
+
+    /**
+     * @brief Invoke @p fn for every entity that has all of the components @p Ts
+     * @details Matching archetypes are visited one at a time and their columns
+     * are walked linearly. @p fn is called with the entity and each column's
+     * stored value: a handle for ComponentBase-derived components and a
+     * reference for plain ones. It must not add or remove components while
+     * iterating. Disabled entities are skipped. Double-buffered rows handed
+     * out for writing are stamped with one change tick for the whole call.
+     */
+    template <typename... Ts, typename F> void each(F &&fn)
+    {
+        auto tick = lookup_tick<Ts...>();
+        for (auto &arch : archetypes)
+        {
+            if (!(... && arch->has(component_type_id<Ts>())) || arch->size() == 0)
+            {
+                continue;
+            }
+            auto cols  = std::make_tuple(arch->column<Ts>()...);
+            auto visit = [&](std::size_t begin, std::size_t end) {
+                (stamp_lookups<Ts>(*std::get<Column<std::remove_cv_t<Ts>> *>(cols), begin, end, tick), ...);
+                for (auto row = begin; row < end; ++row)
+                {
+                    fn(arch->entities[row], std::get<Column<std::remove_cv_t<Ts>> *>(cols)->data[row]...);
+                }
+            };
+            if (arch->enabled.all())
+            {
+                visit(0, arch->size());
+            }
+            else
+            {
+                arch->enabled.for_each_run(0, arch->size(), visit);
+            }
+        }
+    }
+
+    /**
+     * @brief Invoke @p fn for every entity matching `Query<Terms...>`
+     * @details @p fn is called as `fn(entity, const A &, B &, ...)` with one
+     * argument per @c Read or @c Write term. It must not add or remove
+     * components while iterating. Written rows are stamped with @c ticks.this_run
+     * and @c Changed terms compare against @c ticks.last_run.
+     */
+    template <typename... Terms, typename F> void query(const query_ticks &ticks, F &&fn)
+    {
+        for (auto &arch : archetypes)
+        {
+            if (arch->size() != 0 && Query<Terms...>::matches(*arch))
+            {
+                Query<Terms...>::run(*arch, 0, arch->size(), fn, ticks);
+            }
+        }
+    }
+
+    /**
+     * @brief Invoke @p fn for every entity matching `Query<Terms...>`, as a new
+     * change tick, with @c Changed terms matching anything ever changed
+     */
+    template <typename... Terms, typename F> void query(F &&fn)
+    {
+        query<Terms...>(query_ticks{advance_change_tick(), 0}, std::forward<F>(fn));
+    }
+
+    /**
+     * @brief Invoke @p fn once per archetype matching `Query<Terms...>`, with
+     * spans over its columns; see Query::run_batch()
+     */
+    template <typename... Terms, typename F> void query_batches(const query_ticks &ticks, F &&fn)
+    {
+        for (auto &arch : archetypes)
+        {
+            if (arch->size() != 0 && Query<Terms...>::matches(*arch))
+            {
+                Query<Terms...>::run_batch(*arch, 0, arch->size(), fn, ticks);
+            }
+        }
+    }
+
+    template <typename... Terms, typename F> void query_batches(F &&fn)
+    {
+        query_batches<Terms...>(query_ticks{advance_change_tick(), 0}, std::forward<F>(fn));
+    }
+
+    /**
+     * @brief The latest change tick handed out
+     * @details Change ticks count system runs, not frames: each run takes a new
+     * tick, stamps what it writes with it, and remembers it so the next run can
+     * ask what changed in between. Anything written outside a run, such as a
+     * spawn or a command played back, takes a new tick of its own, so it is
+     * newer than every run so far, the last one included.
+     */
+    inline tick_t current_change_tick() const { return change_tick.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Take a new change tick for a system run that is about to start
+     */
+    inline tick_t advance_change_tick() { return change_tick.fetch_add(1, std::memory_order_acq_rel) + 1; }
+
+    /**
+     * @brief Stamp an entity's @p T as changed, for code that writes components
+     * outside of a query
+     */
+    template <typename T> void mark_changed(entity_t entity)
+    {
+        auto *rec = find_record(entity);
+        if (!rec)
+        {
+            return;
+        }
+        if (auto *col = archetypes[rec->archetype]->column<T>())
+        {
+            col->mark_written(rec->row, advance_change_tick());
+        }
+    }
+
+    /**
+     * @brief Whether an entity's @p T was added or written after change tick
+     * @p tick
+     */
+    template <typename T> bool changed_since(entity_t entity, tick_t tick) const
+    {
+        auto *rec = find_record(entity);
+        if (!rec)
+        {
+            return false;
+        }
+        auto &arch = *archetypes[rec->archetype];
+        auto idx   = arch.column_index(component_type_id<T>());
+        return idx != Archetype::npos && arch.columns[idx]->changed_since(rec->row, tick);
+    }
+
+    /**
+     * @brief The archetype tables currently in use, for systems that want to
+     * iterate columns directly
+     */
+    const std::vector<std::unique_ptr<Archetype>> &get_archetypes() const { return archetypes; }
+
+  private:
+    /**
+     * @brief Store a component's column value for an entity, replacing any
+     * existing @p T
+     * @throws std::out_of_range if @p entity was not created by this manager or
+     * has been destroyed
+     */
+    template <typename T> T &insert(entity_t entity, typename Column<T>::value_type value)
+    {
+        static_assert(!std::is_const_v<T>, "Cannot add a const component");
+        auto type   = component_type_id<T>();
+        auto *found = find_record(entity);
+        if (!found)
+        {
+            throw std::out_of_range("Cannot add a component to an entity that is not alive");
+        }
+        auto &rec = *found;
+        auto *src = archetypes[rec.archetype].get();
+        if (auto *col = src->column<T>())
+        {
+            // Already present, so just replace it in place
+            col->data[rec.row] = std::move(value);
+            col->mark_written(rec.row, advance_change_tick());
+            return *col->get(rec.row);
+        }
+
+        std::size_t dst_idx = find_add_edge(rec.archetype, type, std::make_unique<Column<T>>());
+        move_entity(entity, rec, dst_idx);
+        auto *col = archetypes[dst_idx]->template column<T>();
+        col->push_back(std::move(value), advance_change_tick());
+        return *col->get(rec.row);
+    }
+
+    /**
+     * @brief The change tick to stamp rows of any of @p Ts handed out for
+     * writing with, or 0 if none need stamping
+     * @details The running system's tick if a SystemManager tracking this
+     * manager is running one, and otherwise a new one.
+     */
+    template <typename... Ts> inline tick_t lookup_tick()
+    {
+        if constexpr ((... || (is_double_buffered_v<Ts> && !std::is_const_v<Ts>)))
+        {
+            auto tick = detail::current_lookup_context().tick_for(this);
+            return tick != 0 ? tick : advance_change_tick();
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    /**
+     * @brief Stamp double-buffered rows `[begin, end)` handed out for writing
+     * outside of a query with @p tick, recording the range so swap_buffers()
+     * knows to copy it forward
+     * @details Within a system run the range is kept by the calling thread
+     * until the run or its chunk ends, and otherwise recorded at once.
+     */
+    template <typename T>
+    inline void stamp_lookups(Column<std::remove_cv_t<T>> &col, std::size_t begin, std::size_t end, tick_t tick)
+    {
+        if constexpr (is_double_buffered_v<T> && !std::is_const_v<T>)
+        {
+            for (auto row = begin; row < end; ++row)
+            {
+                col.mark_changed(row, tick);
+            }
+            auto &context = detail::current_lookup_context();
+            if (context.ticks)
+            {
+                context.add(&col, begin, end);
+            }
+            else
+            {
+                col.record_written(begin, end);
+            }
+        }
+    }
+
+    template <typename T> inline void stamp_lookup(Column<std::remove_cv_t<T>> &col, std::size_t row)
+    {
+        stamp_lookups<T>(col, row, row + 1, lookup_tick<T>());
+    }
+
+    template <typename T> ref<T> get_ref_in(Archetype &arch, std::size_t row)
+    {
+        auto *col = arch.column<T>();
+        if (!col)
+        {
+            return nullptr;
+        }
+        stamp_lookup<T>(*col, row);
+        return col->get(row);
+    }
+
+    template <typename T> component_ptr_t<T> get_in(Archetype &arch, std::size_t row)
+    {
+        auto *col = arch.column<T>();
+        if constexpr (is_plain_component_v<T>)
+        {
+            if (!col)
+            {
+                return nullptr;
+            }
+            stamp_lookup<T>(*col, row);
+            return col->get(row);
+        }
+        else
+        {
+            return col ? col->data[row] : nullptr;
+        }
+    }
+
+  public:
+#if SIM_ECS_COMPONENT_METADATA
+    /**
+     * @brief Debug timestamps for an entity's @p T, from the side table kept in
+     * builds with SIM_ECS_COMPONENT_METADATA enabled
+     */
+    template <typename T> maybe<component_metadata> metadata(entity_t entity) const
+    {
+        auto *rec = find_record(entity);
+        if (!rec)
+        {
+            return nothing;
+        }
+        auto &arch = *archetypes[rec->archetype];
+        auto idx   = arch.column_index(component_type_id<T>());
+        if (idx == Archetype::npos)
+        {
+            return nothing;
+        }
+        return arch.columns[idx]->metadata[rec->row];
+    }
+#endif
+
+  private:
+
+    /**
+     * @brief Create an entity and give it a row in an archetype; the caller is
+     * responsible for filling that row's columns
+     */
+    entity_t create_entity_in(std::size_t archetype)
+    {
+        auto entity = registry.create();
+        auto index  = entity_index(entity);
+        if (records.size() <= index)
+        {
+            records.resize(index + 1);
+        }
+        auto &arch     = *archetypes[archetype];
+        records[index] = entity_record{entity, archetype, arch.entities.size()};
+        arch.entities.push_back(entity);
+        arch.enabled.push_back(true);
+        ++arch.version;
+        return entity;
+    }
+
+    /**
+     * @brief create_entity_in() for @p count entities in fresh slots; the caller
+     * fills their rows
+     */
+    entity_range create_entities_in(std::size_t archetype, std::size_t count)
+    {
+        auto range = registry.create_range(count);
+        records.resize(std::max(records.size(), static_cast<std::size_t>(range.first) + count));
+        auto &arch = *archetypes[archetype];
+        arch.entities.reserve(arch.size() + count);
+        for (auto entity : range)
+        {
+            records[entity_index(entity)] = entity_record{entity, archetype, arch.entities.size()};
+            arch.entities.push_back(entity);
+        }
+        arch.enabled.push_back(count, true);
+        ++arch.version;
+        return range;
+    }
+
+    template <typename It> std::size_t destroy_batch(It first, It last)
+    {
+        // Rows to go in each archetype, released from the registry up front so
+        // a repeated ID is only counted once
+        std::vector<std::vector<std::size_t>> doomed(archetypes.size());
+        std::size_t destroyed = 0;
+        for (; first != last; ++first)
+        {
+            auto entity = *first;
+            auto *rec   = find_record(entity);
+            if (!rec)
+            {
+                continue;
+            }
+            if (on_destroy)
+            {
+                on_destroy(entity);
+            }
+            doomed[rec->archetype].push_back(rec->row);
+            *rec = entity_record{};
+            forget_relations(entity);
+            registry.destroy(entity);
+            ++destroyed;
+        }
+
+        std::vector<bool> hit;
+        for (std::size_t idx = 0; idx < doomed.size(); ++idx)
+        {
+            auto &rows = doomed[idx];
+            if (rows.empty())
+            {
+                continue;
+            }
+            auto &arch = *archetypes[idx];
+
+            // Highest row first; a large batch is put in order by a pass over
+            // the table rather than a sort
+            if (rows.size() * 8 >= arch.size())
+            {
+                hit.assign(arch.size(), false);
+                for (auto row : rows)
+                {
+                    hit[row] = true;
+                }
+                rows.clear();
+                for (auto row = arch.size(); row-- > 0;)
+                {
+                    if (hit[row])
+                    {
+                        rows.push_back(row);
+                    }
+                }
+            }
+            else
+            {
+                std::sort(rows.begin(), rows.end(), std::greater<std::size_t>());
+            }
+
+            for (auto &col : arch.columns)
+            {
+                col->swap_remove_rows(rows);
+            }
+            auto tail = ColumnBase::removable_tail(rows, arch.size());
+            arch.entities.resize(arch.size() - tail);
+            arch.enabled.truncate(arch.size());
+            ++arch.version;
+            for (auto it = rows.begin() + tail; it != rows.end(); ++it)
+            {
+                swap_remove_entity(arch, *it);
+            }
+        }
+        return destroyed;
+    }
+
+    /**
+     * @brief Rearrange a table's rows as Column::permute() does, keeping entity
+     * records in step
+     */
+    void permute_rows(std::size_t idx, const std::vector<std::size_t> &order)
+    {
+        auto &arch = *archetypes[idx];
+        for (auto &col : arch.columns)
+        {
+            col->permute(order);
+        }
+        std::vector<entity_t> entities(order.size());
+        for (std::size_t row = 0; row < order.size(); ++row)
+        {
+            entities[row]                            = arch.entities[order[row]];
+            records[entity_index(entities[row])].row = row;
+        }
+        arch.entities.swap(entities);
+        arch.enabled.permute(order);
+        ++arch.version;
+    }
+
+    /**
+     * @brief Exchange two rows of a table, keeping entity records in step
+     */
+    void swap_rows(Archetype &arch, std::size_t a, std::size_t b)
+    {
+        for (auto &col : arch.columns)
+        {
+            col->swap_rows(a, b);
+        }
+        auto enabled_a = arch.enabled.test(a);
+        arch.enabled.set(a, arch.enabled.test(b));
+        arch.enabled.set(b, enabled_a);
+        std::swap(arch.entities[a], arch.entities[b]);
+        records[entity_index(arch.entities[a])].row = a;
+        records[entity_index(arch.entities[b])].row = b;
+    }
+
+    void link(entity_t child, entity_t owner)
+    {
+        if (owner == NO_ENTITY)
+        {
+            return;
+        }
+        auto needed = std::max(entity_index(child), entity_index(owner)) + std::size_t{1};
+        if (relations.size() < needed)
+        {
+            relations.resize(needed);
+        }
+        auto &list = children[entity_index(owner)];
+        relations[entity_index(child)] = relation{owner, static_cast<std::uint32_t>(list.size()),
+            relations[entity_index(child)].child_count};
+        list.push_back(child);
+        ++relations[entity_index(owner)].child_count;
+    }
+
+    /**
+     * @brief Take @p child out of its owner's list of children, if it has an
+     * owner
+     */
+    void unlink(entity_t child)
+    {
+        auto index = entity_index(child);
+        if (index >= relations.size() || relations[index].owner == NO_ENTITY)
+        {
+            return;
+        }
+        auto &rel  = relations[index];
+        auto owner = entity_index(rel.owner);
+        auto &list = children[owner];
+
+        // Swap-remove, moving the last child into the freed slot
+        auto moved                          = list.back();
+        list[rel.slot]                      = moved;
+        relations[entity_index(moved)].slot = rel.slot;
+        list.pop_back();
+        if (--relations[owner].child_count == 0)
+        {
+            children.erase(owner);
+        }
+        rel.owner = NO_ENTITY;
+        rel.slot  = 0;
+    }
+
+    /**
+     * @brief Unlink an entity that is being destroyed from its owner, and leave
+     * its children without one
+     */
+    void forget_relations(entity_t entity)
+    {
+        auto index = entity_index(entity);
+        if (index >= relations.size())
+        {
+            return;
+        }
+        unlink(entity);
+        if (relations[index].child_count != 0)
+        {
+            for (auto child : children[index])
+            {
+                relations[entity_index(child)].owner = NO_ENTITY;
+                relations[entity_index(child)].slot  = 0;
+            }
+            children.erase(index);
+            relations[index].child_count = 0;
+        }
+    }
+
+    /**
+     * @brief The archetype holding exactly the components @p Ts, created if
+     * needed
+     */
+    template <typename... Ts> std::size_t archetype_for()
+    {
+        std::vector<component_type_t> signature{component_type_id<Ts>()...};
+        std::sort(signature.begin(), signature.end());
+        return get_or_create_archetype(std::move(signature), [](component_type_t type) {
+            std::unique_ptr<ColumnBase> col;
+            ((type == component_type_id<Ts>() ? (void)(col = std::make_unique<Column<Ts>>()) : (void)0), ...);
+            return col;
+        });
+    }
+
+    inline const entity_record *find_record(entity_t entity) const
+    {
+        auto index = entity_index(entity);
+        if (index >= records.size() || records[index].entity != entity || entity == NO_ENTITY)
+        {
+            return nullptr;
+        }
+        return &records[index];
+    }
+
+    inline entity_record *find_record(entity_t entity)
+    {
+        return const_cast<entity_record *>(std::as_const(*this).find_record(entity));
+    }
+
+    /**
+     * @brief Remove an archetype's row from its entity list, fixing up the
+     * record of the entity that was moved into its place
+     */
+    void swap_remove_entity(Archetype &arch, std::size_t row)
+    {
+        auto last          = arch.entities.back();
+        arch.entities[row] = last;
+        arch.entities.pop_back();
+        arch.enabled.swap_remove(row);
+        ++arch.version;
+        records[entity_index(last)].row = row;
+    }
+
+    std::size_t get_or_create_archetype(
+        std::vector<component_type_t> signature, const std::function<std::unique_ptr<ColumnBase>(component_type_t)> &make_column)
+    {
+        auto it = archetype_index.find(signature);
+        if (it != archetype_index.end())
+        {
+            return it->second;
+        }
+        std::vector<std::unique_ptr<ColumnBase>> cols;
+        cols.reserve(signature.size());
+        for (auto type : signature)
+        {
+            cols.push_back(make_column(type));
+        }
+        auto idx = archetypes.size();
+        archetypes.push_back(std::make_unique<Archetype>(signature, std::move(cols)));
+        archetype_index.emplace(std::move(signature), idx);
+        return idx;
+    }
+
+    std::size_t find_add_edge(std::size_t src_idx, component_type_t type, std::unique_ptr<ColumnBase> new_column)
+    {
+        auto &src = *archetypes[src_idx];
+        auto it   = src.add_edges.find(type);
+        if (it != src.add_edges.end())
+        {
+            return it->second;
+        }
+        auto signature = src.signature;
+        signature.insert(std::upper_bound(signature.begin(), signature.end(), type), type);
+        auto dst_idx = get_or_create_archetype(std::move(signature), [&](component_type_t t) {
+            auto &from = *archetypes[src_idx];
+            return t == type ? std::move(new_column) : from.columns[from.column_index(t)]->make_empty();
+        });
+        archetypes[src_idx]->add_edges[type]    = dst_idx;
+        archetypes[dst_idx]->remove_edges[type] = src_idx;
+        return dst_idx;
+    }
+
+    std::size_t find_remove_edge(std::size_t src_idx, component_type_t type)
+    {
+        auto &src = *archetypes[src_idx];
+        auto it   = src.remove_edges.find(type);
+        if (it != src.remove_edges.end())
+        {
+            return it->second;
+        }
+        auto signature = src.signature;
+        signature.erase(std::find(signature.begin(), signature.end(), type));
+        auto dst_idx = get_or_create_archetype(std::move(signature), [&](component_type_t t) {
+            auto &from = *archetypes[src_idx];
+            return from.columns[from.column_index(t)]->make_empty();
+        });
+        archetypes[src_idx]->remove_edges[type] = dst_idx;
+        archetypes[dst_idx]->add_edges[type]    = src_idx;
+        return dst_idx;
+    }
+
+    /**
+     * @brief Move an entity's row into another archetype, carrying over every
+     * column both tables share and dropping the rest
+     */
+    void move_entity(entity_t entity, entity_record &rec, std::size_t dst_idx)
+    {
+        auto &src    = *archetypes[rec.archetype];
+        auto &dst    = *archetypes[dst_idx];
+        auto row     = rec.row;
+        auto new_row = dst.entities.size();
+        for (std::size_t c = 0; c < src.signature.size(); ++c)
+        {
+            auto dst_col = dst.column_index(src.signature[c]);
+            if (dst_col != Archetype::npos)
+            {
+                src.columns[c]->move_to(row, *dst.columns[dst_col]);
+            }
+            else
+            {
+                src.columns[c]->swap_remove(row);
+            }
+        }
+        dst.entities.push_back(entity);
+        dst.enabled.push_back(src.enabled.test(row));
+        ++dst.version;
+        swap_remove_entity(src, row);
+        rec = entity_record{entity, dst_idx, new_row};
+    }
+};
+
+//
+// Maintenance
+//
+
+/**
+ * @brief Interleave the bits of @p x and @p y, so that sorting by the result
+ * follows a Z-order curve and points near each other in 2D mostly stay near
+ * each other in 1D
+ */
+inline std::uint64_t morton_code(std::uint32_t x, std::uint32_t y)
+{
+    auto spread = [](std::uint64_t v) {
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+        v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+        v = (v | (v << 2)) & 0x3333333333333333ull;
+        v = (v | (v << 1)) & 0x5555555555555555ull;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+/**
+ * @brief Puts the rows of a ComponentManager's tables in order of a key and
+ * gives back spare capacity, a little at a time
+ * @details Each step() stops once it has used up its budget and the next one
+ * picks up where it left off, so a full pass can be spread over the idle time
+ * of many ticks. Tables are done one after another: the key of every row is
+ * computed, the keys are sorted in bounded runs and merges, and then rows are
+ * swapped into place one pair at a time. Entity records follow their rows, so
+ * entity IDs, lookups and relations are unaffected, but refs and spans into a
+ * table are not; call step() between updates.
+ *
+ * A table whose rows are added, removed or rearranged between steps is
+ * started over. A table already in key order is only read, and without a key
+ * a pass only compacts.
+ */
+class Defragmenter
+{
+  public:
+    using key_fn_t = std::function<std::uint64_t(entity_t)>;
+
+    explicit Defragmenter(ComponentManager &components, key_fn_t key = {})
+        : components{components}, key{std::move(key)}
+    {
+    }
+    Defragmenter(const Defragmenter &)            = delete;
+    Defragmenter(Defragmenter &&)                 = delete;
+    Defragmenter &operator=(const Defragmenter &) = delete;
+    Defragmenter &operator=(Defragmenter &&)      = delete;
+
+    /**
+     * @brief A key that groups entities by owner, as
+     * ComponentManager::group_by_owner() does
+     */
+    static key_fn_t by_owner(const ComponentManager &components)
+    {
+        return [&components](entity_t entity) -> std::uint64_t { return entity_index(components.owner_of(entity)); };
+    }
+
+    /**
+     * @brief Work for about @p budget, never less than one unit of work
+     * @return true if this step finished a pass over every table; the next one
+     * starts another
+     */
+    bool step(duration_t budget)
+    {
+        auto deadline = clock_t::now() + budget;
+        for (; table < components.archetypes.size(); ++table)
+        {
+            if (!step_table(*components.archetypes[table], deadline))
+            {
+                return false;
+            }
+        }
+        table = 0;
+        ++pass_count;
+        return true;
+    }
+
+    inline std::size_t passes() const { return pass_count; }
+    inline std::size_t rows_moved() const { return moved; }
+
+  private:
+    enum class phase
+    {
+        keys,
+        sort,
+        merge,
+        index,
+        apply,
+        compact
+    };
+
+    static constexpr std::size_t run_length     = 4 * 1024; //< Keys sorted at a time before merging
+    static constexpr std::size_t check_interval = 256;      //< Rows between looks at the clock
+
+    ComponentManager &components;
+    key_fn_t key;
+
+    std::size_t table     = 0; //< Index of the table being worked on
+    phase at              = phase::keys;
+    std::uint64_t version = 0; //< The table's version when work on it started
+    std::size_t cursor    = 0; //< Progress through the current phase
+    std::size_t width     = 0; //< Length of the sorted runs being merged
+    std::size_t left      = 0; //< Next key to take from the first of the two runs being merged
+    std::size_t right     = 0; //< Next key to take from the second
+    bool in_order         = true;
+
+    std::vector<std::pair<std::uint64_t, std::size_t>> plan; //< (key, row) pairs, sorted into the order rows should take
+    std::vector<std::pair<std::uint64_t, std::size_t>> merged; //< Where the current merge pass writes to
+    std::vector<std::size_t> where; //< Where each planned row is now
+    std::vector<std::size_t> who;   //< Which planned row each row holds now
+
+    std::size_t pass_count = 0;
+    std::size_t moved      = 0;
+
+    static inline bool out_of_time(time_t deadline) { return clock_t::now() >= deadline; }
+
+    void restart()
+    {
+        at       = phase::keys;
+        cursor   = 0;
+        in_order = true;
+        plan.clear();
+        merged.clear();
+    }
+
+    /**
+     * @brief Carry on with @p arch until it is done, returning true, or the
+     * deadline passes, returning false
+     */
+    bool step_table(Archetype &arch, time_t deadline)
+    {
+        if (at != phase::keys || cursor != 0)
+        {
+            if (arch.version != version)
+            {
+                restart();
+            }
+        }
+        version = arch.version;
+
+        auto n = arch.size();
+        while (true)
+        {
+            switch (at)
+            {
+            case phase::keys:
+                if (!key || n < 2)
+                {
+                    at = phase::compact;
+                    break;
+                }
+                // Buffers grow as they are filled, so first touching their
+                // pages is spread over the steps as well
+                plan.reserve(n);
+                while (cursor < n)
+                {
+                    plan.emplace_back(key(arch.entities[cursor]), cursor);
+                    in_order = in_order && (cursor == 0 || plan[cursor - 1].first <= plan[cursor].first);
+                    if (++cursor % check_interval == 0 && out_of_time(deadline))
+                    {
+                        return false;
+                    }
+                }
+                cursor = 0;
+                at     = in_order ? phase::compact : phase::sort;
+                break;
+
+            case phase::sort:
+                while (cursor < n)
+                {
+                    auto end = std::min(n, cursor + run_length);
+                    std::sort(plan.begin() + cursor, plan.begin() + end);
+                    cursor = end;
+                    if (out_of_time(deadline))
+                    {
+                        return false;
+                    }
+                }
+                merged.reserve(n);
+                cursor = 0;
+                width  = run_length;
+                left   = 0;
+                right  = std::min(n, width);
+                at     = phase::merge;
+                break;
+
+            case phase::merge:
+                // Bottom-up merge sort, alternating between two buffers so
+                // that it can stop after any key
+                while (width < n)
+                {
+                    while (cursor < n)
+                    {
+                        auto middle = std::min(n, cursor + width);
+                        auto end    = std::min(n, cursor + 2 * width);
+                        merged.resize(std::max(merged.size(), end));
+                        while (left < middle || right < end)
+                        {
+                            auto out    = left + right - middle;
+                            auto first  = right == end || (left < middle && !(plan[right] < plan[left]));
+                            merged[out] = first ? plan[left++] : plan[right++];
+                            if ((out + 1) % check_interval == 0 && out_of_time(deadline))
+                            {
+                                return false;
+                            }
+                        }
+                        cursor = end;
+                        left   = end;
+                        right  = std::min(n, end + width);
+                    }
+                    plan.swap(merged);
+                    width *= 2;
+                    cursor = 0;
+                    left   = 0;
+                    right  = std::min(n, width);
+                }
+                where.clear();
+                who.clear();
+                where.reserve(n);
+                who.reserve(n);
+                cursor = 0;
+                at     = phase::index;
+                break;
+
+            case phase::index:
+                while (cursor < n)
+                {
+                    where.push_back(cursor);
+                    who.push_back(cursor);
+                    if (++cursor % (16 * check_interval) == 0 && out_of_time(deadline))
+                    {
+                        return false;
+                    }
+                }
+                cursor = 0;
+                at     = phase::apply;
+                break;
+
+            case phase::apply:
+                while (cursor < n)
+                {
+                    auto planned = plan[cursor].second;
+                    auto row     = where[planned];
+                    if (row != cursor)
+                    {
+                        components.swap_rows(arch, cursor, row);
+                        auto displaced   = who[cursor];
+                        who[cursor]      = planned;
+                        who[row]         = displaced;
+                        where[planned]   = cursor;
+                        where[displaced] = row;
+                        ++moved;
+                    }
+                    if (++cursor % check_interval == 0 && out_of_time(deadline))
+                    {
+                        return false;
+                    }
+                }
+                at = phase::compact;
+                break;
+
+            case phase::compact:
+                arch.compact();
+                restart();
+                return true;
+            }
+        }
+    }
+};
+
+//
+// Commands
+//
+
+namespace detail
+{
+template <typename T> struct command_component
+{
+    using type = T;
+};
+template <typename T> struct command_component<handle<T>>
+{
+    using type = T;
+};
+template <typename T> using command_component_t = typename command_component<std::decay_t<T>>::type;
+} // namespace detail
+
+/**
+ * @brief Told about each command a CommandQueue applies, as it applies it,
+ * for instance to write it to a replay log
+ */
+class CommandLog
+{
+  public:
+    enum class op : std::uint8_t
+    {
+        spawn,
+        despawn,
+        enable,
+        disable,
+        add,
+        remove,
+    };
+
+    virtual ~CommandLog() = default;
+
+    /**
+     * @brief A command just did @p what to @p entities, with components of
+     * @p types
+     * @param entities The entities the command changed, or for a spawn the
+     * ones it created. Entities it was recorded for that had already been
+     * despawned, or that it otherwise left as they were, are left out, and a
+     * command that changed nothing is not reported at all.
+     */
+    virtual void applied(op what, span<const component_type_t> types, span<const entity_t> entities) = 0;
+};
+
+/**
+ * @brief A structural change recorded for later
+ */
+struct Command
+{
+    virtual ~Command() = default;
+
+    /**
+     * @brief Make the change to @p components, and tell @p log about it if
+     * there is one
+     */
+    virtual void apply(ComponentManager &components, CommandLog *log) = 0;
+};
+
+/**
+ * @brief Records structural changes (spawning and despawning entities, adding
+ * and removing components) to be applied later, when no system is iterating
+ * @details Consecutive commands of the same kind are merged as they are
+ * recorded, so a run of spawns with the same components is applied as one
+ * batch with a single archetype lookup.
+ */
+class CommandBuffer
+{
+  public:
+    /**
+     * @brief Spawn an entity with the given components, each either a plain
+     * component value or a handle to a ComponentBase-derived one
+     */
+    template <typename... Cs> void spawn(Cs &&...components)
+    {
+        tail<SpawnCommand<detail::command_component_t<Cs>...>>().rows.emplace_back(std::forward<Cs>(components)...);
+    }
+
+    void despawn(entity_t entity) { tail<DespawnCommand>().entities.push_back(entity); }
+
+    void set_enabled(entity_t entity, bool enabled) { tail<EnableCommand>().entities.emplace_back(entity, enabled); }
+
+    /**
+     * @brief Add a component, either a plain component value or a handle to a
+     * ComponentBase-derived one, replacing any the entity already has
+     */
+    template <typename C> void add(entity_t entity, C &&component)
+    {
+        tail<AddCommand<detail::command_component_t<C>>>().rows.emplace_back(entity, std::forward<C>(component));
+    }
+
+    template <typename T> void remove(entity_t entity) { tail<RemoveCommand<T>>().entities.push_back(entity); }
+
+    inline bool empty() const { return segments.empty(); }
+
+  private:
+    friend class CommandQueue;
+
+    template <typename... Ts> struct SpawnCommand : public Command
+    {
+        std::vector<std::tuple<typename Column<Ts>::value_type...>> rows;
+        void apply(ComponentManager &components, CommandLog *log) override
+        {
+            auto spawned = components.spawn_rows<Ts...>(std::move(rows));
+            if (log)
+            {
+                std::array<component_type_t, sizeof...(Ts)> types{component_type_id<Ts>()...};
+                std::vector<entity_t> entities(spawned.begin(), spawned.end());
+                log->applied(CommandLog::op::spawn, {types.data(), types.size()}, {entities.data(), entities.size()});
+            }
+        }
+    };
+
+    struct DespawnCommand : public Command
+    {
+        std::vector<entity_t> entities;
+        void apply(ComponentManager &components, CommandLog *log) override
+        {
+            if (!log)
+            {
+                components.destroy_entities(entities);
+                return;
+            }
+            std::vector<entity_t> alive;
+            alive.reserve(entities.size());
+            for (auto entity : entities)
+            {
+                if (components.is_alive(entity))
+                {
+                    alive.push_back(entity);
+                }
+            }
+            components.destroy_entities(alive);
+            report(log, CommandLog::op::despawn, {}, alive);
+        }
+    };
+
+    struct EnableCommand : public Command
+    {
+        std::vector<std::pair<entity_t, bool>> entities;
+        void apply(ComponentManager &components, CommandLog *log) override
+        {
+            for (auto &[entity, enabled] : entities)
+            {
+                if (components.set_enabled(entity, enabled) && log)
+                {
+                    log->applied(enabled ? CommandLog::op::enable : CommandLog::op::disable, {}, {&entity, 1});
+                }
+            }
+        }
+    };
+
+    template <typename T> struct AddCommand : public Command
+    {
+        std::vector<std::pair<entity_t, typename Column<T>::value_type>> rows;
+        void apply(ComponentManager &components, CommandLog *log) override
+        {
+            std::vector<entity_t> added;
+            if (log)
+            {
+                added.reserve(rows.size());
+            }
+            for (auto &[entity, component] : rows)
+            {
+                if (!components.is_alive(entity))
+                {
+                    continue;
+                }
+                if constexpr (is_plain_component_v<T>)
+                {
+                    components.emplace<T>(entity, component);
+                }
+                else
+                {
+                    components.add<T>(entity, std::move(component));
+                }
+                if (log)
+                {
+                    added.push_back(entity);
+                }
+            }
+            component_type_t type = component_type_id<T>();
+            report(log, CommandLog::op::add, {&type, 1}, added);
+        }
+    };
+
+    template <typename T> struct RemoveCommand : public Command
+    {
+        std::vector<entity_t> entities;
+        void apply(ComponentManager &components, CommandLog *log) override
+        {
+            std::vector<entity_t> removed;
+            for (auto entity : entities)
+            {
+                if (components.remove<T>(entity) && log)
+                {
+                    removed.push_back(entity);
+                }
+            }
+            component_type_t type = component_type_id<T>();
+            report(log, CommandLog::op::remove, {&type, 1}, removed);
+        }
+    };
+
+    /**
+     * @brief Tell @p log, if there is one, that a command did @p what to
+     * @p entities, unless it did nothing
+     */
+    static void report(CommandLog *log, CommandLog::op what, span<const component_type_t> types,
+        const std::vector<entity_t> &entities)
+    {
+        if (log && !entities.empty())
+        {
+            log->applied(what, types, {entities.data(), entities.size()});
+        }
+    }
+
+    /**
+     * @brief The commands recorded under one command context
+     */
+    struct segment
+    {
+        detail::command_context context;
+        std::vector<std::unique_ptr<Command>> commands;
+    };
+
+    std::vector<segment> segments;
+
+    /**
+     * @brief The command to record into: the last one if it is a @p C recorded
+     * under the current context, otherwise a new one
+     */
+    template <typename C> C &tail()
+    {
+        const auto &context = detail::current_command_context();
+        if (segments.empty() || segments.back().context.sequence != context.sequence
+            || segments.back().context.chunk != context.chunk)
+        {
+            segments.push_back(segment{context, {}});
+        }
+        auto &commands = segments.back().commands;
+        if (commands.empty() || typeid(*commands.back()) != typeid(C))
+        {
+            commands.push_back(std::make_unique<C>());
+        }
+        return static_cast<C &>(*commands.back());
+    }
+};
+
+/**
+ * @brief One CommandBuffer per thread of a SystemManager, all applied to one
+ * ComponentManager
+ * @details Systems record into local() without any locking. playback() applies
+ * everything recorded, ordered by the system and parallel chunk that recorded
+ * it rather than by thread, so the result is the same however the work was
+ * scheduled.
+ */
+class CommandQueue
+{
+    ComponentManager &components;
+    const ThreadPool &pool;
+    std::vector<CommandBuffer> buffers; //< Slot 0 for threads outside the pool, then one per worker
+    CommandLog *log = nullptr;
+
+  public:
+    CommandQueue(ComponentManager &components, const ThreadPool &pool)
+        : components{components}, pool{pool}, buffers(pool.size() + 1)
+    {
+    }
+    CommandQueue(const CommandQueue &)            = delete;
+    CommandQueue(CommandQueue &&)                 = delete;
+    CommandQueue &operator=(const CommandQueue &) = delete;
+    CommandQueue &operator=(CommandQueue &&)      = delete;
+
+    inline ComponentManager &target() const { return components; }
+
+    /**
+     * @brief Tell @p to about every command playback() applies from now on,
+     * in the order it applies them; nullptr stops
+     * @details @p to must outlive this queue or be replaced first.
+     */
+    inline void set_log(CommandLog *to) { log = to; }
+
+    /**
+     * @brief The calling thread's command buffer
+     */
+    CommandBuffer &local()
+    {
+        auto worker = pool.current_worker();
+        return buffers[worker == ThreadPool::npos ? 0 : worker + 1];
+    }
+
+    /**
+     * @brief Apply and clear every recorded command, in the order of the
+     * systems and chunks that recorded them
+     */
+    void playback()
+    {
+        std::vector<CommandBuffer::segment *> ordered;
+        for (auto &buffer : buffers)
+        {
+            for (auto &seg : buffer.segments)
+            {
+                ordered.push_back(&seg);
+            }
+        }
+        if (ordered.empty())
+        {
+            return;
+        }
+        std::stable_sort(ordered.begin(), ordered.end(), [](const auto *a, const auto *b) {
+            return std::tie(a->context.sequence, a->context.chunk) < std::tie(b->context.sequence, b->context.chunk);
+        });
+        for (auto *seg : ordered)
+        {
+            for (auto &command : seg->commands)
+            {
+                command->apply(components, log);
+            }
+        }
+        for (auto &buffer : buffers)
+        {
+            buffer.segments.clear();
+        }
+    }
+};
+
+//
+// Events
+//
+
+namespace detail
+{
+/**
+ * @brief The part of an EventChannel the SystemManager drives, whatever its
+ * event type
+ */
+struct event_channel_base
+{
+    virtual ~event_channel_base() = default;
+
+    virtual void publish()      = 0;
+    virtual void begin_update() = 0;
+};
+} // namespace detail
+
+template <typename E> class EventReader;
+
+/**
+ * @brief A typed stream of one-off events, sent by some systems and read by
+ * others in later stages
+ * @details Each thread sends into its own outbox, so sending takes no lock and
+ * touches nothing another thread touches. At the end of each stage everything
+ * sent is published in the order of the systems and chunks that sent it, as
+ * deferred commands are, so readers see the same events in the same order
+ * however the work was spread across threads.
+ *
+ * Published events stay readable until the end of the next update. A reader
+ * in a later stage than the sender hears about them in the same update, and
+ * one in an earlier stage in the next. Every buffer is cleared rather than
+ * freed, so once the channel has seen its busiest update it stops allocating.
+ */
+template <typename E> class EventChannel : public detail::event_channel_base
+{
+  public:
+    using event_id_t = std::uint64_t; //< Position in every event ever published on the channel
+
+    explicit EventChannel(const ThreadPool &pool) : pool{pool}, outboxes(pool.size() + 1) {}
+    EventChannel(const EventChannel &)            = delete;
+    EventChannel(EventChannel &&)                 = delete;
+    EventChannel &operator=(const EventChannel &) = delete;
+    EventChannel &operator=(EventChannel &&)      = delete;
+
+    inline void send(const E &event) { emplace(event); }
+    inline void send(E &&event) { emplace(std::move(event)); }
+
+    /**
+     * @brief Send an event constructed in place from @p args
+     */
+    template <typename... Args> void emplace(Args &&...args)
+    {
+        auto &box           = local();
+        const auto &context = detail::current_command_context();
+        if (box.runs.empty() || box.runs.back().context.sequence != context.sequence
+            || box.runs.back().context.chunk != context.chunk)
+        {
+            box.runs.push_back(run{context, box.events.size()});
+        }
+        box.events.emplace_back(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief A reader starting from the oldest event still readable
+     */
+    inline EventReader<E> reader() const { return EventReader<E>(*this); }
+
+    /**
+     * @brief Events published and still readable
+     */
+    inline std::size_t size() const { return previous.size() + current.size(); }
+
+    /**
+     * @brief Make everything sent so far readable, in the order of the systems
+     * and chunks that sent it
+     */
+    void publish() override
+    {
+        order.clear();
+        for (std::size_t slot = 0; slot < outboxes.size(); ++slot)
+        {
+            const auto &box = outboxes[slot];
+            for (std::size_t i = 0; i < box.runs.size(); ++i)
+            {
+                auto end = i + 1 < box.runs.size() ? box.runs[i + 1].begin : box.events.size();
+                order.push_back(pending_run{box.runs[i].context, slot, box.runs[i].begin, end});
+            }
+        }
+        if (order.empty())
+        {
+            return;
+        }
+
+        // A total order, so there is no need for stable_sort and its scratch
+        // buffer
+        std::sort(order.begin(), order.end(), [](const pending_run &a, const pending_run &b) {
+            return std::tie(a.context.sequence, a.context.chunk, a.slot, a.begin)
+                 < std::tie(b.context.sequence, b.context.chunk, b.slot, b.begin);
+        });
+        for (const auto &pending : order)
+        {
+            auto &events = outboxes[pending.slot].events;
+            current.insert(current.end(), std::make_move_iterator(events.begin() + pending.begin),
+                std::make_move_iterator(events.begin() + pending.end));
+        }
+        for (auto &box : outboxes)
+        {
+            box.events.clear();
+            box.runs.clear();
+        }
+    }
+
+    /**
+     * @brief Forget the events published before the last update
+     */
+    void begin_update() override
+    {
+        previous.swap(current);
+        current.clear();
+        previous_first = current_first;
+        current_first  = previous_first + previous.size();
+    }
+
+  private:
+    friend class EventReader<E>;
+
+    /**
+     * @brief Where the events one system or chunk sent start in an outbox
+     */
+    struct run
+    {
+        detail::command_context context;
+        std::size_t begin;
+    };
+
+    /**
+     * @brief One thread's unpublished events, on its own cache lines
+     */
+    struct alignas(64) outbox
+    {
+        std::vector<E> events;
+        std::vector<run> runs;
+    };
+
+    struct pending_run
+    {
+        detail::command_context context;
+        std::size_t slot;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    const ThreadPool &pool;
+    std::vector<outbox> outboxes;   //< Slot 0 for threads outside the pool, then one per worker
+    std::vector<pending_run> order; //< Reused by every publish()
+    std::vector<E> previous;        //< Published during the last update
+    std::vector<E> current;         //< Published during this update
+    event_id_t previous_first = 0;  //< ID of the first of previous
+    event_id_t current_first  = 0;  //< ID of the first of current
+
+    outbox &local()
+    {
+        auto worker = pool.current_worker();
+        return outboxes[worker == ThreadPool::npos ? 0 : worker + 1];
+    }
+};
+
+/**
+ * @brief One reader's place in an EventChannel
+ * @details Each read() hands over every event published since the previous
+ * one, in at most two contiguous batches. A reader that skips a whole update
+ * loses the events that stopped being readable in the meantime; missed()
+ * counts them.
+ */
+template <typename E> class EventReader
+{
+  public:
+    using event_id_t = typename EventChannel<E>::event_id_t;
+
+    explicit EventReader(const EventChannel<E> &channel) : channel{&channel}, next{channel.previous_first} {}
+
+    /**
+     * @brief Call @p fn as `fn(span<const E>)` on each batch of unread events
+     * @return How many events were read
+     */
+    template <typename F> std::size_t read(F &&fn)
+    {
+        if (next < channel->previous_first)
+        {
+            dropped += channel->previous_first - next;
+            next = channel->previous_first;
+        }
+        std::size_t count = 0;
+        auto deliver      = [&](const std::vector<E> &events, event_id_t first) {
+            auto end = first + events.size();
+            if (next >= end)
+            {
+                return;
+            }
+            auto offset = static_cast<std::size_t>(next - first);
+            fn(span<const E>{events.data() + offset, events.size() - offset});
+            count += events.size() - offset;
+            next = end;
+        };
+        deliver(channel->previous, channel->previous_first);
+        deliver(channel->current, channel->current_first);
+        return count;
+    }
+
+    /**
+     * @brief Events that stopped being readable before this reader got to them
+     */
+    inline std::uint64_t missed() const { return dropped; }
+
+  private:
+    const EventChannel<E> *channel;
+    event_id_t next;
+    std::uint64_t dropped = 0;
+};
+
+/**
+ * @brief A system that reads one event channel
+ * @details @p F is called as `update(span<const E>)` on each batch of events
+ * published since the system last ran. Add a dependency on the systems that
+ * send them to hear about their events in the same update.
+ */
+template <typename E, typename F> struct EventSystem : public SystemBase
+{
+    EventReader<E> reader;
+    F update_f;
+
+    EventSystem(const EventChannel<E> &channel, F update) : reader{channel}, update_f{std::move(update)} {}
+
+  protected:
+    bool needs_entities() const override { return false; }
+
+    component_set_t update_impl(const std::vector<entity_t> &) override
+    {
+        counts.matched   = reader.read(update_f);
+        counts.processed = counts.matched;
+        return {};
+    }
+};
+
+//
+// Query systems
+//
+
+/**
+ * @brief A system that runs a statically typed query over a ComponentManager
+ * @details This is the fast path for systems: matching entities are found by
+ * archetype rather than by per-entity predicates, and @p F is stored and
+ * called directly rather than through a @c std::function. The entity list
+ * passed to update() is ignored. @c Read terms are declared as reads and
+ * @c Write terms as writes. @c Prev terms are not declared at all, since last
+ * tick's values stay put until the SystemManager's update is over, so a system
+ * reading them can share a stage with one writing the current values.
+ *
+ * Each run takes a new change tick from the ComponentManager, so a
+ * @c Changed<T> term matches exactly the rows whose @p T changed since this
+ * system's previous run.
+ *
+ * With @p Batched set, @p F is called once per archetype (or once per parallel
+ * chunk) with spans over the columns, as in Query::run_batch().
+ */
+template <typename QueryT, typename F, bool Batched = false> struct QuerySystem;
+
+template <typename... Terms, typename F, bool Batched> struct QuerySystem<Query<Terms...>, F, Batched> : public SystemBase
+{
+    using query_t = Query<Terms...>;
+
+    ComponentManager &components;
+    F update_f;
+    tick_t last_run_tick = 0; //< Change tick of this system's previous run
+
+    QuerySystem(ComponentManager &components, F update) : components{components}, update_f{std::move(update)}
+    {
+        (declare_access<Terms>(), ...);
+    }
+
+  protected:
+    bool needs_entities() const override { return false; }
+
+    component_set_t update_impl(const std::vector<entity_t> &) override
+    {
+        // The tick this run's lookups are stamped with, when there is one
+        auto tick = detail::current_lookup_context().tick_for(&components);
+        query_ticks ticks{tick != 0 ? tick : components.advance_change_tick(), last_run_tick};
+        last_run_tick = ticks.this_run;
+        if (!parallel || !pool || pool->size() == 0)
+        {
+            for (const auto &arch : components.get_archetypes())
+            {
+                if (arch->size() != 0 && query_t::matches(*arch))
+                {
+                    counts += query_t::template run_rows<Batched>(*arch, 0, arch->size(), update_f, ticks);
+                }
+            }
+            return {};
+        }
+
+        // Cut every matching archetype into cache-sized row ranges, then run
+        // them all as one parallel-for
+        struct chunk_t
+        {
+            Archetype *arch;
+            std::size_t begin;
+            std::size_t end;
+        };
+        std::vector<chunk_t> chunks;
+        auto rows_per_chunk = effective_chunk_size((0 + ... + Column<std::remove_cv_t<typename Terms::component_type>>::row_bytes));
+        for (const auto &arch : components.get_archetypes())
+        {
+            if (arch->size() == 0 || !query_t::matches(*arch))
+            {
+                continue;
+            }
+            for (std::size_t begin = 0; begin < arch->size(); begin += rows_per_chunk)
+            {
+                chunks.push_back(chunk_t{arch.get(), begin, std::min(arch->size(), begin + rows_per_chunk)});
+            }
+        }
+        std::vector<update_counts> chunk_counts(chunks.size());
+        auto sequence      = detail::current_command_context().sequence;
+        auto *lookup_ticks = detail::current_lookup_context().ticks;
+        pool->parallel_for(chunks.size(), 1, [&](std::size_t begin, std::size_t, std::size_t) {
+            detail::scoped_command_context context{sequence, begin + 1};
+            detail::scoped_lookup_ticks lookups{lookup_ticks};
+            chunk_counts[begin] = query_t::template run_rows<Batched>(
+                *chunks[begin].arch, chunks[begin].begin, chunks[begin].end, update_f, ticks);
+        });
+        for (const auto &chunk : chunk_counts)
+        {
+            counts += chunk;
+        }
+        return {};
+    }
+
+  private:
+    template <typename Term> void declare_access()
+    {
+        using component_t = typename Term::component_type;
+        if constexpr (std::is_same_v<Term, Read<component_t>> || std::is_same_v<Term, Changed<component_t>>)
+        {
+            declare_reads<component_t>();
+        }
+        else if constexpr (std::is_same_v<Term, Write<component_t>>)
+        {
+            declare_writes<component_t>();
+        }
+    }
+};
+
+struct SystemManager
+{
+    struct SystemDependencyNode
+    {
+        system_t id;
+        std::vector<system_t> dependencies;
+    };
+    struct ExecutionStage
+    {
+        std::vector<system_t> systems;
+    };
+    using ExecutionGraph = std::vector<ExecutionStage>;
+
+    /**
+     * @brief One system's run within a profiled update
+     */
+    struct SystemProfile
+    {
+        system_t system    = NO_SYSTEM;
+        std::size_t stage  = 0;
+        std::size_t worker = ThreadPool::npos; //< The pool worker it ran on, or npos for the thread calling update()
+        time_t start;
+        time_t end;
+        update_counts counts;
+    };
+
+    /**
+     * @brief One execution stage within a profiled update, from dispatching its
+     * systems to the end of its command playback
+     */
+    struct StageProfile
+    {
+        std::size_t stage = 0;
+        time_t start;
+        time_t end;
+    };
+
+    /**
+     * @brief Everything recorded during one profiled update
+     */
+    struct TickProfile
+    {
+        frameidx_t tick = 0; //< Counts profiled updates, starting at 1
+        time_t start;
+        time_t end;
+        std::vector<StageProfile> stages;
+        std::vector<SystemProfile> systems; //< Grouped by stage, in stage order
+    };
+
+    std::unordered_map<system_t, SystemDependencyNode> system_nodes;
+    std::unordered_map<system_t, handle<SystemBase>> systems;
+
+    /**
+     * @brief Create a system manager
+     * @param worker_count The number of worker threads used to run the systems
+     * of each execution stage concurrently. With zero workers every system runs
+     * on the thread calling update().
+     */
+    explicit SystemManager(std::size_t worker_count = 0) : pool{std::make_unique<ThreadPool>(worker_count)} {}
+    SystemManager(const SystemManager &)            = delete;
+    SystemManager(SystemManager &&)                 = delete;
+    SystemManager &operator=(const SystemManager &) = delete;
+    SystemManager &operator=(SystemManager &&)      = delete;
+
+    inline std::size_t worker_count() const { return pool->size(); }
+
+    system_t register_new(handle<SystemBase> system)
+    {
+        auto system_id     = next_system_id++;
+        if (system)
+        {
+            system->pool = pool.get();
+        }
+        systems[system_id] = system;
+        invalidate_execution_graph();
+        return system_id;
+    }
+
+    template<typename... Cs>
+    system_t new_system(std::string name,
+        system_state start_state,
+        typename GenericSystem<Cs...>::can_update_t can_update,
+        typename GenericSystem<Cs...>::component_retriever_t get_components,
+        typename GenericSystem<Cs...>::update_function_t update_components)
+    {
+        auto system = std::make_shared<GenericSystem<Cs...>>(can_update, get_components, update_components);
+        system->name = name;
+        system->state = start_state;
+        return register_new(system);
+    }
+
+    /**
+     * @brief Have every update cover @p components: rows of it that systems
+     * look up for writing are stamped with one change tick per system run, and
+     * its double-buffered columns are swapped at the end
+     * @details Query and batch systems and commands() track their manager
+     * already. Track any other manager systems write through, such as one only
+     * a new_system() reaches, before the first update. @p components must
+     * outlive this manager.
+     */
+    void track(ComponentManager &components)
+    {
+        if (std::find(tracked_components.begin(), tracked_components.end(), &components) == tracked_components.end())
+        {
+            tracked_components.push_back(&components);
+        }
+    }
+
+    /**
+     * @brief The per-thread command buffers for deferred structural changes to
+     * @p components, created on first use
+     * @details Systems record into `commands(components).local()` while they
+     * run. Everything recorded is applied once every system of the stage has
+     * finished, before the next stage starts.
+     */
+    CommandQueue &commands(ComponentManager &components)
+    {
+        track(components);
+        for (auto &queue : command_queues)
+        {
+            if (&queue->target() == &components)
+            {
+                return *queue;
+            }
+        }
+        command_queues.push_back(std::make_unique<CommandQueue>(components, *pool));
+        return *command_queues.back();
+    }
+
+    /**
+     * @brief Apply every deferred command recorded so far
+     */
+    void playback_commands()
+    {
+        for (auto &queue : command_queues)
+        {
+            queue->playback();
+        }
+    }
+
+    /**
+     * @brief The channel for events of type @p E, created on first use
+     * @details Systems send with `events<E>().send(event)` from any thread,
+     * without locking. What they send is published when their stage ends, for
+     * systems in later stages to read through an EventReader or
+     * new_event_system(). Get channels while setting up, not from inside
+     * running systems.
+     */
+    template <typename E> EventChannel<E> &events()
+    {
+        auto &channel = event_channels[component_type_id<E>()];
+        if (!channel)
+        {
+            channel = std::make_unique<EventChannel<E>>(*pool);
+        }
+        return static_cast<EventChannel<E> &>(*channel);
+    }
+
+    /**
+     * @brief Register a system that reads the events of type @p E
+     * @details @p update is called as `update(span<const E>)` on each batch of
+     * events published since the system last ran; see EventSystem.
+     */
+    template <typename E, typename F> system_t new_event_system(std::string name, system_state start_state, F update)
+    {
+        auto system   = std::make_shared<EventSystem<E, F>>(events<E>(), std::move(update));
+        system->name  = name;
+        system->state = start_state;
+        return register_new(system);
+    }
+
+    /**
+     * @brief Register a system that runs `Query<Terms...>` over @p components
+     * @details @p update is called as `update(entity, const A &, B &, ...)` for
+     * every matching entity; see QuerySystem. @p components must outlive this
+     * manager.
+     */
+    template <typename... Terms, typename F>
+    system_t new_query_system(std::string name, system_state start_state, ComponentManager &components, F update)
+    {
+        track(components);
+        auto system   = std::make_shared<QuerySystem<Query<Terms...>, F>>(components, std::move(update));
+        system->name  = name;
+        system->state = start_state;
+        return register_new(system);
+    }
+
+    /**
+     * @brief Register a system that runs `Query<Terms...>` over @p components a
+     * batch at a time
+     * @details @p update is called as `update(span<const entity_t>, span<const
+     * A>, span<B>, ...)` once per matching archetype, or once per chunk in
+     * parallel mode; see Query::run_batch().
+     */
+    template <typename... Terms, typename F>
+    system_t new_batch_system(std::string name, system_state start_state, ComponentManager &components, F update)
+    {
+        track(components);
+        auto system   = std::make_shared<QuerySystem<Query<Terms...>, F, true>>(components, std::move(update));
+        system->name  = name;
+        system->state = start_state;
+        return register_new(system);
+    }
+
+    /**
+     * @brief Require @p dependency to finish before @p system starts each update
+     */
+    void add_dependency(system_t system, system_t dependency)
+    {
+        if (system_nodes.find(system) == system_nodes.end())
+        {
+            system_nodes[system] = SystemDependencyNode{system, {}};
+        }
+        system_nodes[system].dependencies.push_back(dependency);
+        invalidate_execution_graph();
+    }
+
+    /**
+     * @brief Let a registered system split its entities across the worker pool
+     * @param chunk_size Entities per chunk, or 0 to size chunks to the cache
+     */
+    void set_parallel(system_t system, bool parallel, std::size_t chunk_size = 0)
+    {
+        auto it = systems.find(system);
+        if (it != systems.end() && it->second)
+        {
+            it->second->parallel   = parallel;
+            it->second->chunk_size = chunk_size;
+        }
+    }
+
+    /**
+     * @brief Run a registered system only on every @p period-th update,
+     * offset by @p phase updates
+     * @details Spreading systems with the same period over different phases
+     * keeps them from all landing on the same update.
+     */
+    void set_rate(system_t system, std::size_t period, std::size_t phase = 0)
+    {
+        auto it = systems.find(system);
+        if (it != systems.end() && it->second)
+        {
+            it->second->period = std::max<std::size_t>(1, period);
+            it->second->phase  = phase;
+        }
+    }
+
+    /**
+     * @brief Set a registered system's priority; below zero, it may be deferred
+     * when an update runs over the time budget
+     */
+    void set_priority(system_t system, int priority)
+    {
+        auto it = systems.find(system);
+        if (it != systems.end() && it->second)
+        {
+            it->second->priority = priority;
+        }
+    }
+
+    /**
+     * @brief Limit the wall time of each update, or pass zero for no limit
+     * @details Once an update has used up its budget, any system with a
+     * negative priority in the remaining stages is deferred instead of run,
+     * and runs on the next update that has time for it. Everything else always
+     * runs, so this sheds optional work but never stalls the simulation. The
+     * budget is only checked before each stage, so a stage already under way
+     * always finishes.
+     */
+    inline void set_time_budget(duration_t budget) { time_budget = budget; }
+
+    inline duration_t get_time_budget() const { return time_budget; }
+
+    /**
+     * @brief Make each update depend only on the world and what was done to it
+     * between updates, never on the clock
+     * @details The time budget is ignored, so no system is ever deferred.
+     * Everything else is already in a fixed order: stages by dependency and
+     * registration, parallel chunks by row, and deferred commands and events
+     * by the system and chunk that recorded them.
+     */
+    inline void set_deterministic(bool on) { deterministic = on; }
+
+    inline bool is_deterministic() const { return deterministic; }
+
+    /**
+     * @brief Set the seed systems pass to stable_random()
+     */
+    inline void set_seed(std::uint64_t s) { seed = s; }
+
+    inline std::uint64_t get_seed() const { return seed; }
+
+    /**
+     * @brief How many times update() has been called
+     */
+    inline frameidx_t frame() const { return frames; }
+
+    /**
+     * @brief Carry on counting updates from @p f, for a run resumed part way
+     * through, so it draws the same stable_random() numbers and runs the same
+     * systems each update as the original would have
+     */
+    inline void set_frame(frameidx_t f) { frames = f; }
+
+    /**
+     * @brief The systems the most recent update deferred for the time budget
+     */
+    inline const std::vector<system_t> &last_deferred() const { return deferred_systems; }
+
+    /**
+     * @brief Whether any enabled system works from the entity list update() is
+     * given, rather than finding its own entities
+     * @details If none does, update() can be passed an empty list.
+     */
+    bool needs_entities() const
+    {
+        for (const auto &[id, system] : systems)
+        {
+            if (system && system->is_enabled() && system->needs_entities())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Declare additional component types read by a registered system
+     */
+    template <typename... Ts> void declare_reads(system_t system)
+    {
+        auto it = systems.find(system);
+        if (it != systems.end() && it->second)
+        {
+            it->second->declare_reads<Ts...>();
+            invalidate_execution_graph();
+        }
+    }
+
+    /**
+     * @brief Declare additional component types written by a registered system
+     */
+    template <typename... Ts> void declare_writes(system_t system)
+    {
+        auto it = systems.find(system);
+        if (it != systems.end() && it->second)
+        {
+            it->second->declare_writes<Ts...>();
+            invalidate_execution_graph();
+        }
+    }
+
+    /**
+     * @brief Turn recording of per-system and per-stage timings on or off
+     * @details While disabled, update() does not read the clock at all. The
+     * entity counts are always kept by each system; see
+     * SystemBase::last_counts().
+     * @param history How many of the most recent updates to keep
+     */
+    void set_profiling(bool enabled, std::size_t history = 64)
+    {
+        profiling       = enabled;
+        profile_history = std::max<std::size_t>(1, history);
+        while (profiles.size() > profile_history)
+        {
+            profiles.pop_front();
+        }
+    }
+
+    inline bool profiling_enabled() const { return profiling; }
+
+    /**
+     * @brief The recorded updates, oldest first
+     */
+    inline const std::deque<TickProfile> &get_profiles() const { return profiles; }
+
+    inline void clear_profiles() { profiles.clear(); }
+
+    /**
+     * @brief Write the recorded updates as Chrome @c trace_event JSON, for
+     * chrome://tracing or Perfetto
+     * @details Each thread gets its own track, with one slice per system run
+     * carrying its stage and entity counts. A separate track shows the updates
+     * and their stages, so a straggler is the slice that ends last in its stage.
+     */
+    void write_chrome_trace(std::ostream &os) const
+    {
+        if (profiles.empty())
+        {
+            os << "{\"traceEvents\": []}\n";
+            return;
+        }
+        auto origin = profiles.front().start;
+        auto micros = [origin](time_t t) {
+            return std::chrono::duration<double, std::micro>(t - origin).count();
+        };
+        // Track 0 is the updates and stages, 1 is the caller of update(), and
+        // worker i is 2 + i
+        auto track = [](std::size_t worker) { return worker == ThreadPool::npos ? 1 : worker + 2; };
+
+        std::stringstream ss;
+        ss.precision(3);
+        ss << std::fixed << "{\"traceEvents\": [\n";
+        ss << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"Stages\"}},\n";
+        ss << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"Caller\"}}";
+        for (std::size_t worker = 0; worker < pool->size(); ++worker)
+        {
+            ss << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << track(worker)
+               << ", \"args\": {\"name\": \"Worker " << worker << "\"}}";
+        }
+        auto slice = [&](const std::string &name, const char *category, std::size_t tid, time_t start, time_t end) {
+            ss << ",\n  {\"name\": " << json_string(name) << ", \"cat\": \"" << category << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+               << tid << ", \"ts\": " << micros(start) << ", \"dur\": " << micros(end) - micros(start);
+        };
+        for (const auto &tick : profiles)
+        {
+            slice("Update " + std::to_string(tick.tick), "update", 0, tick.start, tick.end);
+            ss << "}";
+            for (const auto &stage : tick.stages)
+            {
+                slice("Stage " + std::to_string(stage.stage), "stage", 0, stage.start, stage.end);
+                ss << "}";
+            }
+            for (const auto &run : tick.systems)
+            {
+                slice(describe_system(run.system), "system", track(run.worker), run.start, run.end);
+                ss << ", \"args\": {\"update\": " << tick.tick << ", \"stage\": " << run.stage
+                   << ", \"matched\": " << run.counts.matched << ", \"processed\": " << run.counts.processed
+                   << ", \"changed\": " << run.counts.changed << "}}";
+            }
+        }
+        ss << "\n]}\n";
+        os << ss.str();
+    }
+
+    /**
+     * @brief Force the execution graph to be rebuilt on the next update
+     * @details Registering systems, adding dependencies and declaring access
+     * through this manager do this automatically. Call it after modifying
+     * @c systems, @c system_nodes or a registered system's access directly.
+     */
+    inline void invalidate_execution_graph() { graph_dirty = true; }
+
+    /**
+     * @brief The cached execution graph, rebuilt only if systems or dependencies
+     * changed since it was last built
+     */
+    const ExecutionGraph &execution_graph()
+    {
+        if (graph_dirty)
+        {
+            cached_graph = build_execution_graph();
+            graph_dirty  = false;
+        }
+        return cached_graph;
+    }
+
+    /**
+     * @brief Compute the stages that systems run in
+     * @details Systems are ordered by their explicit dependencies first, and by
+     * registration order where those leave a choice. Any two systems whose
+     * declared component access conflicts are then also ordered, earlier before
+     * later, so no stage ever contains a conflicting pair. Each system is placed
+     * in the earliest stage after everything it must follow.
+     *
+     * @throws std::logic_error if the explicit dependencies contain a cycle
+     */
+    ExecutionGraph build_execution_graph() const
+    {
+        // Every system we know about, in registration order
+        std::vector<system_t> ids;
+        ids.reserve(systems.size());
+        for (const auto &[id, system] : systems)
+        {
+            ids.push_back(id);
+        }
+        for (const auto &[id, node] : system_nodes)
+        {
+            ids.push_back(id);
+            ids.insert(ids.end(), node.dependencies.begin(), node.dependencies.end());
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+        auto index_of = [&ids](system_t id) {
+            return static_cast<std::size_t>(std::lower_bound(ids.begin(), ids.end(), id) - ids.begin());
+        };
+
+        // Explicit dependency edges
+        auto count = ids.size();
+        std::vector<std::vector<std::size_t>> predecessors(count);
+        std::vector<std::vector<std::size_t>> successors(count);
+        std::vector<std::size_t> in_degree(count, 0);
+        for (const auto &[id, node] : system_nodes)
+        {
+            auto to = index_of(id);
+            for (auto dep : node.dependencies)
+            {
+                auto from = index_of(dep);
+                predecessors[to].push_back(from);
+                successors[from].push_back(to);
+                in_degree[to]++;
+            }
+        }
+
+        // Topological order, preferring earlier registered systems
+        std::priority_queue<std::size_t, std::vector<std::size_t>, std::greater<std::size_t>> ready;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (in_degree[i] == 0)
+            {
+                ready.push(i);
+            }
+        }
+        std::vector<std::size_t> order;
+        order.reserve(count);
+        while (!ready.empty())
+        {
+            auto i = ready.top();
+            ready.pop();
+            order.push_back(i);
+            for (auto next : successors[i])
+            {
+                if (--in_degree[next] == 0)
+                {
+                    ready.push(next);
+                }
+            }
+        }
+        if (order.size() != count)
+        {
+            // Every system left over has a dependency that was left over too,
+            // so walking back along those comes round to a system already
+            // walked through. That loop is a cycle, without the systems that
+            // were only left over because they follow it.
+            auto left_over = [&in_degree](std::size_t i) { return in_degree[i] != 0; };
+            std::vector<std::size_t> walked_at(count, count);
+            std::vector<std::size_t> walk;
+            auto at = static_cast<std::size_t>(std::find_if(in_degree.begin(), in_degree.end(),
+                                                   [](std::size_t degree) { return degree != 0; })
+                                               - in_degree.begin());
+            while (walked_at[at] == count)
+            {
+                walked_at[at] = walk.size();
+                walk.push_back(at);
+                at = *std::find_if(predecessors[at].begin(), predecessors[at].end(), left_over);
+            }
+
+            // The walk went against the dependencies, so list it backwards to
+            // show each system before the ones that depend on it
+            std::stringstream ss;
+            ss << "Cycle in system dependencies:";
+            for (auto k = walk.size(); k-- > walked_at[at];)
+            {
+                ss << " " << describe_system(ids[walk[k]]) << " ->";
+            }
+            ss << " " << describe_system(ids[walk.back()]);
+            throw std::logic_error(ss.str());
+        }
+
+        // Order conflicting systems by their position in the topological order,
+        // which can never introduce a cycle
+        std::vector<const SystemBase *> by_order(count, nullptr);
+        for (std::size_t k = 0; k < count; ++k)
+        {
+            auto it = systems.find(ids[order[k]]);
+            if (it != systems.end())
+            {
+                by_order[k] = it->second.get();
+            }
+        }
+        for (std::size_t a = 0; a < count; ++a)
+        {
+            for (std::size_t b = a + 1; by_order[a] && b < count; ++b)
+            {
+                if (by_order[b] && by_order[a]->conflicts_with(*by_order[b]))
+                {
+                    predecessors[order[b]].push_back(order[a]);
+                }
+            }
+        }
+
+        // Each system goes one stage after the latest thing it must follow
+        std::vector<std::size_t> stage_of(count, 0);
+        ExecutionGraph graph;
+        for (auto i : order)
+        {
+            for (auto pred : predecessors[i])
+            {
+                stage_of[i] = std::max(stage_of[i], stage_of[pred] + 1);
+            }
+            if (graph.size() <= stage_of[i])
+            {
+                graph.resize(stage_of[i] + 1);
+            }
+            graph[stage_of[i]].systems.push_back(ids[i]);
+        }
+        for (auto &stage : graph)
+        {
+            std::sort(stage.systems.begin(), stage.systems.end());
+        }
+
+        return graph;
+    }
+
+    /**
+     * @brief Run every enabled system that is due, a stage at a time
+     * @details Deferred commands are played back and events published after
+     * each stage. At the end, every double-buffered column of the tracked
+     * ComponentManagers (see track()) has the rows written during the update
+     * copied into last tick's values.
+     */
+    void update(const std::vector<entity_t> &entities)
+    {
+        const auto &stages = execution_graph();
+        std::vector<SystemBase *> runnable;
+        std::vector<system_t> runnable_ids;
+        std::size_t sequence = 0;
+
+        auto frame_index = frames++;
+        auto budgeted    = !deterministic && time_budget != duration_t::zero();
+        auto started     = budgeted ? clock_t::now() : time_t{};
+        deferred_systems.clear();
+
+        TickProfile *tick = nullptr;
+        if (profiling)
+        {
+            if (profiles.size() >= profile_history)
+            {
+                profiles.pop_front();
+            }
+            tick        = &profiles.emplace_back();
+            tick->tick  = ++profiled_ticks;
+            tick->start = clock_t::now();
+        }
+
+        for (auto &[type, channel] : event_channels)
+        {
+            channel->begin_update();
+        }
+
+        for (std::size_t stage_index = 0; stage_index < stages.size(); ++stage_index)
+        {
+            const auto &stage = stages[stage_index];
+            runnable.clear();
+            runnable_ids.clear();
+            bool over_budget = budgeted && clock_t::now() - started > time_budget;
+            for (const auto &system_id : stage.systems)
+            {
+                auto it = systems.find(system_id);
+                if (it == systems.end())
+                {
+                    continue;
+                }
+
+                auto &system = it->second;
+                if (!system || !system->is_enabled() || !system->is_due(frame_index))
+                {
+                    continue;
+                }
+                if (over_budget && system->priority < 0)
+                {
+                    system->deferred = true;
+                    deferred_systems.push_back(system_id);
+                    continue;
+                }
+                system->deferred = false;
+
+                runnable.push_back(system.get());
+                runnable_ids.push_back(system_id);
+            }
+
+            // Every run gets its own slot up front, so concurrent systems never
+            // touch the same profile
+            SystemProfile *profile = nullptr;
+            StageProfile stage_profile;
+            if (tick)
+            {
+                stage_profile = StageProfile{stage_index, clock_t::now(), {}};
+                auto first    = tick->systems.size();
+                for (auto id : runnable_ids)
+                {
+                    tick->systems.push_back(SystemProfile{id, stage_index, ThreadPool::npos, {}, {}, {}});
+                }
+                profile = tick->systems.data() + first;
+            }
+
+            if (runnable.size() == 1 || pool->size() == 0)
+            {
+                for (std::size_t i = 0; i < runnable.size(); ++i)
+                {
+                    detail::scoped_command_context context{++sequence, 0};
+                    run_system(*runnable[i], entities, profile ? profile + i : nullptr);
+                }
+            }
+            else
+            {
+                // Dispatch the whole stage at once; the wait is the barrier
+                // before the next stage may start
+                ThreadPool::TaskGroup stage_group;
+                for (std::size_t i = 0; i < runnable.size(); ++i)
+                {
+                    pool->submit(stage_group,
+                        [this, system = runnable[i], &entities, seq = ++sequence, slot = profile ? profile + i : nullptr] {
+                            detail::scoped_command_context context{seq, 0};
+                            run_system(*system, entities, slot);
+                        });
+                }
+                pool->wait(stage_group);
+            }
+
+            // Nothing is iterating between stages, so structural changes are safe
+            playback_commands();
+            for (auto &[type, channel] : event_channels)
+            {
+                channel->publish();
+            }
+
+            if (tick)
+            {
+                stage_profile.end = clock_t::now();
+                tick->stages.push_back(stage_profile);
+            }
+        }
+
+        // This tick's values become last tick's, now that nothing is reading them
+        for (auto *components : tracked_components)
+        {
+            components->swap_buffers();
+        }
+
+        if (tick)
+        {
+            tick->end = clock_t::now();
+        }
+    }
+
+  private:
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<std::unique_ptr<CommandQueue>> command_queues;
+    std::vector<ComponentManager *> tracked_components; //< Every manager the updates cover; see track()
+    std::unordered_map<component_type_t, std::unique_ptr<detail::event_channel_base>> event_channels;
+    system_t next_system_id = NO_SYSTEM + 1;
+    ExecutionGraph cached_graph;
+    bool graph_dirty = true;
+
+    frameidx_t frames      = 0;
+    duration_t time_budget = duration_t::zero();
+    std::vector<system_t> deferred_systems;
+    bool deterministic = false;
+    std::uint64_t seed = 0;
+
+    bool profiling              = false;
+    std::size_t profile_history = 64;
+    frameidx_t profiled_ticks   = 0;
+    std::deque<TickProfile> profiles;
+
+    /**
+     * @brief Update @p system, timing it into @p profile if that is set
+     */
+    void run_system(SystemBase &system, const std::vector<entity_t> &entities, SystemProfile *profile)
+    {
+        // One change tick per tracked manager for whatever the system looks up
+        std::vector<detail::run_tick> ticks;
+        ticks.reserve(tracked_components.size());
+        for (auto *components : tracked_components)
+        {
+            ticks.push_back(detail::run_tick{components, components->advance_change_tick()});
+        }
+        detail::scoped_lookup_ticks lookups{&ticks};
+
+        if (!profile)
+        {
+            system.update(entities);
+            return;
+        }
+        profile->worker = pool->current_worker();
+        profile->start  = clock_t::now();
+        system.update(entities);
+        profile->end    = clock_t::now();
+        profile->counts = system.last_counts();
+    }
+
+    static std::string json_string(const std::string &s)
+    {
+        std::string out = "\"";
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                // Control characters may not appear raw in a JSON string
+                static constexpr char hex[] = "0123456789abcdef";
+                out += "\\u00";
+                out += hex[static_cast<unsigned char>(c) >> 4];
+                out += hex[c & 0xf];
+            }
+            else
+            {
+                out += c;
+            }
+        }
+        return out + "\"";
+    }
+
+    std::string describe_system(system_t id) const
+    {
+        std::stringstream ss;
+        auto it = systems.find(id);
+        if (it != systems.end() && it->second && !it->second->name.empty())
+        {
+            ss << "'" << it->second->name << "' (" << id << ")";
+        }
+        else
+        {
+            ss << id;
+        }
+        return ss.str();
+    }
+};
+
+//
+// Scheduling
+//
+
+/**
+ * @brief Runs a SystemManager in fixed steps that keep pace with real time
+ * @details Real time is added to an accumulator, and one update runs for each
+ * whole @c step in it. Catching up after a slow update is capped at
+ * @c max_catch_up updates per call. If the simulation is further behind than
+ * that, the extra time is dropped and counted in dropped_steps(). Dropping it
+ * means the simulation runs slower than real time while it is overloaded,
+ * instead of falling further and further behind.
+ *
+ * Per-system rates, priorities and the per-update time budget are set on the
+ * SystemManager itself; see SystemManager::set_rate() and
+ * SystemManager::set_time_budget(). The budget is checked as each stage
+ * starts, not between the systems of a stage, which run side by side. A
+ * stage that starts within budget runs all of its systems, so an update can
+ * overrun the budget by as much as its longest stage takes.
+ */
+class FixedStepScheduler
+{
+  public:
+    FixedStepScheduler(SystemManager &systems, ComponentManager &components, duration_t step,
+        std::size_t max_catch_up = 4)
+        : systems{systems}, components{components}, step{step}, max_catch_up{std::max<std::size_t>(1, max_catch_up)}
+    {
+        if (step <= duration_t::zero())
+        {
+            throw std::invalid_argument("A fixed step must be longer than zero");
+        }
+    }
+    FixedStepScheduler(const FixedStepScheduler &)            = delete;
+    FixedStepScheduler(FixedStepScheduler &&)                 = delete;
+    FixedStepScheduler &operator=(const FixedStepScheduler &) = delete;
+    FixedStepScheduler &operator=(FixedStepScheduler &&)      = delete;
+
+    /**
+     * @brief Account for @p elapsed real time and run every update that is now
+     * due, up to the catch-up cap
+     * @return The number of updates run
+     */
+    std::size_t advance(duration_t elapsed)
+    {
+        accumulator += elapsed;
+        std::size_t ran = 0;
+        while (accumulator >= step && ran < max_catch_up)
+        {
+            // Only systems working from a given list need every entity listed,
+            // and the list is refilled in place, since the step before may have
+            // spawned or destroyed some
+            if (systems.needs_entities())
+            {
+                components.get_all_entities(entities);
+            }
+            else
+            {
+                entities.clear();
+            }
+            systems.update(entities);
+            if (after_update)
+            {
+                after_update();
+            }
+            accumulator -= step;
+            ++ran;
+        }
+        if (accumulator >= step)
+        {
+            auto behind = accumulator / step;
+            dropped += static_cast<std::size_t>(behind);
+            accumulator -= behind * step;
+        }
+        completed += ran;
+        return ran;
+    }
+
+    /**
+     * @brief Advance by the real time since the last call (or since the first
+     * call started the clock)
+     */
+    std::size_t poll()
+    {
+        auto now = clock_t::now();
+        if (!started)
+        {
+            started   = true;
+            last_poll = now;
+        }
+        auto elapsed = now - last_poll;
+        last_poll    = now;
+        return advance(elapsed);
+    }
+
+    /**
+     * @brief Keep polling for @p wall of real time, sleeping between updates
+     */
+    void run_for(duration_t wall)
+    {
+        poll();
+        auto end = last_poll + wall;
+        while (clock_t::now() < end)
+        {
+            std::this_thread::sleep_until(std::min<time_t>(end, last_poll + (step - accumulator)));
+            poll();
+        }
+    }
+
+    /**
+     * @brief How far into the next step real time is, from 0 to 1, for
+     * interpolating what is drawn between updates
+     */
+    inline double alpha() const { return std::chrono::duration<double>(accumulator) / step; }
+
+    /**
+     * @brief Call @p fn after every update, such as to record the tick
+     */
+    inline void set_after_update(std::function<void()> fn) { after_update = std::move(fn); }
+
+    inline duration_t get_step() const { return step; }
+    inline std::size_t steps() const { return completed; }
+    inline std::size_t dropped_steps() const { return dropped; }
+
+  private:
+    SystemManager &systems;
+    ComponentManager &components;
+    duration_t step;
+    std::size_t max_catch_up;
+
+    duration_t accumulator = duration_t::zero();
+    time_t last_poll;
+    bool started          = false;
+    std::size_t completed = 0; //< Updates run so far
+    std::size_t dropped   = 0; //< Whole steps of real time skipped because the catch-up cap was hit
+    std::function<void()> after_update;
+    std::vector<entity_t> entities; //< Handed to every update, kept to reuse its storage
+};
+
+/**
+ * @brief One self-contained world: its own components and its own systems,
+ * updated on whichever thread runs it
+ * @details The SystemManager has no workers of its own, so a WorldRunner can
+ * run many of these side by side without oversubscribing the machine.
+ */
+struct World
+{
+    handle<ComponentManager> components = std::make_shared<ComponentManager>();
+    handle<SystemManager> systems       = std::make_shared<SystemManager>();
+
+    void run(std::size_t ticks)
+    {
+        for (std::size_t i = 0; i < ticks; ++i)
+        {
+            systems->update(components->get_all_entities());
+        }
+    }
+};
+
+/**
+ * @brief Owns many independent worlds and runs them across one fixed set of
+ * worker threads
+ * @details @p W is any type with a `run(std::size_t ticks)` member, such as
+ * World. Each world is run by one thread at a time and shares no storage with
+ * the others, so worlds never wait on each other. Worlds are handed out to
+ * workers one at a time, so uneven worlds still keep every worker busy. The
+ * calling thread helps run them.
+ */
+template <typename W = World> class WorldRunner
+{
+  public:
+    /**
+     * @param pin Pin each worker to its own core; see ThreadPool
+     */
+    explicit WorldRunner(std::size_t worker_count = std::thread::hardware_concurrency(), bool pin = false)
+        : pool{worker_count, pin}
+    {
+    }
+    WorldRunner(const WorldRunner &)            = delete;
+    WorldRunner(WorldRunner &&)                 = delete;
+    WorldRunner &operator=(const WorldRunner &) = delete;
+    WorldRunner &operator=(WorldRunner &&)      = delete;
+
+    /**
+     * @return The new world's index
+     */
+    std::size_t add(handle<W> world)
+    {
+        worlds.push_back(std::move(world));
+        return worlds.size() - 1;
+    }
+
+    template <typename... Args> W &emplace(Args &&...args)
+    {
+        return *worlds[add(std::make_shared<W>(std::forward<Args>(args)...))];
+    }
+
+    inline std::size_t size() const { return worlds.size(); }
+    inline W &world(std::size_t index) { return *worlds[index]; }
+    inline const ThreadPool &workers() const { return pool; }
+
+    /**
+     * @brief Run @p ticks ticks of every world, returning once all are done
+     * @details If a world throws, the first exception is rethrown here once the
+     * other worlds have finished.
+     */
+    void run(std::size_t ticks)
+    {
+        pool.parallel_for(worlds.size(), 1, [&](std::size_t index, std::size_t, std::size_t) { worlds[index]->run(ticks); });
+    }
+
+    /**
+     * @brief Call `fn(world)` on every world in parallel and collect what it
+     * returns, in world order
+     * @details The result type must be default constructible.
+     */
+    template <typename F> std::vector<std::invoke_result_t<F &, W &>> gather(F &&fn)
+    {
+        static_assert(!std::is_same_v<std::invoke_result_t<F &, W &>, bool>,
+            "std::vector<bool> cannot be written from several threads; return something other than bool");
+        std::vector<std::invoke_result_t<F &, W &>> results(worlds.size());
+        pool.parallel_for(worlds.size(), 1, [&](std::size_t index, std::size_t, std::size_t) {
+            results[index] = fn(*worlds[index]);
+        });
+        return results;
+    }
+
+  private:
+    ThreadPool pool;
+    std::vector<handle<W>> worlds;
 };
 } // namespace jnickg::sim_ecs
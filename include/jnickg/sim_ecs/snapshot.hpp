@@ -0,0 +1,807 @@
+#pragma once
+
+#include "sim_ecs.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SIM_ECS_SNAPSHOT_MMAP 1
+#else
+#define SIM_ECS_SNAPSHOT_MMAP 0
+#endif
+
+namespace jnickg::sim_ecs
+{
+//
+// Snapshots
+//
+// A snapshot is one ComponentManager, written in the writer's native byte
+// order (checked on restore) as:
+//
+//   header      magic, format version, byte order mark, change tick and
+//               snapshot_flags
+//   registry    the generation and liveness of every entity slot, and the
+//               free list, so restored entity IDs are exactly the saved ones
+//   types       name, plain flag and size of each component type stored
+//   archetypes  for each non-empty archetype: its types, its entity IDs, then
+//               for each column its change ticks (unless the flags say they
+//               were left out) followed by either the raw
+//               bytes of its components (plain components, nothing for tags)
+//               or each component written by its serializer (everything else)
+//   relations   every owner's children in order, as (child, owner) pairs
+//   disabled    every disabled entity
+//
+// Every array starts on a 16-byte boundary, so restoring a plain column is a
+// single copy straight out of the mapped file.
+//
+
+constexpr inline char snapshot_magic[8]         = {'S', 'I', 'M', 'E', 'C', 'S', 'S', 'N'};
+constexpr inline std::uint32_t snapshot_version = 1;
+constexpr inline std::uint32_t snapshot_bom     = 0x01020304;
+
+/**
+ * @brief What a snapshot holds beyond the world itself, as bits of the flags
+ * word in its header
+ */
+enum snapshot_flags : std::uint32_t
+{
+    snapshot_change_ticks = 1u << 0, //< Every column's change ticks are stored
+};
+
+/**
+ * @brief Streams a snapshot to an output stream, keeping track of the offset
+ * so arrays can be aligned
+ */
+class SnapshotWriter
+{
+    std::ostream &os;
+    std::uint64_t offset = 0;
+
+  public:
+    explicit SnapshotWriter(std::ostream &os) : os{os} {}
+
+    void write_bytes(const void *data, std::size_t size)
+    {
+        os.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+        offset += size;
+    }
+
+    template <typename T> void write(const T &value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be written directly");
+        write_bytes(&value, sizeof(T));
+    }
+
+    void write_string(const std::string &s)
+    {
+        write<std::uint64_t>(s.size());
+        write_bytes(s.data(), s.size());
+    }
+
+    void align(std::size_t alignment)
+    {
+        static const char zeros[64] = {};
+        write_bytes(zeros, (alignment - offset % alignment) % alignment);
+    }
+};
+
+/**
+ * @brief Reads a snapshot out of a block of memory, throwing
+ * @c std::runtime_error rather than reading past its end
+ */
+class SnapshotReader
+{
+    const std::byte *data;
+    std::size_t size;
+    std::size_t offset = 0;
+
+  public:
+    SnapshotReader(const void *data, std::size_t size) : data{static_cast<const std::byte *>(data)}, size{size} {}
+
+    const std::byte *read_bytes(std::size_t count)
+    {
+        if (count > size - offset)
+        {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        auto *at = data + offset;
+        offset += count;
+        return at;
+    }
+
+    /**
+     * @brief Read @p count elements of @p element_size bytes each
+     * @details Checks @p count against the bytes left before multiplying, so a
+     * corrupt count cannot overflow past the check.
+     */
+    const std::byte *read_array(std::size_t count, std::size_t element_size)
+    {
+        if (element_size != 0 && count > (size - offset) / element_size)
+        {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        return read_bytes(count * element_size);
+    }
+
+    /**
+     * @brief Read how many elements follow, each taking at least
+     * @p min_element_size bytes
+     * @details Throws if that many cannot fit in the bytes left, so the count
+     * is safe to size a container with before reading the elements.
+     */
+    std::uint64_t read_count(std::size_t min_element_size)
+    {
+        auto count = read<std::uint64_t>();
+        if (count > (size - offset) / min_element_size)
+        {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        return count;
+    }
+
+    template <typename T> T read()
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be read directly");
+        T value;
+        std::memcpy(&value, read_bytes(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string read_string()
+    {
+        auto length = read<std::uint64_t>();
+        return std::string(reinterpret_cast<const char *>(read_bytes(length)), length);
+    }
+
+    void align(std::size_t alignment) { read_bytes((alignment - offset % alignment) % alignment); }
+
+    inline bool at_end() const { return offset == size; }
+};
+
+/**
+ * @brief The component types a snapshot may hold, each under a name that stays
+ * the same from one run to the next
+ * @details Component type IDs are handed out in order of first use, so they
+ * can differ between the process that writes a snapshot and the one that reads
+ * it; the names tie them together. Plain components are saved as raw bytes.
+ * Everything else needs a writer and a reader. WorldTimeComponent and
+ * TimedEntityComponent are always included.
+ */
+class SnapshotSchema
+{
+  public:
+    template <typename T> using write_fn_t = std::function<void(SnapshotWriter &, const T &)>;
+    template <typename T> using read_fn_t  = std::function<handle<T>(SnapshotReader &)>;
+
+    struct entry
+    {
+        std::string name;
+        component_type_t type = 0;
+        bool plain            = false;
+        std::size_t size      = 0;
+        std::function<std::unique_ptr<ColumnBase>()> make_column;
+        std::function<void(const ColumnBase &, SnapshotWriter &)> write_column;
+        std::function<void(ColumnBase &, SnapshotReader &, std::size_t)> read_column;
+    };
+
+    SnapshotSchema()
+    {
+        add<WorldTimeComponent>(
+            "sim_ecs::WorldTimeComponent",
+            [](SnapshotWriter &w, const WorldTimeComponent &c) {
+                w.write<std::uint8_t>(c.running);
+                w.write(c.total_time);
+                w.write(c.delta_time);
+                w.write(c.step);
+                w.write(c.time_scale);
+            },
+            [](SnapshotReader &r) {
+                auto c        = std::make_shared<WorldTimeComponent>();
+                c->running    = r.read<std::uint8_t>() != 0;
+                c->total_time = r.read<double>();
+                c->delta_time = r.read<double>();
+                c->step       = r.read<double>();
+                c->time_scale = r.read<double>();
+                return c;
+            });
+        add<TimedEntityComponent>(
+            "sim_ecs::TimedEntityComponent",
+            [](SnapshotWriter &w, const TimedEntityComponent &c) {
+                w.write(c.owner);
+                w.write<std::uint8_t>(c.running);
+                w.write(c.time_scale);
+            },
+            [](SnapshotReader &r) {
+                auto c        = std::make_shared<TimedEntityComponent>(r.read<entity_t>());
+                c->running    = r.read<std::uint8_t>() != 0;
+                c->time_scale = r.read<double>();
+                return c;
+            });
+    }
+
+    /**
+     * @brief Include the plain component @p T, saved as raw bytes
+     */
+    template <typename T> SnapshotSchema &add(std::string name)
+    {
+        static_assert(is_plain_component_v<T>, "Components stored behind handles need a writer and a reader");
+        entry e{std::move(name), component_type_id<T>(), true, sizeof(T), {}, {}, {}};
+        e.make_column  = [] { return std::make_unique<Column<T>>(); };
+        e.write_column = [](const ColumnBase &col, SnapshotWriter &w) {
+            if constexpr (!is_tag_component_v<T>)
+            {
+                const auto &data = static_cast<const Column<T> &>(col).data;
+                w.write_bytes(data.data(), data.size() * sizeof(T));
+            }
+        };
+        e.read_column = [](ColumnBase &col, SnapshotReader &r, std::size_t rows) {
+            auto &data = static_cast<Column<T> &>(col).data;
+            if constexpr (!is_tag_component_v<T>)
+            {
+                const auto *bytes = r.read_array(rows, sizeof(T));
+                data.resize(rows);
+                std::memcpy(static_cast<void *>(data.data()), bytes, rows * sizeof(T));
+            }
+            else
+            {
+                data.resize(rows);
+            }
+            if constexpr (is_double_buffered_v<T>)
+            {
+                // Only the current values are saved, so they are last tick's too
+                static_cast<Column<T> &>(col).prev = data;
+            }
+        };
+        return insert(std::move(e));
+    }
+
+    /**
+     * @brief Include the ComponentBase-derived component @p T, saved and
+     * restored one component at a time by @p write and @p read
+     */
+    template <typename T> SnapshotSchema &add(std::string name, write_fn_t<T> write, read_fn_t<T> read)
+    {
+        static_assert(!is_plain_component_v<T>, "Plain components are saved as raw bytes and take no serializer");
+        entry e{std::move(name), component_type_id<T>(), false, 0, {}, {}, {}};
+        e.make_column  = [] { return std::make_unique<Column<T>>(); };
+        e.write_column = [write](const ColumnBase &col, SnapshotWriter &w) {
+            for (const auto &component : static_cast<const Column<T> &>(col).data)
+            {
+                w.write<std::uint8_t>(component != nullptr);
+                if (component)
+                {
+                    write(w, *component);
+                }
+            }
+        };
+        e.read_column = [read](ColumnBase &col, SnapshotReader &r, std::size_t rows) {
+            auto &data = static_cast<Column<T> &>(col).data;
+            data.reserve(rows);
+            for (std::size_t row = 0; row < rows; ++row)
+            {
+                data.push_back(r.read<std::uint8_t>() ? read(r) : nullptr);
+            }
+        };
+        return insert(std::move(e));
+    }
+
+    inline const entry *find(component_type_t type) const
+    {
+        auto it = by_type.find(type);
+        return it == by_type.end() ? nullptr : &entries[it->second];
+    }
+
+    inline const entry *find(const std::string &name) const
+    {
+        auto it = by_name.find(name);
+        return it == by_name.end() ? nullptr : &entries[it->second];
+    }
+
+  private:
+    std::vector<entry> entries;
+    std::unordered_map<component_type_t, std::size_t> by_type;
+    std::unordered_map<std::string, std::size_t> by_name;
+
+    SnapshotSchema &insert(entry e)
+    {
+        if (by_name.count(e.name) != 0 || by_type.count(e.type) != 0)
+        {
+            throw std::logic_error("Component type or snapshot name '" + e.name + "' is already in the schema");
+        }
+        by_type[e.type] = entries.size();
+        by_name[e.name] = entries.size();
+        entries.push_back(std::move(e));
+        return *this;
+    }
+};
+
+/**
+ * @brief A read-only view of a whole file, memory-mapped where the platform
+ * supports it and read into memory otherwise
+ */
+class MappedFile
+{
+  public:
+    explicit MappedFile(const std::string &path)
+    {
+#if SIM_ECS_SNAPSHOT_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Cannot open snapshot '" + path + "'");
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Cannot read the size of snapshot '" + path + "'");
+        }
+        length = static_cast<std::size_t>(st.st_size);
+        if (length != 0)
+        {
+            void *mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED)
+            {
+                ::close(fd);
+                throw std::runtime_error("Cannot map snapshot '" + path + "'");
+            }
+            ::madvise(mapped, length, MADV_SEQUENTIAL);
+            bytes = mapped;
+        }
+        ::close(fd);
+#else
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in)
+        {
+            throw std::runtime_error("Cannot open snapshot '" + path + "'");
+        }
+        buffer.resize(static_cast<std::size_t>(in.tellg()));
+        in.seekg(0);
+        in.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        bytes  = buffer.data();
+        length = buffer.size();
+#endif
+    }
+    MappedFile(const MappedFile &)            = delete;
+    MappedFile(MappedFile &&)                 = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile &operator=(MappedFile &&)      = delete;
+
+    ~MappedFile()
+    {
+#if SIM_ECS_SNAPSHOT_MMAP
+        if (bytes)
+        {
+            ::munmap(const_cast<void *>(bytes), length);
+        }
+#endif
+    }
+
+    inline const void *data() const { return bytes; }
+    inline std::size_t size() const { return length; }
+
+  private:
+    const void *bytes  = nullptr;
+    std::size_t length = 0;
+#if !SIM_ECS_SNAPSHOT_MMAP
+    std::vector<std::byte> buffer;
+#endif
+};
+
+namespace detail
+{
+struct snapshot_access
+{
+    static constexpr std::size_t array_alignment = 16;
+
+    /**
+     * @brief Write @p components to @p os; without @p change_ticks, the change
+     * tick in the header is zero and the columns' ticks are left out, which
+     * leaves only what the world holds and not when it was last written
+     * @details The flags in the header say which, so read() takes either.
+     */
+    static void write(
+        const ComponentManager &components, const SnapshotSchema &schema, std::ostream &os, bool change_ticks = true)
+    {
+        // Every type that has to be saved, numbered in the order first seen
+        std::vector<const SnapshotSchema::entry *> types;
+        std::unordered_map<component_type_t, std::uint32_t> type_index;
+        for (const auto &arch : components.archetypes)
+        {
+            if (arch->size() == 0)
+            {
+                continue;
+            }
+            for (auto type : arch->signature)
+            {
+                if (type_index.count(type) != 0)
+                {
+                    continue;
+                }
+                auto *found = schema.find(type);
+                if (!found)
+                {
+                    throw std::logic_error("Component type " + std::to_string(type) +
+                                           " is stored in the world but has no name in the SnapshotSchema");
+                }
+                type_index[type] = static_cast<std::uint32_t>(types.size());
+                types.push_back(found);
+            }
+        }
+
+        SnapshotWriter w(os);
+        w.write_bytes(snapshot_magic, sizeof(snapshot_magic));
+        w.write(snapshot_version);
+        w.write(snapshot_bom);
+        w.write<tick_t>(change_ticks ? components.change_tick.load() : 0);
+        w.write<std::uint32_t>(change_ticks ? std::uint32_t{snapshot_change_ticks} : 0u);
+
+        const auto &registry = components.registry;
+        std::uint64_t slots  = registry.generations.size();
+        w.write(slots);
+        w.align(array_alignment);
+        w.write_bytes(registry.generations.data(), slots * sizeof(std::uint32_t));
+        std::vector<std::uint8_t> alive(registry.alive.begin(), registry.alive.end());
+        w.write_bytes(alive.data(), alive.size());
+        w.write<std::uint64_t>(registry.free_slots.size());
+        w.align(array_alignment);
+        w.write_bytes(registry.free_slots.data(), registry.free_slots.size() * sizeof(std::uint32_t));
+
+        w.write<std::uint64_t>(types.size());
+        for (const auto *type : types)
+        {
+            w.write_string(type->name);
+            w.write<std::uint8_t>(type->plain);
+            w.write<std::uint64_t>(type->size);
+        }
+
+        std::uint64_t archetype_count = std::count_if(components.archetypes.begin(), components.archetypes.end(),
+            [](const auto &arch) { return arch->size() != 0; });
+        w.write(archetype_count);
+        for (const auto &arch : components.archetypes)
+        {
+            if (arch->size() == 0)
+            {
+                continue;
+            }
+            w.write<std::uint64_t>(arch->signature.size());
+            for (auto type : arch->signature)
+            {
+                w.write(type_index[type]);
+            }
+            w.write<std::uint64_t>(arch->size());
+            w.align(array_alignment);
+            w.write_bytes(arch->entities.data(), arch->size() * sizeof(entity_t));
+            for (std::size_t c = 0; c < arch->columns.size(); ++c)
+            {
+                const auto &col = *arch->columns[c];
+                if (change_ticks)
+                {
+                    w.align(array_alignment);
+                    w.write_bytes(col.changed.data(), col.changed.size() * sizeof(tick_t));
+                }
+                w.align(array_alignment);
+                types[type_index[arch->signature[c]]]->write_column(col, w);
+            }
+        }
+
+        std::vector<entity_t> owned;
+        for (std::size_t index = 0; index < components.relations.size(); ++index)
+        {
+            if (components.relations[index].child_count == 0)
+            {
+                continue;
+            }
+            auto owner = components.records[index].entity;
+            for (auto child : components.children.at(static_cast<std::uint32_t>(index)))
+            {
+                owned.push_back(child);
+                owned.push_back(owner);
+            }
+        }
+        w.write<std::uint64_t>(owned.size() / 2);
+        w.align(array_alignment);
+        w.write_bytes(owned.data(), owned.size() * sizeof(entity_t));
+
+        std::vector<entity_t> disabled;
+        for (const auto &arch : components.archetypes)
+        {
+            if (arch->enabled.all())
+            {
+                continue;
+            }
+            for (std::size_t row = 0; row < arch->size(); ++row)
+            {
+                if (!arch->enabled.test(row))
+                {
+                    disabled.push_back(arch->entities[row]);
+                }
+            }
+        }
+        w.write<std::uint64_t>(disabled.size());
+        w.align(array_alignment);
+        w.write_bytes(disabled.data(), disabled.size() * sizeof(entity_t));
+
+        if (!os)
+        {
+            throw std::runtime_error("Failed to write snapshot");
+        }
+    }
+
+    /**
+     * @brief Restore a snapshot into @p target, which must never have had
+     * entities
+     * @details The world is built up in a manager of its own and only swapped
+     * into @p target once all of it has been read and checked, so a corrupt
+     * snapshot leaves @p target as it was.
+     */
+    static void read(ComponentManager &target, const SnapshotSchema &schema, const void *data, std::size_t size)
+    {
+        if (target.registry.size() != 0 || target.registry.capacity() > 1)
+        {
+            throw std::logic_error("Snapshots can only be restored into a ComponentManager that never had entities");
+        }
+        ComponentManager components;
+
+        SnapshotReader r(data, size);
+        if (std::memcmp(r.read_bytes(sizeof(snapshot_magic)), snapshot_magic, sizeof(snapshot_magic)) != 0)
+        {
+            throw std::runtime_error("Not a snapshot");
+        }
+        auto version = r.read<std::uint32_t>();
+        if (version != snapshot_version)
+        {
+            throw std::runtime_error("Snapshot format version " + std::to_string(version) + " is not supported");
+        }
+        if (r.read<std::uint32_t>() != snapshot_bom)
+        {
+            throw std::runtime_error("Snapshot was written with a different byte order");
+        }
+        auto tick  = r.read<tick_t>();
+        auto flags = r.read<std::uint32_t>();
+        if ((flags & ~std::uint32_t{snapshot_change_ticks}) != 0)
+        {
+            throw std::runtime_error("Snapshot has flags this build does not know");
+        }
+        components.change_tick.store(std::max(tick, target.change_tick.load()));
+        // Without stored ticks, everything counts as added just now
+        auto restored_at = components.change_tick.load();
+
+        auto &registry = components.registry;
+        auto slots     = r.read<std::uint64_t>();
+        r.align(array_alignment);
+        const auto *generations = r.read_array(slots, sizeof(std::uint32_t));
+        registry.generations.resize(slots);
+        std::memcpy(registry.generations.data(), generations, slots * sizeof(std::uint32_t));
+        const auto *alive = r.read_bytes(slots);
+        registry.alive.assign(slots, false);
+        registry.alive_count = 0;
+        for (std::size_t i = 0; i < slots; ++i)
+        {
+            registry.alive[i] = alive[i] != std::byte{0};
+            registry.alive_count += registry.alive[i] ? 1 : 0;
+        }
+        if (slots == 0 || registry.alive[0])
+        {
+            throw std::runtime_error("Snapshot is corrupt: slot 0 is missing or alive");
+        }
+        auto free_count = r.read<std::uint64_t>();
+        r.align(array_alignment);
+        const auto *free_slots = r.read_array(free_count, sizeof(std::uint32_t));
+        registry.free_slots.resize(free_count);
+        if (free_count != 0)
+        {
+            std::memcpy(registry.free_slots.data(), free_slots, free_count * sizeof(std::uint32_t));
+        }
+        // create() reuses these without looking, so each must be a real slot
+        // that is dead and listed once
+        std::vector<bool> listed(slots, false);
+        for (auto slot : registry.free_slots)
+        {
+            if (slot == 0 || slot >= slots || registry.alive[slot] || listed[slot])
+            {
+                throw std::runtime_error("Snapshot is corrupt: free slot " + std::to_string(slot)
+                                         + " is out of range, alive or listed twice");
+            }
+            listed[slot] = true;
+        }
+
+        // Each type is at least a name length, a plain flag and a size
+        std::vector<const SnapshotSchema::entry *> types(
+            r.read_count(sizeof(std::uint64_t) + sizeof(std::uint8_t) + sizeof(std::uint64_t)));
+        for (auto &type : types)
+        {
+            auto name  = r.read_string();
+            auto plain = r.read<std::uint8_t>() != 0;
+            auto bytes = r.read<std::uint64_t>();
+            type       = schema.find(name);
+            if (!type)
+            {
+                throw std::runtime_error("Snapshot holds component type '" + name + "', which is not in the schema");
+            }
+            if (type->plain != plain || type->size != bytes)
+            {
+                throw std::runtime_error("Component type '" + name + "' has changed layout since the snapshot was written");
+            }
+        }
+
+        components.records.assign(slots, ComponentManager::entity_record{});
+        std::unordered_set<std::size_t> tables; //< Archetypes already filled, each of which must appear once
+        auto archetype_count = r.read<std::uint64_t>();
+        for (std::uint64_t a = 0; a < archetype_count; ++a)
+        {
+            std::vector<const SnapshotSchema::entry *> saved_columns(r.read_count(sizeof(std::uint32_t)));
+            std::vector<bool> in_block(types.size(), false);
+            std::vector<component_type_t> signature;
+            for (auto &column : saved_columns)
+            {
+                auto index = r.read<std::uint32_t>();
+                if (index >= types.size() || in_block[index])
+                {
+                    throw std::runtime_error("Snapshot is corrupt: unknown or repeated component type index");
+                }
+                in_block[index] = true;
+                column          = types[index];
+                signature.push_back(column->type);
+            }
+            std::sort(signature.begin(), signature.end());
+            std::size_t idx = components.get_or_create_archetype(std::move(signature),
+                [&](component_type_t type) { return schema.find(type)->make_column(); });
+            if (!tables.insert(idx).second)
+            {
+                throw std::runtime_error("Snapshot is corrupt: two archetypes with the same component types");
+            }
+            auto &arch = *components.archetypes[idx];
+
+            auto rows = r.read<std::uint64_t>();
+            r.align(array_alignment);
+            // Read before growing anything, so a corrupt row count is caught
+            // by the bounds check rather than by the allocator
+            const auto *entities = r.read_array(rows, sizeof(entity_t));
+            arch.entities.resize(rows);
+            arch.enabled.push_back(rows, true);
+            std::memcpy(arch.entities.data(), entities, rows * sizeof(entity_t));
+            for (std::size_t row = 0; row < rows; ++row)
+            {
+                auto entity = arch.entities[row];
+                if (entity_index(entity) >= slots || !registry.is_alive(entity))
+                {
+                    throw std::runtime_error("Snapshot is corrupt: row for an entity that is not alive");
+                }
+                auto &record = components.records[entity_index(entity)];
+                if (record.entity != NO_ENTITY)
+                {
+                    throw std::runtime_error("Snapshot is corrupt: entity stored in two rows");
+                }
+                record = ComponentManager::entity_record{entity, idx, row};
+            }
+
+            for (const auto *column : saved_columns)
+            {
+                auto &col = *arch.columns[arch.column_index(column->type)];
+                if (flags & snapshot_change_ticks)
+                {
+                    r.align(array_alignment);
+                    const auto *changed = r.read_array(rows, sizeof(tick_t));
+                    col.changed.resize(rows);
+                    std::memcpy(col.changed.data(), changed, rows * sizeof(tick_t));
+                }
+                else
+                {
+                    col.changed.assign(rows, restored_at);
+                }
+#if SIM_ECS_COMPONENT_METADATA
+                auto now = clock_t::now();
+                col.metadata.assign(rows, component_metadata{now, now});
+#endif
+                r.align(array_alignment);
+                column->read_column(col, r, rows);
+            }
+        }
+
+        for (std::size_t i = 1; i < slots; ++i)
+        {
+            if (registry.alive[i] && components.records[i].entity == NO_ENTITY)
+            {
+                throw std::runtime_error("Snapshot is corrupt: slot " + std::to_string(i) + " is alive but has no row");
+            }
+        }
+
+        auto pairs = r.read<std::uint64_t>();
+        r.align(array_alignment);
+        const auto *owned = r.read_array(pairs, 2 * sizeof(entity_t));
+        for (std::uint64_t i = 0; i < pairs; ++i)
+        {
+            entity_t pair[2]; //< Child, then owner
+            std::memcpy(pair, owned + i * sizeof(pair), sizeof(pair));
+            if (!components.find_record(pair[0]) || !components.find_record(pair[1]))
+            {
+                throw std::runtime_error("Snapshot is corrupt: ownership of an entity that is not alive");
+            }
+            components.link(pair[0], pair[1]);
+        }
+
+        auto count = r.read<std::uint64_t>();
+        r.align(array_alignment);
+        const auto *disabled = r.read_array(count, sizeof(entity_t));
+        for (std::uint64_t i = 0; i < count; ++i)
+        {
+            entity_t entity;
+            std::memcpy(&entity, disabled + i * sizeof(entity_t), sizeof(entity_t));
+            if (!components.set_enabled(entity, false))
+            {
+                throw std::runtime_error("Snapshot is corrupt: disabled entity that is not alive");
+            }
+        }
+
+        std::swap(target.registry, components.registry);
+        target.archetypes.swap(components.archetypes);
+        target.archetype_index.swap(components.archetype_index);
+        target.records.swap(components.records);
+        target.relations.swap(components.relations);
+        target.children.swap(components.children);
+        target.change_tick.store(components.change_tick.load());
+    }
+};
+} // namespace detail
+
+/**
+ * @brief Write every entity and component of @p components to @p os
+ * @throws std::logic_error if a stored component type is not in @p schema
+ */
+inline void write_snapshot(const ComponentManager &components, const SnapshotSchema &schema, std::ostream &os)
+{
+    detail::snapshot_access::write(components, schema, os);
+}
+
+inline void write_snapshot(const ComponentManager &components, const SnapshotSchema &schema, const std::string &path)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        throw std::runtime_error("Cannot create snapshot '" + path + "'");
+    }
+    write_snapshot(components, schema, out);
+}
+
+/**
+ * @brief Restore a snapshot held in memory into @p components, which must
+ * never have had any entities
+ * @details Entities keep the IDs they were saved with. If the snapshot cannot
+ * be restored, @p components is left as it was, so it can still take another.
+ * @throws std::runtime_error if the snapshot is malformed or holds a type that
+ * is not in @p schema
+ */
+inline void read_snapshot(ComponentManager &components, const SnapshotSchema &schema, const void *data, std::size_t size)
+{
+    detail::snapshot_access::read(components, schema, data, size);
+}
+
+/**
+ * @brief Memory-map the snapshot file at @p path and restore it into
+ * @p components
+ */
+inline void read_snapshot(ComponentManager &components, const SnapshotSchema &schema, const std::string &path)
+{
+    MappedFile file(path);
+    read_snapshot(components, schema, file.data(), file.size());
+}
+} // namespace jnickg::sim_ecs
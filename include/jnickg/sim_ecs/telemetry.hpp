@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace jnickg::sim_ecs
+{
+/**
+ * @brief One telemetry event as it sits in a ring: a timestamp, a small
+ * trivially copyable payload, and how to format it
+ */
+struct TelemetryRecord
+{
+    static constexpr std::size_t payload_size = 48;
+
+    using format_t = void (*)(std::ostream &, const TelemetryRecord &);
+
+    std::chrono::steady_clock::time_point time;
+    format_t format    = nullptr; //< Unpacks the payload and calls the user's formatter
+    void (*user)()     = nullptr; //< The user's formatter, type-erased
+    alignas(8) std::byte payload[payload_size];
+};
+
+/**
+ * @brief A sink for telemetry from hot paths that never blocks on I/O
+ * @details Each thread that emits gets its own single-producer ring of binary
+ * records, so emitting is a copy and two atomic operations with no locks
+ * shared between threads. A background thread drains the rings, formats the
+ * records and writes them to the output stream, flushing only when it runs out
+ * of work. When a thread's ring is full, its new records are dropped and
+ * counted in dropped() instead of waiting.
+ *
+ * Records from one thread are written in the order they were emitted.
+ * Records from different threads are merged by timestamp within each batch
+ * the consumer drains, so their interleaving is close to, but not strictly,
+ * the order they happened in.
+ */
+class Telemetry
+{
+  public:
+    explicit Telemetry(std::ostream &out = std::cout, std::size_t ring_capacity = 4096,
+        std::chrono::microseconds poll_interval = std::chrono::milliseconds(1))
+        : out{out}, capacity{round_up_pow2(ring_capacity)}, poll_interval{poll_interval},
+          id{next_id().fetch_add(1, std::memory_order_relaxed)}
+    {
+        consumer = std::thread([this] { consume(); });
+    }
+    Telemetry(const Telemetry &)            = delete;
+    Telemetry(Telemetry &&)                 = delete;
+    Telemetry &operator=(const Telemetry &) = delete;
+    Telemetry &operator=(Telemetry &&)      = delete;
+
+    ~Telemetry()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        consumer.join();
+    }
+
+    /**
+     * @brief Record @p payload, to be written later as `format(os, payload)` on
+     * the consumer thread
+     * @details @p format must be a plain function or a lambda without captures.
+     * @return false if the calling thread's ring was full and the record was
+     * dropped
+     */
+    template <typename P>
+    // The formatter's payload type is spelled so it is not deduced, letting lambdas convert to it
+    bool emit(const P &payload, void (*format)(std::ostream &, const typename std::decay<P>::type &))
+    {
+        static_assert(std::is_trivially_copyable_v<P>, "Telemetry payloads are copied as raw bytes");
+        static_assert(sizeof(P) <= TelemetryRecord::payload_size, "Telemetry payload is too large for a record");
+
+        auto &ring = local_ring();
+        auto head  = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.tail.load(std::memory_order_acquire) == capacity)
+        {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        auto &record  = ring.slots[head & (capacity - 1)];
+        record.time   = std::chrono::steady_clock::now();
+        record.format = &format_as<P>;
+        record.user   = reinterpret_cast<void (*)()>(format);
+        std::memcpy(record.payload, &payload, sizeof(P));
+        ring.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Block until everything the calling thread emitted so far has been
+     * written and the output stream flushed
+     * @details This waits on the consumer, so call it between updates, never
+     * from a system.
+     */
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto ticket = ++flush_requested;
+        wake.notify_all();
+        flushed.wait(lock, [&] { return flush_completed >= ticket; });
+    }
+
+    /**
+     * @brief Records dropped because a ring was full, over every thread
+     */
+    std::size_t dropped() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::size_t total = 0;
+        for (const auto &ring : rings)
+        {
+            total += ring->dropped.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    inline std::size_t written() const { return written_count.load(std::memory_order_relaxed); }
+
+  private:
+    struct Ring
+    {
+        std::vector<TelemetryRecord> slots;
+        alignas(64) std::atomic<std::size_t> head    = 0; //< Next slot the producer writes
+        alignas(64) std::atomic<std::size_t> tail    = 0; //< Next slot the consumer reads
+        alignas(64) std::atomic<std::size_t> dropped = 0;
+
+        explicit Ring(std::size_t capacity) : slots(capacity) {}
+    };
+
+    std::ostream &out;
+    const std::size_t capacity;
+    const std::chrono::microseconds poll_interval;
+    const std::uint64_t id; //< Never reused, so a thread's cached ring can't be mistaken for another sink's
+    // Expires with the sink, telling threads to drop their cached ring for it
+    const std::shared_ptr<const std::uint64_t> lifetime = std::make_shared<const std::uint64_t>(id);
+
+    mutable std::mutex mutex; //< Guards rings, the flush counters and stopping; never taken by emit() after the first call on a thread
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::uint64_t flush_requested = 0;
+    std::uint64_t flush_completed = 0;
+    bool stopping                 = false;
+    std::atomic<std::size_t> written_count = 0;
+    std::thread consumer;
+
+    static std::atomic<std::uint64_t> &next_id()
+    {
+        static std::atomic<std::uint64_t> counter = 1;
+        return counter;
+    }
+
+    static std::size_t round_up_pow2(std::size_t n)
+    {
+        std::size_t p = 1;
+        while (p < n)
+        {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    template <typename P> static void format_as(std::ostream &os, const TelemetryRecord &record)
+    {
+        P payload;
+        std::memcpy(static_cast<void *>(&payload), record.payload, sizeof(P));
+        reinterpret_cast<void (*)(std::ostream &, const P &)>(record.user)(os, payload);
+    }
+
+    /**
+     * @brief The calling thread's ring, made on its first emit()
+     * @details Each thread keeps a small cache of its rings, one per sink it
+     * has emitted to. Entries for destroyed sinks are dropped whenever the
+     * thread adds a new one, so a thread that outlives many sinks does not
+     * keep them all.
+     */
+    Ring &local_ring()
+    {
+        struct cached
+        {
+            std::uint64_t sink;
+            std::weak_ptr<const std::uint64_t> lifetime;
+            Ring *ring;
+        };
+        thread_local std::vector<cached> cache;
+        for (const auto &entry : cache)
+        {
+            if (entry.sink == id)
+            {
+                return *entry.ring;
+            }
+        }
+        auto expired = [](const cached &entry) { return entry.lifetime.expired(); };
+        cache.erase(std::remove_if(cache.begin(), cache.end(), expired), cache.end());
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.push_back(std::make_unique<Ring>(capacity));
+        cache.push_back(cached{id, lifetime, rings.back().get()});
+        return *rings.back();
+    }
+
+    void consume()
+    {
+        std::vector<TelemetryRecord> batch;
+        std::stringstream text;
+        while (true)
+        {
+            std::uint64_t flush_ticket;
+            bool stop;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                flush_ticket = flush_requested;
+                stop         = stopping;
+
+                // Rings are only ever added, and only under the lock
+                batch.clear();
+                for (auto &ring : rings)
+                {
+                    auto tail = ring->tail.load(std::memory_order_relaxed);
+                    auto head = ring->head.load(std::memory_order_acquire);
+                    for (; tail != head; ++tail)
+                    {
+                        batch.push_back(ring->slots[tail & (capacity - 1)]);
+                    }
+                    ring->tail.store(tail, std::memory_order_release);
+                }
+            }
+
+            if (!batch.empty())
+            {
+                std::stable_sort(batch.begin(), batch.end(),
+                    [](const TelemetryRecord &a, const TelemetryRecord &b) { return a.time < b.time; });
+                text.str("");
+                for (const auto &record : batch)
+                {
+                    record.format(text, record);
+                }
+                out << text.str();
+                written_count.fetch_add(batch.size(), std::memory_order_relaxed);
+                continue;
+            }
+
+            // Out of work: everything requested so far is written
+            out.flush();
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                flush_completed = flush_ticket;
+                flushed.notify_all();
+                if (stop)
+                {
+                    return;
+                }
+                wake.wait_for(lock, poll_interval, [&] { return stopping || flush_requested != flush_completed; });
+            }
+        }
+    }
+};
+} // namespace jnickg::sim_ecs
@@ -0,0 +1,338 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace jnickg::sim_ecs
+{
+/**
+ * @brief A fixed-size pool of worker threads with per-worker queues and work
+ * stealing
+ * @details Each worker pops from the back of its own queue and, when that is
+ * empty, steals from the front of the other workers' queues. Work is grouped
+ * into a @c TaskGroup, and a thread that waits on a group keeps running queued
+ * tasks until the group drains, so tasks may themselves submit and wait on
+ * nested groups without deadlocking the pool.
+ *
+ * A pool with zero workers runs every submitted task inline on the calling
+ * thread. Workers can be pinned one to a core, on platforms that support it.
+ */
+class ThreadPool
+{
+  public:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    using task_t = std::function<void()>;
+
+    /**
+     * @brief A set of tasks that can be waited on together
+     */
+    class TaskGroup
+    {
+        friend class ThreadPool;
+        std::atomic<std::size_t> pending = 0;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+
+      public:
+        inline bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+    };
+
+    /**
+     * @param pin Pin worker @c i to the @c i th core this process may run on,
+     * wrapping around if there are more workers than cores. Ignored where
+     * unsupported; see pinned().
+     */
+    explicit ThreadPool(std::size_t worker_count, bool pin = false) : queues(worker_count)
+    {
+        for (auto &queue : queues)
+        {
+            queue = std::make_unique<WorkerQueue>();
+        }
+        auto cores = pin ? allowed_cores() : std::vector<std::size_t>{};
+        workers.reserve(worker_count);
+        for (std::size_t i = 0; i < worker_count; ++i)
+        {
+            workers.emplace_back([this, i] { worker_loop(i); });
+            if (!cores.empty() && pin_to_core(workers.back(), cores[i % cores.size()]))
+            {
+                ++pinned_count;
+            }
+        }
+    }
+    ThreadPool(const ThreadPool &)            = delete;
+    ThreadPool(ThreadPool &&)                 = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ThreadPool &operator=(ThreadPool &&)      = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        sleep_cv.notify_all();
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    inline std::size_t size() const { return workers.size(); }
+
+    /**
+     * @brief How many workers were pinned to a core
+     */
+    inline std::size_t pinned() const { return pinned_count; }
+
+    /**
+     * @brief The index of the pool worker running the calling thread, or @c npos
+     * if the caller is not one of this pool's workers
+     */
+    inline std::size_t current_worker() const { return tls_pool() == this ? tls_index() : npos; }
+
+    void submit(TaskGroup &group, task_t task)
+    {
+        if (workers.empty())
+        {
+            task();
+            return;
+        }
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+
+        // Workers push to their own queue to keep nested work local; outside
+        // threads spread their tasks round-robin
+        auto home = current_worker();
+        if (home == npos)
+        {
+            home = next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues[home]->mutex);
+            queues[home]->tasks.push_back(queued_task{std::move(task), &group});
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        {
+            // Pairs with the predicate check in worker_loop so a worker that is
+            // about to sleep cannot miss this task
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        sleep_cv.notify_one();
+    }
+
+    /**
+     * @brief Block until every task in @p group has finished, running queued
+     * tasks on the calling thread in the meantime
+     * @details If any task in the group threw, the first exception is rethrown
+     * here once the rest of the group has finished.
+     */
+    void wait(TaskGroup &group)
+    {
+        auto home = current_worker();
+        while (!group.done())
+        {
+            if (!try_run_one(home == npos ? 0 : home))
+            {
+                std::this_thread::yield();
+            }
+        }
+        if (group.error)
+        {
+            auto error  = group.error;
+            group.error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * @brief Split `[0, count)` into chunks of @p chunk_size and run
+     * `fn(begin, end, chunk_index)` for each, returning once all are done
+     * @details The calling thread takes part in running the chunks.
+     */
+    template <typename F> void parallel_for(std::size_t count, std::size_t chunk_size, F &&fn)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        chunk_size       = chunk_size == 0 ? count : chunk_size;
+        auto chunk_count = (count + chunk_size - 1) / chunk_size;
+        if (workers.empty() || chunk_count == 1)
+        {
+            for (std::size_t chunk = 0; chunk < chunk_count; ++chunk)
+            {
+                fn(chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size), chunk);
+            }
+            return;
+        }
+        TaskGroup group;
+        for (std::size_t chunk = 0; chunk < chunk_count; ++chunk)
+        {
+            submit(group, [&fn, chunk, chunk_size, count] {
+                fn(chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size), chunk);
+            });
+        }
+        wait(group);
+    }
+
+  private:
+    struct queued_task
+    {
+        task_t fn;
+        TaskGroup *group = nullptr;
+    };
+
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<queued_task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> queued     = 0;
+    std::atomic<std::size_t> next_queue = 0;
+    std::size_t pinned_count            = 0;
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    bool stopping = false;
+
+    /**
+     * @brief The cores this process is allowed to run on, or none if that
+     * cannot be found out
+     */
+    static std::vector<std::size_t> allowed_cores()
+    {
+        std::vector<std::size_t> cores;
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for (std::size_t core = 0; core < CPU_SETSIZE; ++core)
+            {
+                if (CPU_ISSET(core, &set))
+                {
+                    cores.push_back(core);
+                }
+            }
+        }
+#endif
+        return cores;
+    }
+
+    static bool pin_to_core(std::thread &thread, std::size_t core)
+    {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+        (void)thread;
+        (void)core;
+        return false;
+#endif
+    }
+
+    static const ThreadPool *&tls_pool()
+    {
+        thread_local const ThreadPool *pool = nullptr;
+        return pool;
+    }
+
+    static std::size_t &tls_index()
+    {
+        thread_local std::size_t index = npos;
+        return index;
+    }
+
+    bool try_pop(std::size_t queue_index, bool steal, queued_task &out)
+    {
+        auto &queue = *queues[queue_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+        {
+            return false;
+        }
+        if (steal)
+        {
+            out = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        else
+        {
+            out = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool try_run_one(std::size_t home)
+    {
+        if (queued.load(std::memory_order_acquire) == 0)
+        {
+            return false;
+        }
+        queued_task task;
+        bool found = try_pop(home, false, task);
+        for (std::size_t i = 1; !found && i < queues.size(); ++i)
+        {
+            found = try_pop((home + i) % queues.size(), true, task);
+        }
+        if (!found)
+        {
+            return false;
+        }
+        try
+        {
+            task.fn();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(task.group->error_mutex);
+            if (!task.group->error)
+            {
+                task.group->error = std::current_exception();
+            }
+        }
+        task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    void worker_loop(std::size_t index)
+    {
+        tls_pool()  = this;
+        tls_index() = index;
+        while (true)
+        {
+            if (try_run_one(index))
+            {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleep_cv.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if (stopping)
+            {
+                return;
+            }
+        }
+    }
+};
+} // namespace jnickg::sim_ecs
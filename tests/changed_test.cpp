@@ -0,0 +1,157 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+
+namespace
+{
+struct counter
+{
+    std::uint32_t id    = 0;
+    std::uint32_t value = 0;
+};
+
+struct heat //< Double buffered, so copied forward at the end of every update
+{
+    std::uint32_t id = 0;
+    double value     = 0.0;
+};
+
+constexpr std::uint32_t count = 300;
+} // namespace
+
+template <> struct jnickg::sim_ecs::double_buffered<heat> : std::true_type
+{
+};
+
+namespace
+{
+/**
+ * @brief Whether the writers below write entity @p id on @p frame
+ */
+bool written_on(std::uint32_t id, frameidx_t frame) { return (id + frame) % 3 == 0; }
+
+/**
+ * @brief Changed terms see only what was written since the reader last ran,
+ * never the copy swap_buffers() makes of it at the end of an update
+ */
+void changed_across_swap_buffers()
+{
+    ComponentManager components;
+    SystemManager systems(4);
+    std::vector<entity_t> entities;
+    std::uint32_t next_id = 0;
+    for (auto e : components.spawn_batch(count, heat{}))
+    {
+        components.get_ref<heat>(e)->id = next_id++;
+        entities.push_back(e);
+    }
+
+    auto writer = systems.new_query_system<Write<heat>>(
+        "Writer", system_state::enabled, components, [&systems](entity_t, heat &h) -> bool {
+            if (!written_on(h.id, systems.frame()))
+            {
+                return false;
+            }
+            h.value += 1.0;
+            return true;
+        });
+    systems.set_parallel(writer, true, 32);
+
+    std::set<std::uint32_t> seen;
+    systems.new_query_system<Read<heat>, Changed<heat>>(
+        "Reader", system_state::enabled, components, [&seen](entity_t, const heat &h) { seen.insert(h.id); });
+
+    systems.update({});
+    for (int tick = 0; tick < 4; ++tick)
+    {
+        // Written from outside between updates, which the next update's
+        // readers count as a change
+        auto outside = static_cast<std::uint32_t>(7 * tick + 1);
+        components.get_ref<heat>(entities[outside])->value = -1.0;
+
+        seen.clear();
+        systems.update({});
+        std::set<std::uint32_t> written{outside};
+        for (std::uint32_t id = 0; id < count; ++id)
+        {
+            if (written_on(id, systems.frame()))
+            {
+                written.insert(id);
+            }
+        }
+        SIM_ECS_CHECK(seen == written);
+        for (auto e : entities)
+        {
+            SIM_ECS_CHECK(components.get_prev<heat>(e)->value == components.get_ref<const heat>(e)->value);
+        }
+    }
+}
+} // namespace
+
+/**
+ * @brief A batch system that says which rows it wrote, a byte per row, has
+ * only those rows seen as changed, and swapping buffers counts as no change
+ */
+int main()
+{
+    ComponentManager components;
+    SystemManager systems(4);
+    std::uint32_t next_id = 0;
+    for (auto e : components.spawn_batch(count, counter{}))
+    {
+        components.get_ref<counter>(e)->id = next_id++;
+    }
+
+    auto writer = systems.new_batch_system<Write<counter>>(
+        "Writer", system_state::enabled, components,
+        [&systems](span<const entity_t>, span<counter> rows) -> span<const std::uint8_t> {
+            thread_local std::vector<std::uint8_t> written;
+            written.assign(rows.size(), 0);
+            for (std::size_t i = 0; i < rows.size(); ++i)
+            {
+                if (written_on(rows[i].id, systems.frame()))
+                {
+                    ++rows[i].value;
+                    written[i] = 1;
+                }
+            }
+            // A mask short of the span leaves the rest unstamped
+            return {written.data(), rows.size() - 1};
+        });
+    // Chunks split the table, so each call's mask starts part way through it
+    systems.set_parallel(writer, true, 32);
+
+    std::set<std::uint32_t> seen;
+    systems.new_query_system<Read<counter>, Changed<counter>>(
+        "Reader", system_state::enabled, components, [&seen](entity_t, const counter &c) { seen.insert(c.id); });
+
+    // The first update sees every row as changed, since they were spawned
+    systems.update({});
+    SIM_ECS_CHECK(seen.size() == count);
+
+    for (int tick = 0; tick < 3; ++tick)
+    {
+        seen.clear();
+        systems.update({});
+        std::set<std::uint32_t> expected;
+        for (std::uint32_t id = 0; id < count; ++id)
+        {
+            bool last_in_chunk = id % 32 == 31 || id == count - 1;
+            if (written_on(id, systems.frame()) && !last_in_chunk)
+            {
+                expected.insert(id);
+            }
+        }
+        SIM_ECS_CHECK(!expected.empty());
+        SIM_ECS_CHECK(seen == expected);
+    }
+
+    changed_across_swap_buffers();
+    return test::result();
+}
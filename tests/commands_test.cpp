@@ -0,0 +1,189 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <cstdint>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+using test::item;
+
+namespace
+{
+struct flagged
+{
+};
+
+/**
+ * @brief Keeps every command applied, in the order applied
+ */
+struct collect : public CommandLog
+{
+    struct entry
+    {
+        op what;
+        std::vector<component_type_t> types;
+        std::vector<entity_t> entities;
+    };
+
+    std::vector<entry> entries;
+
+    void applied(op what, span<const component_type_t> types, span<const entity_t> entities) override
+    {
+        entries.push_back(entry{what, {types.begin(), types.end()}, {entities.begin(), entities.end()}});
+    }
+};
+
+constexpr std::uint32_t count = 200;
+constexpr std::size_t chunk   = 16;
+
+inline bool marks(std::uint32_t id) { return id % 4 == 0; }
+inline bool dooms(std::uint32_t id) { return id % 9 == 0; }
+} // namespace
+
+/**
+ * @brief Commands are applied in the order of the systems and chunks that
+ * recorded them, and in the order recorded within each, however many threads
+ * recorded them
+ */
+int main()
+{
+    using op = CommandLog::op;
+
+    for (auto workers : test::worker_counts)
+    {
+        ComponentManager components;
+        test::spawn_items(components, count);
+        std::vector<entity_t> entities;
+        components.query<Read<item>>([&entities](entity_t e, const item &) { entities.push_back(e); });
+
+        SystemManager systems(workers);
+        auto &commands = systems.commands(components);
+        collect log;
+        commands.set_log(&log);
+        auto marker = systems.new_query_system<Read<item>>(
+            "Marker", system_state::enabled, components, [&commands](entity_t e, const item &i) {
+                if (marks(i.id))
+                {
+                    commands.local().add(e, flagged{});
+                }
+                if (dooms(i.id))
+                {
+                    commands.local().despawn(e);
+                }
+            });
+        systems.set_parallel(marker, true, chunk);
+        systems.update({});
+        commands.set_log(nullptr);
+
+        // Each chunk's commands in row order, with consecutive ones of a kind
+        // merged, and chunks never merged with each other
+        std::vector<collect::entry> expected;
+        std::size_t last_chunk = 0;
+        for (std::uint32_t id = 0; id < count; ++id)
+        {
+            for (auto [applies, what] : {std::pair{marks(id), op::add}, std::pair{dooms(id), op::despawn}})
+            {
+                if (!applies)
+                {
+                    continue;
+                }
+                if (expected.empty() || expected.back().what != what || last_chunk != id / chunk)
+                {
+                    expected.push_back(collect::entry{what, {}, {}});
+                    if (what == op::add)
+                    {
+                        expected.back().types.push_back(component_type_id<flagged>());
+                    }
+                }
+                expected.back().entities.push_back(entities[id]);
+                last_chunk = id / chunk;
+            }
+        }
+        SIM_ECS_CHECK(log.entries.size() == expected.size());
+        for (std::size_t i = 0; i < log.entries.size() && i < expected.size(); ++i)
+        {
+            SIM_ECS_CHECK(log.entries[i].what == expected[i].what);
+            SIM_ECS_CHECK(log.entries[i].types == expected[i].types);
+            SIM_ECS_CHECK(log.entries[i].entities == expected[i].entities);
+        }
+        for (std::uint32_t id = 0; id < count; ++id)
+        {
+            SIM_ECS_CHECK(components.is_alive(entities[id]) == !dooms(id));
+            SIM_ECS_CHECK(components.has<flagged>(entities[id]) == (marks(id) && !dooms(id)));
+        }
+    }
+
+    // One buffer played back by hand: kinds are kept in the order recorded,
+    // rather than grouped, and consecutive commands of a kind are merged
+    {
+        ComponentManager components;
+        SystemManager systems(2);
+        auto &commands = systems.commands(components);
+        collect log;
+        commands.set_log(&log);
+
+        auto a = components.create_entity();
+        auto b = components.create_entity();
+        auto c = components.create_entity();
+        auto &local = commands.local();
+        local.despawn(a);
+        local.add(b, item{1});
+        local.add(c, item{2});
+        local.despawn(c);
+        local.spawn(item{3});
+        local.spawn(item{4});
+        SIM_ECS_CHECK(components.is_alive(a));
+        commands.playback();
+
+        SIM_ECS_CHECK(log.entries.size() == 4);
+        if (log.entries.size() == 4)
+        {
+            SIM_ECS_CHECK(log.entries[0].what == op::despawn && log.entries[0].entities == std::vector<entity_t>{a});
+            SIM_ECS_CHECK(log.entries[1].what == op::add && log.entries[1].entities == (std::vector<entity_t>{b, c}));
+            SIM_ECS_CHECK(log.entries[1].types == std::vector<component_type_t>{component_type_id<item>()});
+            SIM_ECS_CHECK(log.entries[2].what == op::despawn && log.entries[2].entities == std::vector<entity_t>{c});
+            SIM_ECS_CHECK(log.entries[3].what == op::spawn && log.entries[3].entities.size() == 2);
+
+            // Spawns report the entities they made, in the order recorded
+            std::uint32_t expected = 3;
+            for (auto e : log.entries[3].entities)
+            {
+                auto i = components.get_ref<const item>(e);
+                SIM_ECS_CHECK(i && i->id == expected++);
+            }
+        }
+        SIM_ECS_CHECK(!components.is_alive(a) && !components.is_alive(c));
+        SIM_ECS_CHECK(components.get_ref<const item>(b) && components.get_ref<const item>(b)->id == 1);
+
+        // Commands for an entity despawned before they apply are dropped, and
+        // only what was applied is logged
+        log.entries.clear();
+        auto d = components.create_entity();
+        local.despawn(d);
+        local.add(d, flagged{});
+        local.add(b, flagged{});
+        local.despawn(d);
+        local.remove<flagged>(d);
+        local.set_enabled(d, false);
+        local.remove<flagged>(b);
+        local.remove<flagged>(b);
+        commands.playback();
+        SIM_ECS_CHECK(!components.is_alive(d));
+        SIM_ECS_CHECK(!components.has<flagged>(b));
+        SIM_ECS_CHECK(log.entries.size() == 3);
+        if (log.entries.size() == 3)
+        {
+            SIM_ECS_CHECK(log.entries[0].what == op::despawn && log.entries[0].entities == std::vector<entity_t>{d});
+            SIM_ECS_CHECK(log.entries[1].what == op::add && log.entries[1].entities == std::vector<entity_t>{b});
+            SIM_ECS_CHECK(log.entries[2].what == op::remove && log.entries[2].entities == std::vector<entity_t>{b});
+        }
+
+        // Playback clears what it applied
+        log.entries.clear();
+        commands.playback();
+        SIM_ECS_CHECK(log.entries.empty());
+        commands.set_log(nullptr);
+    }
+    return test::result();
+}
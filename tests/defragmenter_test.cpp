@@ -0,0 +1,98 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+
+namespace
+{
+struct spot
+{
+    std::uint64_t key = 0; //< Where the defragmenter should put it
+    std::uint32_t id  = 0;
+};
+
+struct other_table //< Puts some entities in a second table
+{
+};
+} // namespace
+
+/**
+ * @brief Many tiny steps, with entities spawned and despawned between some of
+ * them, still end in every table sorted by key with nothing lost
+ */
+int main()
+{
+    ComponentManager components;
+    std::mt19937_64 rng(3);
+    std::unordered_map<entity_t, std::uint32_t> ids;
+    std::uint32_t next_id = 0;
+    auto spawn            = [&] {
+        auto e = components.create_entity();
+        components.emplace<spot>(e, spot{rng() % 100000, next_id});
+        if (next_id % 3 == 0)
+        {
+            components.emplace<other_table>(e);
+        }
+        ids[e] = next_id++;
+    };
+    for (int i = 0; i < 20000; ++i)
+    {
+        spawn();
+    }
+
+    Defragmenter defragmenter(components, [&components](entity_t e) { return components.get_ref<const spot>(e)->key; });
+
+    // Interrupt the first passes with structural changes after every step, so
+    // they land in the middle of every phase
+    for (std::size_t steps = 0; steps < 400; ++steps)
+    {
+        defragmenter.step(std::chrono::microseconds(0));
+        if (steps % 2 == 0)
+        {
+            spawn();
+        }
+        else
+        {
+            auto doomed = std::next(ids.begin(), static_cast<std::ptrdiff_t>(rng() % ids.size()))->first;
+            components.destroy_entity(doomed);
+            ids.erase(doomed);
+        }
+    }
+    // Then leave it alone for a whole pass after the one under way, which has
+    // to take many steps for this to test picking up where a step left off
+    while (!defragmenter.step(std::chrono::microseconds(0)))
+    {
+    }
+    std::size_t last_pass_steps = 1;
+    while (!defragmenter.step(std::chrono::microseconds(0)))
+    {
+        ++last_pass_steps;
+    }
+    SIM_ECS_CHECK(last_pass_steps > 10);
+    SIM_ECS_CHECK(defragmenter.rows_moved() > 0);
+
+    std::size_t tables = 0;
+    std::size_t seen   = 0;
+    components.query_batches<Read<spot>>(query_ticks{}, [&](span<const entity_t> entities, span<const spot> spots) {
+        ++tables;
+        for (std::size_t row = 0; row < spots.size(); ++row)
+        {
+            SIM_ECS_CHECK(row == 0 || spots[row - 1].key <= spots[row].key);
+            auto it = ids.find(entities[row]);
+            SIM_ECS_CHECK(it != ids.end() && it->second == spots[row].id);
+            SIM_ECS_CHECK(components.get_ref<const spot>(entities[row])->id == spots[row].id);
+        }
+        seen += spots.size();
+    });
+    SIM_ECS_CHECK(tables == 2);
+    SIM_ECS_CHECK(seen == ids.size());
+    return test::result();
+}
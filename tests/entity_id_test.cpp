@@ -0,0 +1,100 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <cstdint>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+using test::item;
+
+/**
+ * @brief A destroyed entity's ID stays dead after its slot is reused, each
+ * reuse bumps the slot's generation, and every world numbers its own entities
+ */
+int main()
+{
+    // Slots are handed out from 1, and a freed one is reused with the next
+    // generation, last freed first
+    {
+        EntityRegistry registry;
+        auto a = registry.create();
+        auto b = registry.create();
+        auto c = registry.create();
+        SIM_ECS_CHECK(entity_index(a) == 1 && entity_index(b) == 2 && entity_index(c) == 3);
+        SIM_ECS_CHECK(entity_generation(a) == 0 && entity_generation(c) == 0);
+        SIM_ECS_CHECK(registry.size() == 3 && registry.capacity() == 4);
+
+        SIM_ECS_CHECK(registry.destroy(b));
+        SIM_ECS_CHECK(!registry.is_alive(b));
+        SIM_ECS_CHECK(!registry.destroy(b));
+        SIM_ECS_CHECK(registry.size() == 2);
+
+        auto b2 = registry.create();
+        SIM_ECS_CHECK(entity_index(b2) == entity_index(b));
+        SIM_ECS_CHECK(entity_generation(b2) == 1);
+        SIM_ECS_CHECK(b2 != b);
+        SIM_ECS_CHECK(registry.is_alive(b2) && !registry.is_alive(b));
+        SIM_ECS_CHECK(!registry.destroy(b));
+        SIM_ECS_CHECK(registry.is_alive(b2));
+
+        registry.destroy(b2);
+        auto b3 = registry.create();
+        SIM_ECS_CHECK(entity_index(b3) == entity_index(b) && entity_generation(b3) == 2);
+        SIM_ECS_CHECK(!registry.is_alive(b2));
+
+        registry.destroy(a);
+        registry.destroy(c);
+        SIM_ECS_CHECK(registry.create() == make_entity(entity_index(c), 1));
+        SIM_ECS_CHECK(registry.create() == make_entity(entity_index(a), 1));
+        SIM_ECS_CHECK(registry.capacity() == 4);
+
+        // A range takes fresh slots even with some free
+        registry.destroy(b3);
+        auto range = registry.create_range(3);
+        SIM_ECS_CHECK(range.first == 4 && range.size() == 3);
+        SIM_ECS_CHECK(registry.is_alive(range[2]) && range.contains(range[1]));
+        SIM_ECS_CHECK(!range.contains(b3));
+        SIM_ECS_CHECK(entity_index(registry.create()) == entity_index(b));
+
+        SIM_ECS_CHECK(!registry.is_alive(NO_ENTITY));
+        SIM_ECS_CHECK(!registry.is_alive(make_entity(100, 0)));
+    }
+
+    // A stale ID finds nothing in the world and cannot touch the slot's new
+    // occupant
+    {
+        ComponentManager components;
+        auto old = components.create_entity();
+        components.emplace<item>(old, item{1});
+        SIM_ECS_CHECK(components.destroy_entity(old));
+
+        auto occupant = components.create_entity();
+        components.emplace<item>(occupant, item{2});
+        SIM_ECS_CHECK(entity_index(occupant) == entity_index(old));
+        SIM_ECS_CHECK(entity_generation(occupant) == entity_generation(old) + 1);
+
+        SIM_ECS_CHECK(!components.is_alive(old));
+        SIM_ECS_CHECK(!components.has<item>(old));
+        SIM_ECS_CHECK(!components.get_ref<item>(old));
+        SIM_ECS_CHECK(!components.destroy_entity(old));
+        SIM_ECS_CHECK(components.destroy_entities(std::vector<entity_t>{old, old}) == 0);
+        SIM_ECS_CHECK(!components.set_enabled(old, false));
+
+        auto kept = components.get_ref<const item>(occupant);
+        SIM_ECS_CHECK(components.is_alive(occupant) && kept && kept->id == 2);
+        SIM_ECS_CHECK(components.is_enabled(occupant));
+    }
+
+    // Each world hands out its own IDs
+    {
+        ComponentManager first;
+        ComponentManager second;
+        first.create_entity();
+        auto a = first.create_entity();
+        auto b = second.create_entity();
+        SIM_ECS_CHECK(entity_index(a) == 2 && entity_index(b) == 1);
+        SIM_ECS_CHECK(!second.is_alive(a));
+    }
+    return test::result();
+}
@@ -0,0 +1,102 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <cstdint>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+using test::item;
+
+namespace
+{
+struct ping
+{
+    std::uint32_t id = 0;
+    frameidx_t frame = 0;
+};
+
+constexpr std::uint32_t count = 300;
+
+/**
+ * @brief What each reader heard over a few updates on @p workers threads
+ */
+struct heard
+{
+    std::vector<ping> after;  //< By a reader in a later stage than the sender
+    std::vector<ping> before; //< By a reader in an earlier stage
+    std::size_t late_read     = 0;
+    std::uint64_t late_missed = 0;
+};
+
+heard run(std::size_t workers)
+{
+    ComponentManager components;
+    test::spawn_items(components, count);
+    SystemManager systems(workers);
+    auto &pings = systems.events<ping>();
+    auto late   = pings.reader();
+    heard result;
+
+    auto before = systems.new_event_system<ping>("Before", system_state::enabled, [&](span<const ping> events) {
+        result.before.insert(result.before.end(), events.begin(), events.end());
+    });
+    auto sender = systems.new_query_system<Read<item>>(
+        "Sender", system_state::enabled, components, [&](entity_t, const item &i) {
+            pings.send(ping{i.id, systems.frame()});
+        });
+    systems.set_parallel(sender, true, 16);
+    auto after = systems.new_event_system<ping>("After", system_state::enabled, [&](span<const ping> events) {
+        result.after.insert(result.after.end(), events.begin(), events.end());
+    });
+    systems.add_dependency(sender, before);
+    systems.add_dependency(after, sender);
+
+    for (int tick = 0; tick < 3; ++tick)
+    {
+        systems.update({});
+    }
+    // Only the last two updates' events are still readable
+    result.late_read   = late.read([](span<const ping>) {});
+    result.late_missed = late.missed();
+    return result;
+}
+
+/**
+ * @brief Whether @p events are every item's ping from each of @p frames in
+ * turn, in row order
+ */
+bool in_order(const std::vector<ping> &events, std::vector<frameidx_t> frames)
+{
+    if (events.size() != frames.size() * count)
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < events.size(); ++i)
+    {
+        if (events[i].id != i % count || events[i].frame != frames[i / count])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+/**
+ * @brief Events are read in the order of the systems and chunks that sent
+ * them, by later stages in the same update and by earlier ones in the next,
+ * and stay readable until the end of the next update
+ */
+int main()
+{
+    for (auto workers : test::worker_counts)
+    {
+        auto result = run(workers);
+        SIM_ECS_CHECK(in_order(result.after, {1, 2, 3}));
+        SIM_ECS_CHECK(in_order(result.before, {1, 2}));
+        SIM_ECS_CHECK(result.late_read == 2 * count);
+        SIM_ECS_CHECK(result.late_missed == count);
+    }
+    return test::result();
+}
@@ -0,0 +1,159 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+using test::item;
+
+namespace
+{
+struct other
+{
+    int value = 0;
+};
+
+struct tick
+{
+};
+
+/**
+ * @brief The stage @p system runs in, or the stage count if it is in none
+ */
+std::size_t stage_of(const SystemManager::ExecutionGraph &graph, system_t system)
+{
+    for (std::size_t stage = 0; stage < graph.size(); ++stage)
+    {
+        const auto &systems = graph[stage].systems;
+        if (std::find(systems.begin(), systems.end(), system) != systems.end())
+        {
+            return stage;
+        }
+    }
+    return graph.size();
+}
+
+/**
+ * @brief The message of the exception building @p systems' graph throws, or
+ * nothing if it does not throw
+ */
+std::string cycle_error(SystemManager &systems)
+{
+    try
+    {
+        systems.build_execution_graph();
+    }
+    catch (const std::logic_error &e)
+    {
+        return e.what();
+    }
+    return {};
+}
+} // namespace
+
+/**
+ * @brief Systems whose component access conflicts are put in different
+ * stages in registration order, those that only read share one, and a cycle
+ * of dependencies is refused naming only the systems on it
+ */
+int main()
+{
+    ComponentManager components;
+    test::spawn_items(components, 4);
+
+    // Readers share a stage, and a writer goes between the readers registered
+    // before it and after it
+    {
+        SystemManager systems;
+        auto noop   = [](entity_t, auto &&...) {};
+        auto first  = systems.new_query_system<Read<item>>("First", system_state::enabled, components, noop);
+        auto second = systems.new_query_system<Read<item>>("Second", system_state::enabled, components, noop);
+        auto writer = systems.new_query_system<Write<item>>("Writer", system_state::enabled, components, noop);
+        auto third  = systems.new_query_system<Read<item>>("Third", system_state::enabled, components, noop);
+        auto apart  = systems.new_query_system<Write<other>>("Apart", system_state::enabled, components, noop);
+
+        const auto &graph = systems.execution_graph();
+        SIM_ECS_CHECK(graph.size() == 3);
+        SIM_ECS_CHECK(stage_of(graph, first) == 0 && stage_of(graph, second) == 0);
+        SIM_ECS_CHECK(stage_of(graph, writer) == 1);
+        SIM_ECS_CHECK(stage_of(graph, third) == 2);
+        SIM_ECS_CHECK(stage_of(graph, apart) == 0);
+
+        // Declared access counts the same as the query's own
+        systems.declare_reads<other>(third);
+        SIM_ECS_CHECK(stage_of(systems.execution_graph(), third) == 2);
+        SIM_ECS_CHECK(stage_of(systems.execution_graph(), apart) == 3);
+
+        // An explicit dependency overrides registration order, and conflicts
+        // follow the order it gives
+        systems.add_dependency(first, third);
+        const auto &ordered = systems.execution_graph();
+        SIM_ECS_CHECK(stage_of(ordered, second) == 0);
+        SIM_ECS_CHECK(stage_of(ordered, writer) == 1);
+        SIM_ECS_CHECK(stage_of(ordered, third) == 2);
+        SIM_ECS_CHECK(stage_of(ordered, first) == 3);
+        SIM_ECS_CHECK(stage_of(ordered, apart) == 3);
+        SIM_ECS_CHECK(cycle_error(systems).empty());
+    }
+
+    // A cycle is reported by the systems on it, not the ones after it
+    {
+        SystemManager systems;
+        auto noop       = [](span<const tick>) {};
+        auto before     = systems.new_event_system<tick>("Before", system_state::enabled, noop);
+        auto alpha      = systems.new_event_system<tick>("Alpha", system_state::enabled, noop);
+        auto beta       = systems.new_event_system<tick>("Beta", system_state::enabled, noop);
+        auto gamma      = systems.new_event_system<tick>("Gamma", system_state::enabled, noop);
+        auto downstream = systems.new_event_system<tick>("Downstream", system_state::enabled, noop);
+        systems.add_dependency(alpha, before);
+        systems.add_dependency(beta, alpha);
+        systems.add_dependency(gamma, beta);
+        systems.add_dependency(downstream, gamma);
+        SIM_ECS_CHECK(cycle_error(systems).empty());
+
+        systems.add_dependency(alpha, gamma);
+        auto message = cycle_error(systems);
+        SIM_ECS_CHECK(!message.empty());
+        auto at = [&message](const char *name) { return message.find(name); };
+        for (auto name : {"'Alpha'", "'Beta'", "'Gamma'"})
+        {
+            SIM_ECS_CHECK(at(name) != std::string::npos);
+        }
+        SIM_ECS_CHECK(at("'Before'") == std::string::npos);
+        SIM_ECS_CHECK(at("'Downstream'") == std::string::npos);
+
+        // Listed in the order the dependencies ask for, coming back round
+        std::vector<std::string> listed;
+        for (auto open = message.find('\''); open != std::string::npos; open = message.find('\'', open + 1))
+        {
+            auto close = message.find('\'', open + 1);
+            listed.push_back(message.substr(open + 1, close - open - 1));
+            open = close;
+        }
+        std::vector<std::string> cycle{"Alpha", "Beta", "Gamma"};
+        SIM_ECS_CHECK(listed.size() == 4);
+        if (listed.size() == 4)
+        {
+            SIM_ECS_CHECK(listed.front() == listed.back());
+            auto first = std::find(cycle.begin(), cycle.end(), listed.front());
+            std::rotate(cycle.begin(), first == cycle.end() ? cycle.begin() : first, cycle.end());
+            SIM_ECS_CHECK(std::equal(cycle.begin(), cycle.end(), listed.begin()));
+        }
+
+        bool threw = false;
+        try
+        {
+            systems.update({});
+        }
+        catch (const std::logic_error &)
+        {
+            threw = true;
+        }
+        SIM_ECS_CHECK(threw);
+    }
+    return test::result();
+}
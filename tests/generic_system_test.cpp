@@ -0,0 +1,110 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+using test::item;
+
+namespace
+{
+/**
+ * @brief A ComponentBase-derived total, so updates to it can be reported
+ */
+struct tally : public ComponentBase
+{
+    std::uint64_t value = 0;
+};
+
+constexpr std::uint32_t count = 500;
+
+/**
+ * @brief What one run of the system left behind in a fresh world
+ */
+struct outcome
+{
+    update_counts counts;
+    std::vector<std::uint64_t> values; //< Each entity's tally, or -1 without one
+    std::vector<bool> reported;        //< Whether each entity's tally was in the updated set
+};
+
+outcome run(std::size_t workers, bool parallel)
+{
+    ComponentManager components;
+    std::vector<entity_t> entities;
+    for (std::uint32_t id = 0; id < count; ++id)
+    {
+        auto e = components.create_entity();
+        components.emplace<item>(e, item{id});
+        if (id % 3 != 0)
+        {
+            components.emplace<tally>(e);
+        }
+        entities.push_back(e);
+    }
+
+    SystemManager systems(workers);
+    auto id = systems.new_system<tally, const item>(
+        "Tally", system_state::enabled,
+        [&components](entity_t e) { return components.get<const item>(e)->id % 5 != 0; },
+        [&components](entity_t e) { return std::make_tuple(components.get<tally>(e), components.get<const item>(e)); },
+        [](entity_t, std::tuple<handle<tally>, const item *> c) {
+            auto &[t, i] = c;
+            t->value += i->id;
+            return i->id % 2 == 0 ? component_set_t{t} : component_set_t{};
+        });
+    systems.set_parallel(id, parallel, 7);
+
+    // Stamps from before the update are strictly earlier than the update's own
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    auto before = jnickg::sim_ecs::clock_t::now();
+    systems.update(components.get_all_entities());
+
+    outcome result;
+    result.counts = systems.systems.at(id)->last_counts();
+    for (auto e : entities)
+    {
+        auto t = components.get<tally>(e);
+        result.values.push_back(t ? t->value : static_cast<std::uint64_t>(-1));
+        result.reported.push_back(t && t->last_updated_at >= before);
+    }
+    return result;
+}
+} // namespace
+
+/**
+ * @brief A GenericSystem run in parallel chunks matches, updates and reports
+ * exactly what it does run serially
+ */
+int main()
+{
+    auto serial = run(1, false);
+    SIM_ECS_CHECK(serial.counts.matched == serial.counts.processed);
+    SIM_ECS_CHECK(serial.counts.changed > 0 && serial.counts.changed < serial.counts.matched);
+
+    std::size_t expected_matched = 0, expected_changed = 0;
+    for (std::uint32_t id = 0; id < count; ++id)
+    {
+        if (id % 3 != 0 && id % 5 != 0)
+        {
+            ++expected_matched;
+            expected_changed += id % 2 == 0;
+        }
+    }
+    SIM_ECS_CHECK(serial.counts.matched == expected_matched && serial.counts.changed == expected_changed);
+
+    for (auto workers : test::worker_counts)
+    {
+        auto chunked = run(workers, true);
+        SIM_ECS_CHECK(chunked.counts.matched == serial.counts.matched);
+        SIM_ECS_CHECK(chunked.counts.processed == serial.counts.processed);
+        SIM_ECS_CHECK(chunked.counts.changed == serial.counts.changed);
+        SIM_ECS_CHECK(chunked.values == serial.values);
+        SIM_ECS_CHECK(chunked.reported == serial.reported);
+    }
+    return test::result();
+}
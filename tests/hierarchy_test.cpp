@@ -0,0 +1,125 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+
+namespace
+{
+struct label
+{
+    std::uint32_t id = 0;
+};
+
+bool owns(const ComponentManager &components, entity_t owner, entity_t child)
+{
+    auto children = components.children_of(owner);
+    return std::find(children.begin(), children.end(), child) != children.end();
+}
+} // namespace
+
+/**
+ * @brief Owners track their children, destroy_with_children() takes a whole
+ * subtree and nothing else, and destroy_entity() leaves the children behind
+ */
+int main()
+{
+    ComponentManager components;
+    auto make = [&](std::uint32_t id) {
+        auto e = components.create_entity();
+        components.emplace<label>(e, label{id});
+        return e;
+    };
+
+    // root -> {a, b}, a -> {a1, a2}, a1 -> {a1x}; b -> {b1}; loner owns nothing
+    auto root = make(0);
+    auto a = make(1), b = make(2), a1 = make(3), a2 = make(4), a1x = make(5), b1 = make(6), loner = make(7);
+    components.set_owner(a, root);
+    components.set_owner(b, root);
+    components.set_owner(a1, a);
+    components.set_owner(a2, a);
+    components.set_owner(a1x, a1);
+    components.set_owner(b1, b);
+
+    SIM_ECS_CHECK(components.owner_of(a1x) == a1);
+    SIM_ECS_CHECK(components.owner_of(root) == NO_ENTITY);
+    SIM_ECS_CHECK(components.children_of(root).size() == 2);
+    SIM_ECS_CHECK(owns(components, a, a1) && owns(components, a, a2));
+    SIM_ECS_CHECK(components.children_of(loner).empty());
+
+    // Ownership cannot loop back on itself, however far up
+    bool refused = false;
+    try
+    {
+        components.set_owner(root, a1x);
+    }
+    catch (const std::logic_error &)
+    {
+        refused = true;
+    }
+    SIM_ECS_CHECK(refused);
+    SIM_ECS_CHECK(components.owner_of(root) == NO_ENTITY);
+
+    // Moving a subtree updates both owners
+    components.set_owner(a2, b);
+    SIM_ECS_CHECK(!owns(components, a, a2) && owns(components, b, a2));
+    SIM_ECS_CHECK(components.owner_of(a2) == b);
+
+    // Destroying a takes a1 and a1x with it, and leaves b's side alone
+    SIM_ECS_CHECK(components.destroy_with_children(a) == 3);
+    SIM_ECS_CHECK(!components.is_alive(a) && !components.is_alive(a1) && !components.is_alive(a1x));
+    for (auto e : {root, b, b1, a2, loner})
+    {
+        SIM_ECS_CHECK(components.is_alive(e));
+    }
+    SIM_ECS_CHECK(components.children_of(root).size() == 1 && owns(components, root, b));
+    SIM_ECS_CHECK(components.destroy_with_children(a) == 0);
+
+    // A slot reused after its entity was destroyed starts with no relations
+    auto reused = make(8);
+    SIM_ECS_CHECK(components.owner_of(reused) == NO_ENTITY);
+    SIM_ECS_CHECK(components.children_of(reused).empty());
+
+    // destroy_entity() only takes the one entity, leaving its children unowned
+    components.destroy_entity(b);
+    SIM_ECS_CHECK(components.is_alive(b1) && components.is_alive(a2));
+    SIM_ECS_CHECK(components.owner_of(b1) == NO_ENTITY && components.owner_of(a2) == NO_ENTITY);
+    SIM_ECS_CHECK(components.children_of(root).empty());
+
+    // A wide, deep tree goes all at once, with every component with it
+    auto top = make(100);
+    std::vector<entity_t> level{top};
+    std::size_t total = 1;
+    for (int depth = 0; depth < 4; ++depth)
+    {
+        std::vector<entity_t> next;
+        for (auto owner : level)
+        {
+            for (std::uint32_t i = 0; i < 5; ++i)
+            {
+                auto child = make(1000 + static_cast<std::uint32_t>(total));
+                components.set_owner(child, owner);
+                next.push_back(child);
+                ++total;
+            }
+        }
+        level = std::move(next);
+    }
+    std::size_t labels_before = 0;
+    components.query<Read<label>>([&](entity_t, const label &) { ++labels_before; });
+    SIM_ECS_CHECK(components.destroy_with_children(top) == total);
+    std::size_t labels_after = 0;
+    components.query<Read<label>>([&](entity_t, const label &) { ++labels_after; });
+    SIM_ECS_CHECK(labels_before - labels_after == total);
+    for (auto e : level)
+    {
+        SIM_ECS_CHECK(!components.is_alive(e));
+    }
+    SIM_ECS_CHECK(components.is_alive(root) && components.is_alive(loner));
+    return test::result();
+}
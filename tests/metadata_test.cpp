@@ -0,0 +1,91 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+using test::item;
+
+namespace
+{
+struct weight
+{
+    double value = 0.0;
+};
+
+/**
+ * @brief Wait long enough that the next timestamp is strictly later
+ */
+jnickg::sim_ecs::time_t later()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    return jnickg::sim_ecs::clock_t::now();
+}
+} // namespace
+
+/**
+ * @brief Plain components' debug timestamps are set when they are added and
+ * written, and stay with their entity as rows move between and within tables
+ */
+int main()
+{
+    ComponentManager components;
+    auto start = later();
+    std::vector<entity_t> entities;
+    for (std::uint32_t id = 0; id < 4; ++id)
+    {
+        auto e = components.create_entity();
+        components.emplace<item>(e, item{id});
+        entities.push_back(e);
+    }
+
+    // Added: created and last updated at once, now
+    auto added = components.metadata<item>(entities[3]);
+    SIM_ECS_CHECK(added && added->created_at >= start && added->created_at == added->last_updated_at);
+    SIM_ECS_CHECK(!components.metadata<weight>(entities[3]));
+    SIM_ECS_CHECK(!components.metadata<item>(NO_ENTITY));
+
+    // Written by a query or marked changed: last updated moves, created stays
+    auto written_at = later();
+    components.query<Write<item>>([](entity_t, item &i) {
+        if (i.id == 3)
+        {
+            ++i.id;
+            return true;
+        }
+        return false;
+    });
+    auto written = components.metadata<item>(entities[3]);
+    SIM_ECS_CHECK(written->created_at == added->created_at && written->last_updated_at >= written_at);
+    SIM_ECS_CHECK(components.metadata<item>(entities[2])->last_updated_at < written_at);
+
+    auto marked_at = later();
+    components.mark_changed<item>(entities[1]);
+    SIM_ECS_CHECK(components.metadata<item>(entities[1])->last_updated_at >= marked_at);
+
+    // Moved to another table by adding a component, and then moved within it
+    // when the row before it goes
+    auto before_move = *components.metadata<item>(entities[3]);
+    components.emplace<weight>(entities[2], weight{1.0});
+    components.emplace<weight>(entities[3], weight{2.0});
+    auto moved = components.metadata<item>(entities[3]);
+    SIM_ECS_CHECK(moved->created_at == before_move.created_at);
+    SIM_ECS_CHECK(moved->last_updated_at == before_move.last_updated_at);
+    SIM_ECS_CHECK(components.metadata<weight>(entities[3])->created_at > before_move.last_updated_at);
+
+    components.destroy_entity(entities[2]);
+    auto swapped = components.metadata<item>(entities[3]);
+    SIM_ECS_CHECK(swapped->created_at == before_move.created_at);
+    SIM_ECS_CHECK(swapped->last_updated_at == before_move.last_updated_at);
+
+    // The same in the table left behind, where the last row fills the first
+    auto last_before = *components.metadata<item>(entities[1]);
+    components.destroy_entity(entities[0]);
+    auto filled = components.metadata<item>(entities[1]);
+    SIM_ECS_CHECK(filled->created_at == last_before.created_at);
+    SIM_ECS_CHECK(filled->last_updated_at == last_before.last_updated_at);
+    return test::result();
+}
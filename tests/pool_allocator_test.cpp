@@ -0,0 +1,108 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+using namespace jnickg::sim_ecs;
+
+namespace
+{
+/**
+ * @brief A memory resource that counts what it hands out, and says when it is
+ * gone
+ */
+class counting_resource : public std::pmr::memory_resource
+{
+    std::size_t &live;
+    bool &destroyed;
+
+  public:
+    counting_resource(std::size_t &live, bool &destroyed) : live{live}, destroyed{destroyed} {}
+    ~counting_resource() override { destroyed = true; }
+
+  private:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        ++live;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+    {
+        --live;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+};
+
+/**
+ * @brief A component that counts how many of it are alive
+ */
+struct tracked : public ComponentBase
+{
+    static inline int alive = 0;
+    double payload[6]       = {};
+
+    tracked(double value) : payload{value} { ++alive; }
+    ~tracked() override { --alive; }
+};
+} // namespace
+
+/**
+ * @brief Components come from their manager's pool in one allocation each,
+ * a handle kept past its manager still frees safely, and a despawned
+ * component's block is reused by the next of its size
+ */
+int main()
+{
+    // One allocation for the object and its control block, returned when the
+    // last handle goes, and the resource kept alive until then
+    {
+        std::size_t live = 0;
+        bool destroyed   = false;
+        auto resource    = std::make_shared<counting_resource>(live, destroyed);
+        auto kept        = std::allocate_shared<tracked>(pool_allocator<tracked>{resource}, 1.0);
+        auto copy        = kept;
+        SIM_ECS_CHECK(live == 1 && tracked::alive == 1);
+        resource.reset();
+        kept.reset();
+        SIM_ECS_CHECK(!destroyed && live == 1 && copy->payload[0] == 1.0);
+        copy.reset();
+        SIM_ECS_CHECK(destroyed && live == 0 && tracked::alive == 0);
+    }
+
+    // A handle kept past its manager still reads, and frees on release
+    {
+        handle<tracked> kept;
+        {
+            auto components = std::make_unique<ComponentManager>();
+            auto e          = components->create_entity();
+            components->emplace<tracked>(e, 2.0);
+            for (int i = 0; i < 50; ++i)
+            {
+                components->emplace<tracked>(components->create_entity(), 3.0);
+            }
+            kept = components->get<tracked>(e);
+            components.reset();
+        }
+        SIM_ECS_CHECK(tracked::alive == 1 && kept->payload[0] == 2.0);
+        kept.reset();
+        SIM_ECS_CHECK(tracked::alive == 0);
+    }
+
+    // Despawning hands the block back for the next spawn
+    {
+        ComponentManager components;
+        auto first = components.create_entity();
+        components.emplace<tracked>(first, 4.0);
+        const tracked *where = components.get_ref<const tracked>(first);
+        components.destroy_entity(first);
+        SIM_ECS_CHECK(tracked::alive == 0);
+        auto second = components.create_entity();
+        components.emplace<tracked>(second, 5.0);
+        SIM_ECS_CHECK(components.get_ref<const tracked>(second) == where);
+    }
+    return test::result();
+}
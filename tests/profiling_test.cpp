@@ -0,0 +1,355 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+using test::item;
+
+namespace
+{
+struct weight
+{
+    double value = 0.0;
+};
+
+/**
+ * @brief A parsed JSON value, just enough of one to check a trace with
+ */
+struct json
+{
+    enum class kind
+    {
+        null,
+        boolean,
+        number,
+        string,
+        array,
+        object,
+    };
+
+    kind type     = kind::null;
+    double number = 0.0;
+    std::string text;
+    std::vector<json> items;
+    std::map<std::string, json> fields;
+
+    bool has(const std::string &key) const { return fields.count(key) != 0; }
+    const json &operator[](const std::string &key) const { return fields.at(key); }
+};
+
+/**
+ * @brief A strict parser for the JSON grammar, failing on anything outside it
+ */
+class json_parser
+{
+    const std::string &in;
+    std::size_t at = 0;
+
+    void space()
+    {
+        while (at < in.size() && (in[at] == ' ' || in[at] == '\n' || in[at] == '\r' || in[at] == '\t'))
+        {
+            ++at;
+        }
+    }
+
+    bool eat(char c)
+    {
+        space();
+        if (at < in.size() && in[at] == c)
+        {
+            ++at;
+            return true;
+        }
+        return false;
+    }
+
+    bool literal(const char *word)
+    {
+        auto length = std::char_traits<char>::length(word);
+        if (in.compare(at, length, word) != 0)
+        {
+            return false;
+        }
+        at += length;
+        return true;
+    }
+
+    bool string(std::string &out)
+    {
+        if (!eat('"'))
+        {
+            return false;
+        }
+        while (at < in.size() && in[at] != '"')
+        {
+            auto c = in[at++];
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                return false;
+            }
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+            if (at >= in.size())
+            {
+                return false;
+            }
+            auto escaped = in[at++];
+            if (escaped == 'u')
+            {
+                for (int i = 0; i < 4; ++i, ++at)
+                {
+                    if (at >= in.size() || !std::isxdigit(static_cast<unsigned char>(in[at])))
+                    {
+                        return false;
+                    }
+                }
+                out += static_cast<char>(std::strtol(in.substr(at - 4, 4).c_str(), nullptr, 16));
+            }
+            else if (std::string("\"\\/bfnrt").find(escaped) != std::string::npos)
+            {
+                out += escaped;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return eat('"');
+    }
+
+    bool number(double &out)
+    {
+        auto begin = at;
+        if (at < in.size() && in[at] == '-')
+        {
+            ++at;
+        }
+        auto digits = [&] {
+            auto from = at;
+            while (at < in.size() && std::isdigit(static_cast<unsigned char>(in[at])))
+            {
+                ++at;
+            }
+            return at > from;
+        };
+        if (!digits() || (at < in.size() && in[at] == '.' && (++at, !digits())))
+        {
+            return false;
+        }
+        out = std::strtod(in.substr(begin, at - begin).c_str(), nullptr);
+        return true;
+    }
+
+  public:
+    explicit json_parser(const std::string &in) : in{in} {}
+
+    bool value(json &out)
+    {
+        space();
+        if (at >= in.size())
+        {
+            return false;
+        }
+        switch (in[at])
+        {
+        case '{':
+            out.type = json::kind::object;
+            ++at;
+            if (eat('}'))
+            {
+                return true;
+            }
+            do
+            {
+                std::string key;
+                json field;
+                if (!string(key) || !eat(':') || !value(field) || out.fields.count(key) != 0)
+                {
+                    return false;
+                }
+                out.fields.emplace(key, std::move(field));
+            } while (eat(','));
+            return eat('}');
+        case '[':
+            out.type = json::kind::array;
+            ++at;
+            if (eat(']'))
+            {
+                return true;
+            }
+            do
+            {
+                out.items.emplace_back();
+                if (!value(out.items.back()))
+                {
+                    return false;
+                }
+            } while (eat(','));
+            return eat(']');
+        case '"':
+            out.type = json::kind::string;
+            return string(out.text);
+        case 't':
+        case 'f':
+            out.type = json::kind::boolean;
+            return literal(in[at] == 't' ? "true" : "false");
+        case 'n':
+            return literal("null");
+        default:
+            out.type = json::kind::number;
+            return number(out.number);
+        }
+    }
+
+    /**
+     * @brief Parse the whole input as one value
+     */
+    bool document(json &out)
+    {
+        if (!value(out))
+        {
+            return false;
+        }
+        space();
+        return at == in.size();
+    }
+};
+
+json parse_trace(const SystemManager &systems)
+{
+    std::stringstream ss;
+    systems.write_chrome_trace(ss);
+    json trace;
+    SIM_ECS_CHECK(json_parser(ss.str()).document(trace));
+    return trace;
+}
+} // namespace
+
+/**
+ * @brief Each system's counts say how many entities it matched, ran on and
+ * wrote, both from the system and in the profiles, and the Chrome trace is
+ * well-formed JSON with a slice for every update, stage and system run
+ */
+int main()
+{
+    ComponentManager components;
+    test::spawn_items(components, 10);
+    std::vector<entity_t> entities;
+    components.query<Read<item>>([&entities](entity_t e, const item &) { entities.push_back(e); });
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        components.emplace<weight>(entities[i], weight{1.0});
+    }
+    components.set_enabled(entities[0], false);
+    components.set_enabled(entities[5], false);
+
+    SystemManager systems(2);
+
+    // The trace of nothing is still a trace
+    auto empty = parse_trace(systems);
+    SIM_ECS_CHECK(empty.has("traceEvents") && empty["traceEvents"].items.empty());
+
+    auto reader = systems.new_query_system<Read<item>>(
+        "Reader \"quoted\"\tand\\slashed\n", system_state::enabled, components, [](entity_t, const item &) {});
+    auto writer = systems.new_query_system<Read<item>, Write<weight>>(
+        "Writer", system_state::enabled, components, [](entity_t, const item &i, weight &w) {
+            if (i.id % 2 == 0)
+            {
+                w.value += 1.0;
+                return true;
+            }
+            return false;
+        });
+    auto watcher = systems.new_query_system<Read<weight>, Changed<weight>>(
+        "Watcher", system_state::enabled, components, [](entity_t, const weight &) {});
+    systems.add_dependency(watcher, writer);
+    systems.set_parallel(reader, true, 3);
+
+    systems.set_profiling(true, 2);
+    SIM_ECS_CHECK(systems.profiling_enabled());
+    for (int tick = 0; tick < 3; ++tick)
+    {
+        systems.update({});
+    }
+
+    // Disabled entities are matched but not run on, and only writes that
+    // happened count as changes
+    auto counts = [&systems](system_t id) { return systems.systems.at(id)->last_counts(); };
+    SIM_ECS_CHECK(counts(reader).matched == 10 && counts(reader).processed == 8 && counts(reader).changed == 0);
+    SIM_ECS_CHECK(counts(writer).matched == 4 && counts(writer).processed == 3 && counts(writer).changed == 1);
+    SIM_ECS_CHECK(counts(watcher).processed == 1);
+
+    // Only the last two updates are kept, with every system run in each,
+    // grouped by stage, with the same counts
+    const auto &profiles = systems.get_profiles();
+    SIM_ECS_CHECK(profiles.size() == 2);
+    SIM_ECS_CHECK(profiles.front().tick == 2 && profiles.back().tick == 3);
+    const auto &last = profiles.back();
+    SIM_ECS_CHECK(last.systems.size() == 3);
+    SIM_ECS_CHECK(last.stages.size() == systems.execution_graph().size());
+    SIM_ECS_CHECK(last.start <= last.end);
+    for (std::size_t i = 0; i < last.systems.size(); ++i)
+    {
+        const auto &run = last.systems[i];
+        SIM_ECS_CHECK(i == 0 || last.systems[i - 1].stage <= run.stage);
+        SIM_ECS_CHECK(run.start <= run.end && last.start <= run.start && run.end <= last.end);
+        SIM_ECS_CHECK(run.counts.processed == counts(run.system).processed);
+        SIM_ECS_CHECK(run.counts.changed == counts(run.system).changed);
+    }
+
+    // One metadata event per track, then a slice per update, stage and run
+    auto trace = parse_trace(systems);
+    SIM_ECS_CHECK(trace.has("traceEvents") && trace["traceEvents"].type == json::kind::array);
+    std::size_t metadata = 0, updates = 0, stages = 0, runs = 0;
+    bool named_reader = false;
+    for (const auto &event : trace["traceEvents"].items)
+    {
+        SIM_ECS_CHECK(event.type == json::kind::object && event.has("name") && event.has("ph"));
+        SIM_ECS_CHECK(event.has("pid") && event.has("tid"));
+        if (event["ph"].text == "M")
+        {
+            ++metadata;
+            continue;
+        }
+        SIM_ECS_CHECK(event["ph"].text == "X");
+        SIM_ECS_CHECK(event["ts"].type == json::kind::number && event["ts"].number >= 0.0);
+        SIM_ECS_CHECK(event["dur"].type == json::kind::number && event["dur"].number >= 0.0);
+        const auto &category = event["cat"].text;
+        updates += category == "update";
+        stages += category == "stage";
+        if (category == "system")
+        {
+            ++runs;
+            SIM_ECS_CHECK(event["args"]["matched"].type == json::kind::number);
+            SIM_ECS_CHECK(event["args"]["processed"].type == json::kind::number);
+            SIM_ECS_CHECK(event["args"]["changed"].type == json::kind::number);
+            named_reader = named_reader || event["name"].text.find("Reader \"quoted\"\tand\\slashed\n") == 1;
+        }
+    }
+    SIM_ECS_CHECK(metadata == 2 + systems.worker_count());
+    SIM_ECS_CHECK(updates == 2);
+    SIM_ECS_CHECK(stages == 2 * last.stages.size());
+    SIM_ECS_CHECK(runs == 2 * 3);
+    SIM_ECS_CHECK(named_reader);
+
+    // Turning profiling off stops recording, keeping what was recorded
+    systems.set_profiling(false);
+    systems.update({});
+    SIM_ECS_CHECK(systems.get_profiles().size() == 2);
+    systems.clear_profiles();
+    SIM_ECS_CHECK(systems.get_profiles().empty());
+    return test::result();
+}
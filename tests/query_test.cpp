@@ -0,0 +1,135 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <tuple>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+
+namespace
+{
+struct label
+{
+    std::uint32_t id = 0;
+};
+
+struct weight
+{
+    double value = 0.0;
+};
+
+struct marked
+{
+};
+
+struct note : public ComponentBase //< Stored as a handle, however big it is
+{
+    char text[256] = {};
+};
+
+/**
+ * @brief The labels a query with @p Terms visits, sorted
+ */
+template <typename... Terms> std::vector<std::uint32_t> visited(ComponentManager &components)
+{
+    std::vector<std::uint32_t> ids;
+    components.query<Read<label>, Terms...>([&ids](entity_t, const label &l, auto &&...) { ids.push_back(l.id); });
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+} // namespace
+
+/**
+ * @brief Queries visit exactly the entities whose archetype matches their
+ * terms and that are enabled, and values survive moves between archetypes
+ */
+int main()
+{
+    ComponentManager components;
+    std::vector<entity_t> entities;
+    for (std::uint32_t id = 0; id < 12; ++id)
+    {
+        auto e = components.create_entity();
+        components.emplace<label>(e, label{id});
+        if (id % 2 == 0)
+        {
+            components.emplace<weight>(e, weight{id * 0.5});
+        }
+        if (id % 3 == 0)
+        {
+            components.emplace<marked>(e);
+        }
+        entities.push_back(e);
+    }
+
+    using ids = std::vector<std::uint32_t>;
+    SIM_ECS_CHECK(visited<>(components).size() == 12);
+    SIM_ECS_CHECK(visited<Read<weight>>(components) == (ids{0, 2, 4, 6, 8, 10}));
+    SIM_ECS_CHECK(visited<With<marked>>(components) == (ids{0, 3, 6, 9}));
+    SIM_ECS_CHECK((visited<Read<weight>, Without<marked>>(components) == (ids{2, 4, 8, 10})));
+
+    // Writes land in the entity's own row
+    components.query<Read<label>, Write<weight>>([](entity_t, const label &l, weight &w) { w.value += l.id; });
+    for (std::uint32_t id = 0; id < 12; id += 2)
+    {
+        auto w = components.get_ref<const weight>(entities[id]);
+        SIM_ECS_CHECK(w && w->value == id * 1.5);
+    }
+
+    // Disabled entities are skipped until enabled again, and keep their values
+    SIM_ECS_CHECK(components.set_enabled(entities[4], false));
+    SIM_ECS_CHECK(!components.is_enabled(entities[4]));
+    SIM_ECS_CHECK(visited<Read<weight>>(components) == (ids{0, 2, 6, 8, 10}));
+    components.set_enabled(entities[4], true);
+    SIM_ECS_CHECK(visited<Read<weight>>(components) == (ids{0, 2, 4, 6, 8, 10}));
+    SIM_ECS_CHECK(components.get_ref<const weight>(entities[4])->value == 6.0);
+
+    // Adding and removing components moves entities between archetypes, with
+    // every other value kept, theirs and their former neighbours' alike
+    components.emplace<marked>(entities[4]);
+    components.remove<weight>(entities[6]);
+    components.remove<marked>(entities[0]);
+    SIM_ECS_CHECK(visited<With<marked>>(components) == (ids{3, 4, 6, 9}));
+    SIM_ECS_CHECK((visited<Read<weight>, Without<marked>>(components) == (ids{0, 2, 8, 10})));
+    SIM_ECS_CHECK(!components.has<weight>(entities[6]));
+    for (std::uint32_t id = 0; id < 12; ++id)
+    {
+        SIM_ECS_CHECK(components.get_ref<const label>(entities[id])->id == id);
+        if (id % 2 == 0 && id != 6)
+        {
+            SIM_ECS_CHECK(components.get_ref<const weight>(entities[id])->value == id * 1.5);
+        }
+    }
+
+    // A destroyed entity's row is filled by another, which stays reachable
+    components.destroy_entity(entities[2]);
+    SIM_ECS_CHECK((visited<Read<weight>, Without<marked>>(components) == (ids{0, 8, 10})));
+    SIM_ECS_CHECK(components.get_ref<const weight>(entities[10])->value == 15.0);
+
+    // update_if() with an empty std::function updates nothing, however the
+    // function is passed
+    GenericSystem<label> counter(
+        [](entity_t) { return true; },
+        [&components](entity_t e) { return std::make_tuple(components.get_ref<label>(e)); },
+        [](entity_t, std::tuple<ref<label>>) { return component_set_t{}; });
+    counter.enable();
+    std::function<bool(entity_t)> empty;
+    const auto &const_empty = empty;
+    counter.update_if(entities, const_empty);
+    counter.update_if(entities, empty);
+    counter.update_if(entities, std::function<bool(entity_t)>{});
+    SIM_ECS_CHECK(counter.last_counts().processed == 0);
+    counter.update_if(entities, [](entity_t) { return true; });
+    SIM_ECS_CHECK(counter.last_counts().processed > 0);
+
+    // Parallel chunks are sized by the bytes each row stores, not by the
+    // component a handle points to
+    SIM_ECS_CHECK(Column<note>::row_bytes == sizeof(handle<note>));
+    SIM_ECS_CHECK(Column<weight>::row_bytes == sizeof(weight));
+    SIM_ECS_CHECK(Column<marked>::row_bytes == 0);
+    return test::result();
+}
@@ -0,0 +1,183 @@
+#include <jnickg/sim_ecs/replay.hpp>
+
+#include "test_check.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+using namespace jnickg::sim_ecs;
+
+namespace
+{
+struct cell
+{
+    std::uint32_t value = 0;
+};
+
+struct marked //< Added by a command, moving the entity to another table
+{
+};
+
+const SnapshotSchema &schema()
+{
+    static const SnapshotSchema s = [] {
+        SnapshotSchema s;
+        s.add<cell>("test::cell");
+        s.add<marked>("test::marked");
+        return s;
+    }();
+    return s;
+}
+
+const std::string log_path      = "replay_test.log";
+constexpr std::size_t tick_count = 12;
+
+/**
+ * @brief Systems that spawn, despawn, mark and unmark cells through commands
+ * each tick
+ * @param extra_at A frame() to also re-enable an entity that is already
+ * enabled on, which changes nothing in the world but is a command all the same
+ */
+void add_systems(SystemManager &systems, ComponentManager &components, std::size_t extra_at = tick_count)
+{
+    auto &commands = systems.commands(components);
+    systems.new_query_system<Read<cell>>(
+        "Churn", system_state::enabled, components, [&systems, &commands](entity_t e, const cell &c) {
+            auto tick = static_cast<std::uint32_t>(systems.frame());
+            if (c.value % 13 == tick % 13)
+            {
+                commands.local().despawn(e);
+            }
+            else if (c.value % 3 == tick % 3)
+            {
+                commands.local().add(e, marked{});
+            }
+        });
+    systems.new_query_system<Read<cell>, With<marked>>(
+        "Unmark", system_state::enabled, components, [&systems, &commands, extra_at](entity_t e, const cell &c) {
+            if (c.value % 2 == systems.frame() % 2)
+            {
+                commands.local().remove<marked>(e);
+            }
+            if (systems.frame() == extra_at)
+            {
+                commands.local().set_enabled(e, true);
+            }
+        });
+    systems.new_query_system<Read<cell>>(
+        "Spawn", system_state::enabled, components, [&systems, &commands](entity_t, const cell &c) {
+            if (c.value % 7 == systems.frame() % 7)
+            {
+                commands.local().spawn(cell{c.value + static_cast<std::uint32_t>(systems.frame()) + 1});
+            }
+        });
+}
+
+/**
+ * @brief Record a run of the systems to log_path
+ */
+void record()
+{
+    ComponentManager components;
+    for (std::uint32_t i = 0; i < 40; ++i)
+    {
+        components.emplace<cell>(components.create_entity(), cell{i});
+    }
+    SystemManager systems(4);
+    systems.set_deterministic(true);
+    add_systems(systems, components);
+
+    ReplayRecorder recorder(log_path, components, schema(), 1);
+    systems.commands(components).set_log(&recorder);
+    for (std::size_t tick = 0; tick < tick_count; ++tick)
+    {
+        systems.update({});
+        recorder.end_tick(state_hash(components, schema()));
+    }
+    systems.commands(components).set_log(nullptr);
+}
+
+struct replayed
+{
+    std::size_t ticks                  = 0;
+    std::size_t first_command_mismatch = tick_count;
+    std::size_t first_hash_mismatch    = tick_count;
+};
+
+/**
+ * @brief Replay log_path, with the systems re-enabling an entity on frame
+ * @p extra_at
+ */
+replayed replay(std::size_t extra_at)
+{
+    ReplayReader log(log_path);
+    ComponentManager components;
+    log.restore(components, schema());
+    SystemManager systems(4);
+    systems.set_deterministic(true);
+    systems.set_frame(log.frame());
+    add_systems(systems, components, extra_at);
+
+    ReplayCommandCheck check(log, schema());
+    systems.commands(components).set_log(&check);
+    replayed result;
+    while (auto expected = log.next_tick([](std::uint32_t, SnapshotReader &) { SIM_ECS_CHECK(!"no inputs"); }))
+    {
+        SIM_ECS_CHECK(!log.commands().empty());
+        systems.update({});
+        if (!check.end_tick() && result.first_command_mismatch == tick_count)
+        {
+            result.first_command_mismatch = result.ticks;
+        }
+        if (state_hash(components, schema()) != *expected && result.first_hash_mismatch == tick_count)
+        {
+            result.first_hash_mismatch = result.ticks;
+        }
+        ++result.ticks;
+    }
+    systems.commands(components).set_log(nullptr);
+    return result;
+}
+} // namespace
+
+/**
+ * @brief A replay applies the same commands in the same order as the run it
+ * was recorded from, and one applying a command more is caught at that tick
+ * even when the world comes out the same
+ */
+int main()
+{
+    record();
+
+    auto same = replay(tick_count);
+    SIM_ECS_CHECK(same.ticks == tick_count);
+    SIM_ECS_CHECK(same.first_command_mismatch == tick_count);
+    SIM_ECS_CHECK(same.first_hash_mismatch == tick_count);
+
+    // frame() counts the update under way, so frame 5 is the fifth tick
+    auto extra = replay(5);
+    SIM_ECS_CHECK(extra.ticks == tick_count);
+    SIM_ECS_CHECK(extra.first_command_mismatch == 4);
+    SIM_ECS_CHECK(extra.first_hash_mismatch == tick_count);
+
+    // Input kinds the log uses itself are refused
+    {
+        ComponentManager components;
+        ReplayRecorder recorder(log_path, components, schema(), 1);
+        bool refused = false;
+        try
+        {
+            recorder.record(ReplayRecorder::command_kind, std::uint8_t{0});
+        }
+        catch (const std::logic_error &)
+        {
+            refused = true;
+        }
+        SIM_ECS_CHECK(refused);
+    }
+
+    std::remove(log_path.c_str());
+    return test::result();
+}
@@ -0,0 +1,189 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+using namespace std::chrono_literals;
+
+using test::item;
+
+namespace
+{
+/**
+ * @brief A system over the one entity in @p components, so @p f runs once a
+ * run
+ */
+template <typename F> system_t once(SystemManager &systems, ComponentManager &components, std::string name, F f)
+{
+    return systems.new_query_system<Read<item>>(
+        std::move(name), system_state::enabled, components, [f](entity_t, const item &) mutable { f(); });
+}
+
+bool deferred(const SystemManager &systems, system_t system)
+{
+    const auto &list = systems.last_deferred();
+    return std::find(list.begin(), list.end(), system) != list.end();
+}
+} // namespace
+
+/**
+ * @brief Systems run at their period and phase, the fixed-step scheduler
+ * catches up at most so far and drops the rest, and over budget only systems
+ * of negative priority are put off, to the next update
+ */
+int main()
+{
+    // Every third update starting from the second, and every update
+    {
+        ComponentManager components;
+        test::spawn_items(components, 1);
+        SystemManager systems;
+        std::vector<std::size_t> slow_runs;
+        std::size_t every_runs = 0;
+        std::size_t update     = 0;
+        auto slow = once(systems, components, "Slow", [&]() { slow_runs.push_back(update); });
+        once(systems, components, "Every", [&]() { ++every_runs; });
+        systems.set_rate(slow, 3, 1);
+        for (; update < 9; ++update)
+        {
+            systems.update({});
+        }
+        SIM_ECS_CHECK(slow_runs == (std::vector<std::size_t>{1, 4, 7}));
+        SIM_ECS_CHECK(every_runs == 9);
+
+        // A phase past the period wraps around
+        slow_runs.clear();
+        systems.set_rate(slow, 3, 5);
+        for (update = 0; update < 6; ++update)
+        {
+            systems.update({});
+        }
+        SIM_ECS_CHECK(slow_runs == (std::vector<std::size_t>{2, 5}));
+    }
+
+    // One update per whole step, catching up at most three at a time
+    {
+        ComponentManager components;
+        test::spawn_items(components, 1);
+        SystemManager systems;
+        std::size_t runs = 0;
+        once(systems, components, "Counter", [&runs]() { ++runs; });
+        FixedStepScheduler scheduler(systems, components, 10ms, 3);
+        std::size_t after = 0;
+        scheduler.set_after_update([&after] { ++after; });
+
+        SIM_ECS_CHECK(scheduler.advance(5ms) == 0);
+        SIM_ECS_CHECK(scheduler.alpha() == 0.5);
+        SIM_ECS_CHECK(scheduler.advance(20ms) == 2);
+        SIM_ECS_CHECK(scheduler.alpha() == 0.5);
+        SIM_ECS_CHECK(scheduler.advance(5ms) == 1);
+        SIM_ECS_CHECK(scheduler.alpha() == 0.0);
+        SIM_ECS_CHECK(scheduler.dropped_steps() == 0);
+
+        // Far behind: three updates, and the rest of the whole steps dropped
+        SIM_ECS_CHECK(scheduler.advance(104ms) == 3);
+        SIM_ECS_CHECK(scheduler.dropped_steps() == 7);
+        SIM_ECS_CHECK(scheduler.alpha() == std::chrono::duration<double>(4ms) / 10ms);
+        SIM_ECS_CHECK(scheduler.steps() == 6 && runs == 6 && after == 6);
+
+        bool refused = false;
+        try
+        {
+            FixedStepScheduler never(systems, components, 0ms);
+        }
+        catch (const std::invalid_argument &)
+        {
+            refused = true;
+        }
+        SIM_ECS_CHECK(refused);
+    }
+
+    // Entities are only listed for systems that work from the list, and are
+    // listed afresh for each step, catching up or not
+    {
+        ComponentManager components;
+        test::spawn_items(components, 1);
+        SystemManager systems;
+        once(systems, components, "Query", [] {});
+        SIM_ECS_CHECK(!systems.needs_entities());
+
+        std::vector<std::size_t> seen{0};
+        auto lister = systems.new_system<const item>(
+            "Lister", system_state::enabled, [](entity_t) { return true; },
+            [&components](entity_t e) { return std::make_tuple(components.get<const item>(e)); },
+            [&seen](entity_t, std::tuple<const item *>) {
+                ++seen.back();
+                return component_set_t{};
+            });
+        SIM_ECS_CHECK(systems.needs_entities());
+
+        // Each step spawns one more before the next
+        FixedStepScheduler scheduler(systems, components, 10ms, 3);
+        scheduler.set_after_update([&] {
+            test::spawn_items(components, 1);
+            seen.push_back(0);
+        });
+        SIM_ECS_CHECK(scheduler.advance(30ms) == 3);
+        SIM_ECS_CHECK(seen == (std::vector<std::size_t>{1, 2, 3, 0}));
+
+        systems.systems.at(lister)->disable();
+        SIM_ECS_CHECK(!systems.needs_entities());
+        SIM_ECS_CHECK(scheduler.advance(10ms) == 1 && seen.back() == 0);
+    }
+
+    // Over budget, the rest of the update's negative-priority systems are put
+    // off to the next update, even one they are not due on
+    {
+        ComponentManager components;
+        test::spawn_items(components, 1);
+        SystemManager systems(2);
+        bool slow_now      = true;
+        std::size_t late   = 0;
+        std::size_t needed = 0;
+        std::size_t early  = 0;
+        auto slow          = once(systems, components, "Slow", [&]() {
+            if (slow_now)
+            {
+                std::this_thread::sleep_for(30ms);
+            }
+        });
+        auto before   = once(systems, components, "Early", [&]() { ++early; });
+        auto optional = once(systems, components, "Optional", [&]() { ++late; });
+        auto essential =
+            once(systems, components, "Essential", [&]() { ++needed; });
+        systems.add_dependency(optional, slow);
+        systems.add_dependency(essential, slow);
+        systems.set_priority(before, -1);
+        systems.set_priority(optional, -1);
+        systems.set_rate(optional, 100);
+        systems.set_time_budget(1ms);
+
+        // The first update is the one optional is due on; it overruns
+        systems.update({});
+        SIM_ECS_CHECK(early == 1 && late == 0 && needed == 1);
+        SIM_ECS_CHECK(deferred(systems, optional) && !deferred(systems, essential) && !deferred(systems, before));
+
+        // The next has time, so optional runs though it is not due
+        slow_now = false;
+        systems.update({});
+        SIM_ECS_CHECK(late == 1 && needed == 2 && systems.last_deferred().empty());
+        systems.update({});
+        SIM_ECS_CHECK(late == 1);
+
+        // Deterministic runs never look at the clock
+        slow_now = true;
+        systems.set_rate(optional, 1);
+        systems.set_deterministic(true);
+        systems.update({});
+        SIM_ECS_CHECK(late == 2 && systems.last_deferred().empty());
+    }
+    return test::result();
+}
@@ -0,0 +1,402 @@
+#include <jnickg/sim_ecs/snapshot.hpp>
+
+#include "test_check.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+
+namespace
+{
+struct position
+{
+    double x = 0.0;
+    double y = 0.0;
+};
+
+struct marker //< A tag, which a snapshot stores no bytes for
+{
+};
+
+const SnapshotSchema &schema()
+{
+    static const SnapshotSchema s = [] {
+        SnapshotSchema s;
+        s.add<position>("test::position");
+        s.add<marker>("test::marker");
+        return s;
+    }();
+    return s;
+}
+
+/**
+ * @brief A small world using everything a snapshot stores: plain, tag and
+ * serialized components, a recycled slot, owners and a disabled entity
+ * @return Its live entities
+ */
+std::vector<entity_t> build_world(ComponentManager &components)
+{
+    std::vector<entity_t> entities;
+    auto world                                      = components.create_entity();
+    components.emplace<WorldTimeComponent>(world).total_time = 12.5;
+    entities.push_back(world);
+
+    components.destroy_entity(components.create_entity());
+    for (int i = 0; i < 5; ++i)
+    {
+        auto e = components.create_entity();
+        components.emplace<position>(e, position{double(i), -0.5 * i});
+        if (i % 2 == 1)
+        {
+            components.emplace<marker>(e);
+        }
+        if (i < 3)
+        {
+            components.set_owner(e, world);
+        }
+        entities.push_back(e);
+    }
+    components.set_enabled(entities.back(), false);
+    components.mark_changed<position>(entities[2]);
+    return entities;
+}
+
+/**
+ * @brief Whether @p a and @p b hold the same @p entities with the same
+ * components, owners and enabled state, and, if @p ticks, change ticks
+ */
+bool same_world(ComponentManager &a, ComponentManager &b, const std::vector<entity_t> &entities, bool ticks)
+{
+    bool ok = true;
+    for (auto e : entities)
+    {
+        ok &= SIM_ECS_CHECK(b.entities().is_alive(e));
+        ok &= SIM_ECS_CHECK(a.has<position>(e) == b.has<position>(e));
+        ok &= SIM_ECS_CHECK(a.has<marker>(e) == b.has<marker>(e));
+        ok &= SIM_ECS_CHECK(a.owner_of(e) == b.owner_of(e));
+        ok &= SIM_ECS_CHECK(a.is_enabled(e) == b.is_enabled(e));
+        if (a.has<position>(e) && b.has<position>(e))
+        {
+            auto pa = a.get_ref<const position>(e), pb = b.get_ref<const position>(e);
+            ok &= SIM_ECS_CHECK(pa->x == pb->x && pa->y == pb->y);
+            for (tick_t t = 0; ticks && t < a.current_change_tick(); ++t)
+            {
+                ok &= SIM_ECS_CHECK(a.changed_since<position>(e, t) == b.changed_since<position>(e, t));
+            }
+        }
+        if (auto ta = a.get_ref<const WorldTimeComponent>(e))
+        {
+            auto tb = b.get_ref<const WorldTimeComponent>(e);
+            ok &= SIM_ECS_CHECK(tb && tb->total_time == ta->total_time);
+        }
+    }
+    // Slots are recycled in the same order
+    ok &= SIM_ECS_CHECK(a.create_entity() == b.create_entity());
+    return ok;
+}
+
+std::string snapshot_of(const ComponentManager &components, bool change_ticks)
+{
+    std::ostringstream os;
+    detail::snapshot_access::write(components, schema(), os, change_ticks);
+    return os.str();
+}
+
+/**
+ * @brief One archetype of a hand-built snapshot: indices into its types, and
+ * the entity in each row
+ */
+struct block
+{
+    std::vector<std::uint32_t> types;
+    std::vector<entity_t> entities;
+};
+
+/**
+ * @brief A snapshot without change ticks of @p slots slots, all alive but the
+ * null one, holding only positions, in @p blocks as given
+ * @details Whatever @p blocks say is written, so a corrupt layout can be
+ * written as easily as a sound one.
+ */
+std::string crafted(std::uint64_t slots, const std::vector<block> &blocks)
+{
+    std::ostringstream os;
+    SnapshotWriter w(os);
+    w.write_bytes(snapshot_magic, sizeof(snapshot_magic));
+    w.write(snapshot_version);
+    w.write(snapshot_bom);
+    w.write<tick_t>(0);
+    w.write<std::uint32_t>(0);
+    w.write(slots);
+    w.align(detail::snapshot_access::array_alignment);
+    for (std::uint64_t i = 0; i < slots; ++i)
+    {
+        w.write<std::uint32_t>(0);
+    }
+    for (std::uint64_t i = 0; i < slots; ++i)
+    {
+        w.write<std::uint8_t>(i != 0);
+    }
+    w.write<std::uint64_t>(0);
+    w.align(detail::snapshot_access::array_alignment);
+
+    w.write<std::uint64_t>(1);
+    w.write_string("test::position");
+    w.write<std::uint8_t>(1);
+    w.write<std::uint64_t>(sizeof(position));
+
+    w.write<std::uint64_t>(blocks.size());
+    for (const auto &b : blocks)
+    {
+        w.write<std::uint64_t>(b.types.size());
+        for (auto type : b.types)
+        {
+            w.write(type);
+        }
+        w.write<std::uint64_t>(b.entities.size());
+        w.align(detail::snapshot_access::array_alignment);
+        w.write_bytes(b.entities.data(), b.entities.size() * sizeof(entity_t));
+        for (std::size_t c = 0; c < b.types.size(); ++c)
+        {
+            w.align(detail::snapshot_access::array_alignment);
+            for (std::size_t row = 0; row < b.entities.size(); ++row)
+            {
+                w.write(position{double(row), 0.0});
+            }
+        }
+    }
+
+    // No relations and nothing disabled
+    for (int section = 0; section < 2; ++section)
+    {
+        w.write<std::uint64_t>(0);
+        w.align(detail::snapshot_access::array_alignment);
+    }
+    return os.str();
+}
+
+/**
+ * @brief Restore @p bytes into a fresh world, expecting either success or a
+ * std::runtime_error and nothing else
+ */
+void restore_or_reject(const std::string &bytes)
+{
+    try
+    {
+        ComponentManager restored;
+        read_snapshot(restored, schema(), bytes.data(), bytes.size());
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+    catch (const std::exception &e)
+    {
+        SIM_ECS_CHECK(!"a corrupt snapshot threw something other than std::runtime_error");
+        std::cerr << "  " << e.what() << "\n";
+    }
+}
+} // namespace
+
+int main()
+{
+    ComponentManager original;
+    auto entities = build_world(original);
+
+    // Read after write, with and without change ticks
+    for (bool ticks : {true, false})
+    {
+        auto bytes = snapshot_of(original, ticks);
+        ComponentManager restored;
+        read_snapshot(restored, schema(), bytes.data(), bytes.size());
+        ComponentManager expected;
+        build_world(expected);
+        SIM_ECS_CHECK(same_world(expected, restored, entities, ticks));
+        if (!ticks)
+        {
+            // Everything counts as added when it was restored
+            for (std::size_t i = 1; i < entities.size(); ++i)
+            {
+                SIM_ECS_CHECK(restored.changed_since<position>(entities[i], restored.current_change_tick() - 1));
+            }
+        }
+    }
+
+    // Any other format version is refused
+    {
+        auto bytes = snapshot_of(original, true);
+        auto other = snapshot_version + 1;
+        std::memcpy(bytes.data() + sizeof(snapshot_magic), &other, sizeof(other));
+        ComponentManager restored;
+        bool refused = false;
+        try
+        {
+            read_snapshot(restored, schema(), bytes.data(), bytes.size());
+        }
+        catch (const std::runtime_error &)
+        {
+            refused = true;
+        }
+        SIM_ECS_CHECK(refused);
+    }
+
+    // Corruption is reported as std::runtime_error, never a crash or a huge
+    // allocation: every truncation, and every word replaced by a huge count
+    auto bytes = snapshot_of(original, true);
+    for (std::size_t size = 0; size < bytes.size(); ++size)
+    {
+        bool rejected = false;
+        try
+        {
+            ComponentManager restored;
+            read_snapshot(restored, schema(), bytes.data(), size);
+        }
+        catch (const std::runtime_error &)
+        {
+            rejected = true;
+        }
+        SIM_ECS_CHECK(rejected);
+    }
+    for (std::size_t at = 0; at + sizeof(std::uint64_t) <= bytes.size(); at += sizeof(std::uint32_t))
+    {
+        for (std::uint64_t huge : {~std::uint64_t{0}, std::uint64_t{1} << 61, std::uint64_t{1} << 32})
+        {
+            auto corrupt = bytes;
+            std::memcpy(&corrupt[at], &huge, sizeof(huge));
+            restore_or_reject(corrupt);
+        }
+    }
+
+    // A free list that would have create() hand out slot 0, a slot past the
+    // end, a live slot or one slot twice is refused
+    {
+        ComponentManager small;
+        std::vector<entity_t> made;
+        for (int i = 0; i < 4; ++i)
+        {
+            made.push_back(small.create_entity());
+            small.emplace<position>(made.back(), position{double(i), 0.0});
+        }
+        small.destroy_entity(made[1]);
+        small.destroy_entity(made[2]);
+        auto good = snapshot_of(small, true);
+
+        // Walk the header to the slot count and the free list
+        SnapshotReader r(good.data(), good.size());
+        r.read_bytes(sizeof(snapshot_magic));
+        r.read<std::uint32_t>();
+        r.read<std::uint32_t>();
+        r.read<tick_t>();
+        r.read<std::uint32_t>();
+        auto slots_at = static_cast<std::size_t>(r.read_bytes(0) - reinterpret_cast<const std::byte *>(good.data()));
+        auto slots    = r.read<std::uint64_t>();
+        r.align(detail::snapshot_access::array_alignment);
+        r.read_array(slots, sizeof(std::uint32_t));
+        auto alive_at = static_cast<std::size_t>(r.read_bytes(slots) - reinterpret_cast<const std::byte *>(good.data()));
+        auto free_count = r.read<std::uint64_t>();
+        r.align(detail::snapshot_access::array_alignment);
+        auto free_at = static_cast<std::size_t>(
+            r.read_array(free_count, sizeof(std::uint32_t)) - reinterpret_cast<const std::byte *>(good.data()));
+        SIM_ECS_CHECK(slots == 5 && free_count == 2);
+
+        // Restored as written, the free list is reused as it would have been
+        {
+            ComponentManager restored;
+            read_snapshot(restored, schema(), good.data(), good.size());
+            auto reused = restored.create_entity();
+            SIM_ECS_CHECK(reused == small.create_entity());
+            SIM_ECS_CHECK(!restored.is_alive(made[2]) && restored.is_alive(made[3]));
+        }
+
+        auto rejected = [](const std::string &bytes) {
+            try
+            {
+                ComponentManager restored;
+                read_snapshot(restored, schema(), bytes.data(), bytes.size());
+            }
+            catch (const std::runtime_error &)
+            {
+                return true;
+            }
+            return false;
+        };
+        auto live = entity_index(made[0]);
+        auto dead = entity_index(made[1]);
+        for (auto [first, second] : {std::pair<std::uint32_t, std::uint32_t>{0, dead}, {dead, 5}, {dead, 1000},
+                 {live, dead}, {dead, dead}})
+        {
+            auto corrupt = good;
+            std::memcpy(&corrupt[free_at], &first, sizeof(first));
+            std::memcpy(&corrupt[free_at + sizeof(first)], &second, sizeof(second));
+            SIM_ECS_CHECK(rejected(corrupt));
+        }
+
+        // As is a world without the null slot, or with it alive
+        auto no_slots = good;
+        std::uint64_t zero = 0;
+        std::memcpy(&no_slots[slots_at], &zero, sizeof(zero));
+        SIM_ECS_CHECK(rejected(no_slots));
+        auto null_alive = good;
+        null_alive[alive_at] = 1;
+        SIM_ECS_CHECK(rejected(null_alive));
+    }
+
+    // Tables, rows and slots that don't line up one to one are refused, and
+    // leave the world they were read into untouched for another try
+    {
+        auto one = make_entity(1, 0);
+        auto two = make_entity(2, 0);
+        auto sound = crafted(3, {{{0}, {one, two}}});
+        std::vector<std::string> corrupt{
+            crafted(3, {{{0}, {one}}, {{0}, {two}}}), // The same table twice
+            crafted(3, {{{0, 0}, {one, two}}}),       // A type twice in a table
+            crafted(3, {{{0}, {one, two, one}}}),     // An entity in two rows
+            crafted(3, {{{0}, {one}}}),               // A live entity with no row
+        };
+
+        ComponentManager fresh;
+        for (const auto &bytes : corrupt)
+        {
+            bool refused_layout = false;
+            try
+            {
+                read_snapshot(fresh, schema(), bytes.data(), bytes.size());
+            }
+            catch (const std::runtime_error &)
+            {
+                refused_layout = true;
+            }
+            SIM_ECS_CHECK(refused_layout);
+            SIM_ECS_CHECK(fresh.entities().size() == 0 && fresh.get_archetypes().size() == 1);
+        }
+        read_snapshot(fresh, schema(), sound.data(), sound.size());
+        SIM_ECS_CHECK(fresh.entities().size() == 2);
+        SIM_ECS_CHECK(fresh.get_ref<const position>(two) && fresh.get_ref<const position>(two)->x == 1.0);
+        std::size_t rows = 0;
+        fresh.query<Read<position>>([&rows](entity_t, const position &) { ++rows; });
+        SIM_ECS_CHECK(rows == 2);
+    }
+
+    // Flags from a newer build are refused rather than misread
+    auto flagged = bytes;
+    std::uint32_t unknown = 1u << 31;
+    std::memcpy(&flagged[sizeof(snapshot_magic) + 2 * sizeof(std::uint32_t) + sizeof(tick_t)], &unknown, sizeof(unknown));
+    bool refused = false;
+    try
+    {
+        ComponentManager restored;
+        read_snapshot(restored, schema(), flagged.data(), flagged.size());
+    }
+    catch (const std::runtime_error &)
+    {
+        refused = true;
+    }
+    SIM_ECS_CHECK(refused);
+
+    return test::result();
+}
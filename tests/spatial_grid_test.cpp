@@ -0,0 +1,195 @@
+#include "simulator.hpp"
+#include "spatial_grid.hpp"
+
+#include "test_check.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+using jnickg::simulator::SpatialGrid2D;
+using jnickg::simulator::SpatialIndexComponent;
+using jnickg::simulator::WandererComponent;
+
+namespace
+{
+using entry = SpatialGrid2D::entry;
+
+std::vector<entity_t> ids_of(const std::vector<entry> &entries)
+{
+    std::vector<entity_t> ids;
+    for (const auto &e : entries)
+    {
+        ids.push_back(e.entity);
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+/**
+ * @brief The entities in @p points that @p keep accepts, sorted
+ */
+template <typename F> std::vector<entity_t> brute_force(const std::vector<entry> &points, F &&keep)
+{
+    std::vector<entity_t> ids;
+    for (const auto &p : points)
+    {
+        if (keep(p))
+        {
+            ids.push_back(p.entity);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+/**
+ * @brief Whether @p v is in `[lo, hi]` on a line that wraps every 20 units
+ */
+bool in_wrapped(double v, double lo, double hi)
+{
+    for (double shift : {-20.0, 0.0, 20.0})
+    {
+        if (v + shift >= lo && v + shift <= hi)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+} // namespace
+
+/**
+ * @brief Radius, box and nearest-neighbor queries agree with brute force,
+ * including across the wrapped edges, and a simulator's index forgets its
+ * wanderers however they are destroyed
+ */
+int main()
+{
+    // A 20 by 20 world that wraps, in 2 by 2 cells
+    SpatialGrid2D grid(-10.0, 10.0, -10.0, 10.0, 2.0);
+
+    // Distances go the short way round
+    SIM_ECS_CHECK(grid.distance_sq(-9.5, 0.0, 9.5, 0.0) == 1.0);
+    SIM_ECS_CHECK(grid.distance_sq(0.0, -9.0, 0.0, 9.0) == 4.0);
+    SIM_ECS_CHECK(grid.distance_sq(-9.0, -9.0, 9.0, 9.0) == 8.0);
+
+    std::mt19937_64 rng(12);
+    std::uniform_real_distribution<double> coord(-10.0, 10.0);
+    std::vector<entry> points;
+    for (std::uint32_t i = 1; i <= 500; ++i)
+    {
+        points.push_back(entry{make_entity(i, 0), coord(rng), coord(rng)});
+        grid.update(points.back().entity, points.back().x, points.back().y);
+    }
+
+    // Move some within their cell and some across, then take some out
+    for (std::size_t i = 0; i < points.size(); i += 3)
+    {
+        points[i].x = i % 2 ? points[i].x + 0.01 : coord(rng);
+        points[i].y = i % 2 ? points[i].y : coord(rng);
+        grid.update(points[i].entity, points[i].x, points[i].y);
+    }
+    for (std::size_t i = 0; i < 50; ++i)
+    {
+        grid.erase(points.back().entity);
+        SIM_ECS_CHECK(!grid.contains(points.back().entity));
+        points.pop_back();
+    }
+    grid.erase(make_entity(9999, 0));
+    SIM_ECS_CHECK(grid.size() == points.size());
+
+    std::vector<std::pair<double, double>> centers{{0.0, 0.0}, {-9.9, 9.9}, {9.5, -3.0}, {coord(rng), coord(rng)}};
+    for (auto [x, y] : centers)
+    {
+        for (double radius : {0.5, 2.5, 7.0, 15.0})
+        {
+            auto expected = brute_force(
+                points, [&](const entry &p) { return grid.distance_sq(x, y, p.x, p.y) <= radius * radius; });
+            SIM_ECS_CHECK(ids_of(grid.in_radius(x, y, radius)) == expected);
+        }
+
+        // Boxes that stay inside and that run off each edge
+        for (double half : {1.0, 4.0, 12.0})
+        {
+            auto expected = brute_force(points, [&](const entry &p) {
+                return in_wrapped(p.x, x - half, x + half) && in_wrapped(p.y, y - half, y + half);
+            });
+            SIM_ECS_CHECK(ids_of(grid.in_box(x - half, y - half, x + half, y + half)) == expected);
+        }
+
+        // Nearest first, the same distances as brute force, and never the one
+        // left out
+        for (std::size_t k : {1, 7, 40})
+        {
+            auto exclude = points[k].entity;
+            auto found   = grid.nearest(x, y, k, exclude);
+            std::vector<double> all;
+            for (const auto &p : points)
+            {
+                if (p.entity != exclude)
+                {
+                    all.push_back(grid.distance_sq(x, y, p.x, p.y));
+                }
+            }
+            std::sort(all.begin(), all.end());
+            SIM_ECS_CHECK(found.size() == k);
+            for (std::size_t i = 0; i < found.size() && i < k; ++i)
+            {
+                SIM_ECS_CHECK(found[i].entity != exclude);
+                SIM_ECS_CHECK(grid.distance_sq(x, y, found[i].x, found[i].y) == all[i]);
+            }
+        }
+    }
+    SIM_ECS_CHECK(grid.nearest(0.0, 0.0, 0).empty());
+    SIM_ECS_CHECK(grid.nearest(0.0, 0.0, points.size() + 10).size() == points.size());
+
+    // A simulator's index keeps only living wanderers, whichever way the
+    // others were destroyed
+    {
+        jnickg::simulator::simulator sim(200, false, 0, 5);
+        sim.run(2);
+        auto &components = *sim.component_manager;
+        std::vector<entity_t> wanderers;
+        entity_t world = NO_ENTITY;
+        components.query<Read<WandererComponent>>([&](entity_t e, const WandererComponent &w) {
+            wanderers.push_back(e);
+            world = w.owner;
+        });
+        auto index_c = components.get_ref<SpatialIndexComponent>(world);
+        SIM_ECS_CHECK(index_c && index_c->grid.size() == wanderers.size());
+
+        auto &commands = sim.system_manager->commands(components);
+        components.destroy_entity(wanderers[0]);
+        components.destroy_entities(std::vector<entity_t>{wanderers[1], wanderers[2], wanderers[1]});
+        components.destroy_with_children(wanderers[3]);
+        commands.local().despawn(wanderers[4]);
+        sim.run(1);
+
+        std::size_t alive = 0;
+        components.query<Read<WandererComponent>>([&alive](entity_t, const WandererComponent &) { ++alive; });
+        SIM_ECS_CHECK(alive == wanderers.size() - 5);
+        SIM_ECS_CHECK(index_c->grid.size() == alive);
+        for (std::size_t i = 0; i < 5; ++i)
+        {
+            SIM_ECS_CHECK(!index_c->grid.contains(wanderers[i]));
+        }
+        bool only_alive = true;
+        for (const auto &e : index_c->grid.in_radius(0.0, 0.0, 100.0))
+        {
+            only_alive = only_alive && components.is_alive(e.entity);
+        }
+        for (const auto &e : index_c->grid.nearest(0.0, 0.0, alive))
+        {
+            only_alive = only_alive && components.is_alive(e.entity);
+        }
+        SIM_ECS_CHECK(only_alive);
+
+        // Taking the world with everything in it is fine too
+        SIM_ECS_CHECK(components.destroy_with_children(world) == alive + 1);
+    }
+    return test::result();
+}
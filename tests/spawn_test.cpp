@@ -0,0 +1,141 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+using test::item;
+
+namespace
+{
+struct velocity
+{
+    double dx = 0.0;
+    double dy = 0.0;
+};
+
+/**
+ * @brief A ComponentBase-derived component that says how to copy itself
+ */
+struct label : public ComponentBase
+{
+    std::string text;
+
+    label(std::string text = "") : text{std::move(text)} {}
+    label(const label &other) : ComponentBase(), text{other.text} {}
+};
+
+/**
+ * @brief One that can't be copied at all
+ */
+struct handle_only : public ComponentBase
+{
+};
+
+std::size_t count_items(ComponentManager &components)
+{
+    std::size_t n = 0;
+    components.query<Read<item>>([&n](entity_t, const item &) { ++n; });
+    return n;
+}
+} // namespace
+
+/**
+ * @brief Bulk spawns and prefab copies make contiguous ranges of entities
+ * holding their own copies, and batch destroys take whichever are alive
+ */
+int main()
+{
+    ComponentManager components;
+
+    // Copies of the prototypes, one contiguous range of fresh slots even with
+    // free ones around
+    auto loose = components.create_entity();
+    components.destroy_entity(loose);
+    auto batch = components.spawn_batch(100, item{7}, velocity{1.0, -1.0}, label{"batch"});
+    SIM_ECS_CHECK(batch.size() == 100);
+    SIM_ECS_CHECK(entity_index(batch[0]) > entity_index(loose));
+    bool copied = true;
+    for (auto e : batch)
+    {
+        auto i = components.get_ref<const item>(e);
+        auto v = components.get_ref<const velocity>(e);
+        auto l = components.get_ref<const label>(e);
+        copied = copied && components.is_alive(e) && i && i->id == 7 && v && v->dx == 1.0 && l && l->text == "batch";
+    }
+    SIM_ECS_CHECK(copied);
+    components.get_ref<label>(batch[0])->text = "changed";
+    SIM_ECS_CHECK(components.get_ref<const label>(batch[1])->text == "batch");
+    SIM_ECS_CHECK(components.spawn_batch(0, item{}).empty());
+
+    // Rows each hold their own values, in order
+    auto rows = components.spawn_rows<item, velocity>({{item{1}, velocity{}}, {item{2}, velocity{}}});
+    SIM_ECS_CHECK(rows.size() == 2 && entity_index(rows[0]) == batch.first + batch.size());
+    SIM_ECS_CHECK(components.get_ref<const item>(rows[1])->id == 2);
+
+    // A prefab's copies have every component it has, and their own copies
+    auto prefab = components.create_entity();
+    components.emplace<item>(prefab, item{42});
+    components.emplace<label>(prefab, "prefab");
+    auto copies = components.instantiate(prefab, 10);
+    SIM_ECS_CHECK(copies.size() == 10 && !copies.contains(prefab));
+    bool cloned = true;
+    for (auto e : copies)
+    {
+        auto l = components.get_ref<const label>(e);
+        cloned = cloned && components.get_ref<const item>(e)->id == 42 && l && l->text == "prefab" &&
+                 !components.has<velocity>(e);
+    }
+    SIM_ECS_CHECK(cloned);
+    components.get_ref<label>(prefab)->text = "edited";
+    SIM_ECS_CHECK(components.get_ref<const label>(copies[9])->text == "prefab");
+    SIM_ECS_CHECK(count_items(components) == 100 + 2 + 1 + 10);
+
+    // Dead prefabs and ones holding what can't be copied are refused, with
+    // nothing spawned
+    auto dead = components.create_entity();
+    components.destroy_entity(dead);
+    auto alive_before = components.entities().size();
+    bool refused_dead = false;
+    try
+    {
+        components.instantiate(dead, 3);
+    }
+    catch (const std::out_of_range &)
+    {
+        refused_dead = true;
+    }
+    auto stuck = components.create_entity();
+    components.emplace<handle_only>(stuck);
+    ++alive_before;
+    bool refused_stuck = false;
+    try
+    {
+        components.instantiate(stuck, 3);
+    }
+    catch (const std::logic_error &)
+    {
+        refused_stuck = true;
+    }
+    SIM_ECS_CHECK(refused_dead && refused_stuck);
+    SIM_ECS_CHECK(components.entities().size() == alive_before);
+
+    // Batch destroys skip the dead and the repeated, and leave the rest
+    std::vector<entity_t> doomed{batch[3], copies[0], batch[3], loose, batch[99], rows[0]};
+    SIM_ECS_CHECK(components.destroy_entities(doomed) == 4);
+    SIM_ECS_CHECK(!components.is_alive(batch[3]) && !components.is_alive(copies[0]) && !components.is_alive(rows[0]));
+    SIM_ECS_CHECK(components.is_alive(batch[4]) && components.get_ref<const item>(batch[98])->id == 7);
+    SIM_ECS_CHECK(components.get_ref<const label>(copies[1])->text == "prefab");
+    SIM_ECS_CHECK(components.destroy_entities(doomed) == 0);
+
+    SIM_ECS_CHECK(components.destroy_entities(copies) == 9);
+    SIM_ECS_CHECK(count_items(components) == 100 - 2 + 1 + 1);
+    SIM_ECS_CHECK(components.get_ref<const item>(rows[1])->id == 2 && components.is_alive(prefab));
+    return test::result();
+}
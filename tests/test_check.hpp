@@ -0,0 +1,61 @@
+#pragma once
+
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+namespace jnickg::sim_ecs::test
+{
+inline int failures = 0; //< Checks that have failed so far in this test
+
+/**
+ * @brief Report @p expr, from @p file at @p line, if it did not hold
+ */
+inline bool check(bool ok, const char *expr, const char *file, int line)
+{
+    if (!ok)
+    {
+        std::cerr << file << ":" << line << ": check failed: " << expr << "\n";
+        ++failures;
+    }
+    return ok;
+}
+
+/**
+ * @brief The exit code for a test: zero if every check held
+ */
+inline int result() { return failures == 0 ? 0 : 1; }
+
+/**
+ * @brief The worker counts that tests of scheduling run with: the calling
+ * thread alone, and a pool
+ */
+inline constexpr std::size_t worker_counts[] = {1, 4};
+
+/**
+ * @brief A component that only numbers its entity
+ */
+struct item
+{
+    std::uint32_t id = 0;
+};
+
+/**
+ * @brief Create @p count entities with an item each, numbered from zero in
+ * the order their rows are laid out
+ */
+inline void spawn_items(ComponentManager &components, std::uint32_t count)
+{
+    for (std::uint32_t id = 0; id < count; ++id)
+    {
+        components.emplace<item>(components.create_entity(), item{id});
+    }
+}
+} // namespace jnickg::sim_ecs::test
+
+/**
+ * @brief Check that @p expr holds, carrying on with the test either way
+ */
+#define SIM_ECS_CHECK(expr) ::jnickg::sim_ecs::test::check(static_cast<bool>(expr), #expr, __FILE__, __LINE__)
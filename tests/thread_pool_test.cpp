@@ -0,0 +1,152 @@
+#include <jnickg/sim_ecs/thread_pool.hpp>
+
+#include "test_check.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+
+/**
+ * @brief Every task submitted runs exactly once, the first exception a group
+ * hits is rethrown by wait() once the rest have finished, and tasks can wait
+ * on nested groups without deadlocking the pool
+ */
+int main()
+{
+    for (std::size_t workers : {0, 1, 4})
+    {
+        ThreadPool pool(workers);
+
+        // Every task runs once, and parallel_for covers every index once
+        {
+            std::vector<std::atomic<int>> runs(1000);
+            ThreadPool::TaskGroup group;
+            for (std::size_t i = 0; i < runs.size(); ++i)
+            {
+                pool.submit(group, [&runs, i] { ++runs[i]; });
+            }
+            pool.wait(group);
+            SIM_ECS_CHECK(group.done());
+            pool.parallel_for(runs.size(), 64, [&runs](std::size_t begin, std::size_t end, std::size_t chunk) {
+                SIM_ECS_CHECK(begin == chunk * 64);
+                for (auto i = begin; i < end; ++i)
+                {
+                    ++runs[i];
+                }
+            });
+            bool all_twice = true;
+            for (auto &r : runs)
+            {
+                all_twice = all_twice && r == 2;
+            }
+            SIM_ECS_CHECK(all_twice);
+        }
+
+        // Tasks run on workers report which one, and others report none
+        SIM_ECS_CHECK(pool.current_worker() == ThreadPool::npos);
+        if (workers > 0)
+        {
+            std::atomic<bool> in_range{true};
+            ThreadPool::TaskGroup group;
+            for (int i = 0; i < 100; ++i)
+            {
+                pool.submit(group, [&] {
+                    auto worker = pool.current_worker();
+                    if (worker != ThreadPool::npos && worker >= pool.size())
+                    {
+                        in_range = false;
+                    }
+                });
+            }
+            pool.wait(group);
+            SIM_ECS_CHECK(in_range);
+        }
+
+        // A task that throws does not stop the rest of its group, and wait()
+        // rethrows once, after they have all finished
+        if (workers > 0)
+        {
+            std::atomic<int> finished{0};
+            ThreadPool::TaskGroup group;
+            for (int i = 0; i < 50; ++i)
+            {
+                pool.submit(group, [&finished, i] {
+                    if (i % 10 == 3)
+                    {
+                        throw std::runtime_error("task failed");
+                    }
+                    ++finished;
+                });
+            }
+            bool threw = false;
+            try
+            {
+                pool.wait(group);
+            }
+            catch (const std::runtime_error &)
+            {
+                threw = true;
+            }
+            SIM_ECS_CHECK(threw);
+            SIM_ECS_CHECK(finished == 45);
+            SIM_ECS_CHECK(group.done());
+
+            // The error was handed over, so the group can be reused
+            pool.submit(group, [&finished] { ++finished; });
+            pool.wait(group);
+            SIM_ECS_CHECK(finished == 46);
+        }
+
+        // Tasks that submit and wait on groups of their own, two levels deep,
+        // more of them than there are workers
+        {
+            std::atomic<int> leaves{0};
+            ThreadPool::TaskGroup outer;
+            for (int i = 0; i < 8; ++i)
+            {
+                pool.submit(outer, [&pool, &leaves] {
+                    ThreadPool::TaskGroup middle;
+                    for (int j = 0; j < 8; ++j)
+                    {
+                        pool.submit(middle, [&pool, &leaves] {
+                            ThreadPool::TaskGroup inner;
+                            for (int k = 0; k < 8; ++k)
+                            {
+                                pool.submit(inner, [&leaves] { ++leaves; });
+                            }
+                            pool.wait(inner);
+                        });
+                    }
+                    pool.wait(middle);
+                });
+            }
+            pool.wait(outer);
+            SIM_ECS_CHECK(leaves == 8 * 8 * 8);
+        }
+
+        // An exception from a nested group reaches the outermost wait()
+        if (workers > 0)
+        {
+            ThreadPool::TaskGroup outer;
+            pool.submit(outer, [&pool] {
+                ThreadPool::TaskGroup inner;
+                pool.submit(inner, [] { throw std::logic_error("nested task failed"); });
+                pool.wait(inner);
+            });
+            bool threw = false;
+            try
+            {
+                pool.wait(outer);
+            }
+            catch (const std::logic_error &)
+            {
+                threw = true;
+            }
+            SIM_ECS_CHECK(threw);
+        }
+    }
+    return test::result();
+}
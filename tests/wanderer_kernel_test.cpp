@@ -0,0 +1,221 @@
+#include "wanderer_kernel.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using jnickg::simulator::move_wanderers;
+using jnickg::simulator::WandererComponent;
+using jnickg::simulator::wrap_bounds;
+namespace detail = jnickg::simulator::detail;
+
+namespace
+{
+constexpr int skipped = 77; //< Tells ctest the CPU cannot run the path this was built for
+
+const wrap_bounds bounds{-10.0, 10.0, -5.0, 7.5};
+
+/**
+ * @brief Wanderers and time steps mixing random values with the edge cases
+ * the SIMD paths are most likely to get wrong
+ */
+struct lanes
+{
+    std::vector<WandererComponent> wanderers;
+    std::vector<double> dt;
+};
+
+lanes make_lanes(std::size_t count, std::uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    auto pick = [&](const std::vector<double> &values) {
+        return values[std::uniform_int_distribution<std::size_t>(0, values.size() - 1)(rng)];
+    };
+    auto inf = std::numeric_limits<double>::infinity();
+    std::uniform_real_distribution<double> inside_x(bounds.min_x, bounds.max_x);
+    std::uniform_real_distribution<double> inside_y(bounds.min_y, bounds.max_y);
+    std::uniform_real_distribution<double> heading(-7.0, 7.0);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    // On each bound, and one ulp either side of it
+    std::vector<double> edge_x = {bounds.min_x, bounds.max_x, std::nextafter(bounds.min_x, -inf),
+        std::nextafter(bounds.min_x, inf), std::nextafter(bounds.max_x, -inf), std::nextafter(bounds.max_x, inf)};
+    std::vector<double> edge_y = {bounds.min_y, bounds.max_y, std::nextafter(bounds.min_y, -inf),
+        std::nextafter(bounds.min_y, inf), std::nextafter(bounds.max_y, -inf), std::nextafter(bounds.max_y, inf)};
+    // Negative, multiples of pi/4 and far beyond 2 pi
+    std::vector<double> far_headings = {-1e-300, -0.0, 0.7853981633974483, -2.356194490192345, 3.141592653589793,
+        -4.71238898038469, 1e3, -1e3, 123456.789, -98765.4321, 1e6 + 0.5, -(1 << 29) + 0.25};
+    // Zero so edge positions only meet the wrap, and far more than the world
+    std::vector<double> speeds = {0.0, 1e-12, 1.0, 30.0, 1e3, 1e6};
+    std::vector<double> steps  = {0.0, -0.0, 1e-9, 0.25, 1.0, 17.0, -1.0};
+
+    lanes out;
+    out.wanderers.resize(count);
+    out.dt.resize(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto &w     = out.wanderers[i];
+        w.owner     = i;
+        w.x         = unit(rng) < 0.3 ? pick(edge_x) : inside_x(rng);
+        w.y         = unit(rng) < 0.3 ? pick(edge_y) : inside_y(rng);
+        w.speed     = unit(rng) < 0.4 ? pick(speeds) : unit(rng) * 2.0;
+        w.direction = unit(rng) < 0.4 ? pick(far_headings) : heading(rng);
+        out.dt[i]   = unit(rng) < 0.4 ? pick(steps) : unit(rng);
+    }
+    return out;
+}
+
+/**
+ * @brief Move a copy of @p input with @p kernel and a copy with the scalar
+ * path, and report every lane where they differ in any bit or in whether they
+ * wrapped
+ */
+template <typename Kernel> bool matches_scalar(const std::string &name, const lanes &input, Kernel &&kernel)
+{
+    auto expected = input.wanderers;
+    std::vector<std::uint8_t> expected_wrapped(expected.size());
+    for (std::size_t i = 0; i < expected.size(); ++i)
+    {
+        expected_wrapped[i] = detail::move_wanderer(expected[i], input.dt[i], bounds);
+    }
+    auto actual = input.wanderers;
+    // Anything but 0 or 1 shows a lane the kernel never flagged
+    std::vector<std::uint8_t> actual_wrapped(actual.size(), 0xA5);
+    kernel(actual.data(), input.dt.data(), actual.size(), actual_wrapped.data());
+
+    bool ok = true;
+    for (std::size_t i = 0; i < actual.size(); ++i)
+    {
+        if (std::memcmp(&actual[i], &expected[i], sizeof(WandererComponent)) != 0
+            || actual_wrapped[i] != expected_wrapped[i])
+        {
+            const auto &in = input.wanderers[i];
+            std::cerr << name << ": lane " << i << " of " << actual.size() << " differs. In: x=" << in.x
+                      << " y=" << in.y << " speed=" << in.speed << " direction=" << in.direction
+                      << " dt=" << input.dt[i] << ". Kernel: (" << actual[i].x << ", " << actual[i].y
+                      << ", wrapped=" << int(actual_wrapped[i]) << "), scalar: (" << expected[i].x << ", "
+                      << expected[i].y << ", wrapped=" << int(expected_wrapped[i]) << ")\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief How many representable doubles apart @p a and @p b are, counting
+ * -0.0 and 0.0 as the same
+ */
+std::uint64_t ulps_apart(double a, double b)
+{
+    auto ordered = [](double d) {
+        std::int64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        return bits < 0 ? std::numeric_limits<std::int64_t>::min() - bits : bits;
+    };
+    auto ia = ordered(a);
+    auto ib = ordered(b);
+    return ia > ib ? static_cast<std::uint64_t>(ia) - static_cast<std::uint64_t>(ib)
+                   : static_cast<std::uint64_t>(ib) - static_cast<std::uint64_t>(ia);
+}
+
+/**
+ * @brief Check fast_sincos() against std::sin and std::cos, within the 2 ulp
+ * it promises for |x| up to 2^22
+ * @details The SIMD paths must match the scalar path bit for bit, so this
+ * bounds their error too.
+ */
+bool sincos_within_bound()
+{
+    constexpr std::uint64_t max_ulps = 2;
+    std::vector<double> xs = {0.0, -0.0, 1e-300, -1e-300, 1e-8, 0.5, -0.5, 0x1p22, -0x1p22};
+    // Around each multiple of pi/2 over a few turns, where the reduction
+    // cancels most of x
+    for (int k = -16; k <= 16; ++k)
+    {
+        auto x = k * 1.5707963267948966;
+        xs.push_back(std::nextafter(x, -std::numeric_limits<double>::infinity()));
+        xs.push_back(x);
+        xs.push_back(std::nextafter(x, std::numeric_limits<double>::infinity()));
+    }
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> heading(-7.0, 7.0);
+    std::uniform_real_distribution<double> far(-0x1p22, 0x1p22);
+    for (int i = 0; i < 200000; ++i)
+    {
+        xs.push_back(heading(rng));
+        xs.push_back(far(rng));
+    }
+
+    bool ok = true;
+    for (auto x : xs)
+    {
+        double sin_x, cos_x;
+        detail::fast_sincos(x, sin_x, cos_x);
+        auto sin_ulps = ulps_apart(sin_x, std::sin(x));
+        auto cos_ulps = ulps_apart(cos_x, std::cos(x));
+        if (sin_ulps > max_ulps || cos_ulps > max_ulps)
+        {
+            std::cerr.precision(17);
+            std::cerr << "fast_sincos(" << x << ") = (" << sin_x << ", " << cos_x << "), " << sin_ulps << " and "
+                      << cos_ulps << " ulp from std::sin and std::cos\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief A SIMD path followed by the scalar path for the lanes it leaves over,
+ * as move_wanderers() runs it
+ */
+template <typename Path> auto with_tail(Path path)
+{
+    return [path](WandererComponent *w, const double *dt, std::size_t count, std::uint8_t *wrapped) {
+        for (auto i = path(w, dt, count, bounds, wrapped); i < count; ++i)
+        {
+            wrapped[i] = detail::move_wanderer(w[i], dt[i], bounds);
+        }
+    };
+}
+} // namespace
+
+int main()
+{
+#if defined(__AVX2__) && defined(__GNUC__)
+#if defined(__FMA__)
+    bool runnable = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    bool runnable = __builtin_cpu_supports("avx2");
+#endif
+    if (!runnable)
+    {
+        std::cout << "This CPU cannot run the AVX2 build of the kernel" << std::endl;
+        return skipped;
+    }
+#endif
+
+    bool ok = sincos_within_bound();
+    // Every tail length after each of the SIMD widths, then runs long enough
+    // to hit the rarer edge cases many times over
+    std::vector<std::size_t> counts = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 31, 1000, 4097, 100003};
+    for (std::size_t c = 0; c < counts.size(); ++c)
+    {
+        auto input = make_lanes(counts[c], c + 1);
+        ok &= matches_scalar("move_wanderers", input,
+            [](WandererComponent *w, const double *dt, std::size_t count, std::uint8_t *wrapped) {
+                move_wanderers(w, dt, count, bounds, wrapped);
+            });
+#if defined(__SSE2__)
+        ok &= matches_scalar("move_wanderers_sse2", input, with_tail(detail::move_wanderers_sse2));
+#endif
+#if defined(__AVX2__)
+        ok &= matches_scalar("move_wanderers_avx2", input, with_tail(detail::move_wanderers_avx2));
+#endif
+    }
+    return ok ? 0 : 1;
+}
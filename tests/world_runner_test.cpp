@@ -0,0 +1,112 @@
+#include <jnickg/sim_ecs/sim_ecs.hpp>
+
+#include "test_check.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+using namespace jnickg::sim_ecs;
+
+namespace
+{
+struct tally
+{
+    std::uint64_t value = 0;
+    std::uint64_t step  = 1;
+};
+
+/**
+ * @brief A World whose entities each add their step to their tally every tick
+ */
+struct counting_world : public World
+{
+    explicit counting_world(std::uint64_t seed)
+    {
+        for (std::uint64_t i = 0; i < 50 + seed * 10; ++i)
+        {
+            components->emplace<tally>(components->create_entity(), tally{0, stable_random(seed, i) % 100});
+        }
+        systems->new_query_system<Write<tally>>(
+            "Tally", system_state::enabled, *components, [](entity_t, tally &t) { t.value += t.step; });
+    }
+
+    std::uint64_t total() const
+    {
+        std::uint64_t sum = 0;
+        components->query<Read<tally>>([&sum](entity_t, const tally &t) { sum += t.value; });
+        return sum;
+    }
+};
+
+/**
+ * @brief Counts its ticks, and throws on its first if told to
+ */
+struct fragile_world
+{
+    bool fails;
+    std::atomic<std::size_t> ticks{0};
+
+    explicit fragile_world(bool fails) : fails{fails} {}
+
+    void run(std::size_t t)
+    {
+        if (fails)
+        {
+            throw std::runtime_error("This world fails");
+        }
+        ticks += t;
+    }
+};
+} // namespace
+
+/**
+ * @brief Worlds run side by side end up as they would run one at a time, are
+ * gathered in world order, and one that throws does not stop the rest
+ */
+int main()
+{
+    constexpr std::size_t world_count = 12;
+    constexpr std::size_t ticks       = 7;
+
+    WorldRunner<counting_world> runner(4);
+    for (std::size_t w = 0; w < world_count; ++w)
+    {
+        runner.emplace(w);
+    }
+    SIM_ECS_CHECK(runner.size() == world_count);
+    runner.run(ticks);
+    runner.run(ticks);
+
+    auto totals = runner.gather([](counting_world &world) { return world.total(); });
+    SIM_ECS_CHECK(totals.size() == world_count);
+    for (std::size_t w = 0; w < world_count; ++w)
+    {
+        counting_world alone(w);
+        alone.run(2 * ticks);
+        SIM_ECS_CHECK(totals[w] == alone.total());
+        SIM_ECS_CHECK(runner.world(w).total() == totals[w]);
+    }
+
+    WorldRunner<fragile_world> fragile(3);
+    for (std::size_t w = 0; w < 8; ++w)
+    {
+        fragile.emplace(w == 2);
+    }
+    bool threw = false;
+    try
+    {
+        fragile.run(5);
+    }
+    catch (const std::runtime_error &)
+    {
+        threw = true;
+    }
+    SIM_ECS_CHECK(threw);
+    for (std::size_t w = 0; w < 8; ++w)
+    {
+        SIM_ECS_CHECK(fragile.world(w).ticks == (w == 2 ? 0 : 5));
+    }
+    return test::result();
+}